@@ -0,0 +1,63 @@
+#include <chrono>
+#include <list>
+
+#include "commons/logger.hpp"
+
+#include "benchapi.hpp"
+
+
+#define DECLARE_BENCH_SUIT(SuitName) \
+    EXTERN_TEST void Collect ## SuitName ## Benchmarks(TestDesc**, int*)
+
+
+#define ENABLE_BENCH_SUIT(BenchesListVar, SuitName) \
+    do{ \
+        TestDesc* pDescs; \
+        int nbDescs; \
+        Collect ## SuitName ## Benchmarks(&pDescs, &nbDescs); \
+        for (int i = 0; i < nbDescs; ++i) { \
+            (BenchesListVar).push_back(pDescs[i]); \
+        } \
+    } while(false)
+
+
+DECLARE_BENCH_SUIT(MpmcBoundedQueue);
+DECLARE_BENCH_SUIT(PayloadPool);
+DECLARE_BENCH_SUIT(SpscBoundedQueue);
+DECLARE_BENCH_SUIT(UdpDgram);
+DECLARE_BENCH_SUIT(UdpEngine);
+DECLARE_BENCH_SUIT(UdpPipe);
+
+
+int main(int argc, char** argv) {
+
+    LOGI << "UDP Pipes benchmarking";
+
+    std::list<TestDesc> allBenches;
+
+    ENABLE_BENCH_SUIT(allBenches, MpmcBoundedQueue);
+    ENABLE_BENCH_SUIT(allBenches, PayloadPool);
+    ENABLE_BENCH_SUIT(allBenches, SpscBoundedQueue);
+    ENABLE_BENCH_SUIT(allBenches, UdpDgram);
+    ENABLE_BENCH_SUIT(allBenches, UdpEngine);
+    ENABLE_BENCH_SUIT(allBenches, UdpPipe);
+
+    LOGI << "Running " << allBenches.size() << " benchmarks:";
+
+    int benchIndex = 0;
+    for(auto &bd : allBenches) {
+        std::chrono::steady_clock::time_point startTp = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < bd.mNumIterations; ++i) {
+            if (!bd.mMethod())
+                return 1;
+        }
+
+        std::chrono::steady_clock::time_point finishTp = std::chrono::steady_clock::now();
+        std::chrono::duration<float> elapsedMs = (finishTp - startTp) * 1000.f;
+
+        LOGI << "[" << ++benchIndex << "/" << allBenches.size() << "] " << bd.mName << " finished in " << elapsedMs.count() << " ms.";
+    }
+
+    return 0;
+}
@@ -26,8 +26,13 @@
     } while(false)
 
 
+DECLARE_SUIT(MpmcBoundedQueue);
+DECLARE_SUIT(PayloadPool);
+DECLARE_SUIT(SpscBoundedQueue);
 DECLARE_SUIT(Threader);
+DECLARE_SUIT(UdpDgram);
 DECLARE_SUIT(UdpEngine);
+DECLARE_SUIT(UdpPipe);
 
 
 int main(int argc, char** argv) {
@@ -36,8 +41,13 @@ int main(int argc, char** argv) {
 
     std::list<TestDesc> allTests;
 
+    ENABLE_SUIT(allTests, MpmcBoundedQueue);
+    ENABLE_SUIT(allTests, PayloadPool);
+    ENABLE_SUIT(allTests, SpscBoundedQueue);
     ENABLE_SUIT(allTests, Threader);
+    ENABLE_SUIT(allTests, UdpDgram);
     ENABLE_SUIT(allTests, UdpEngine);
+    ENABLE_SUIT(allTests, UdpPipe);
 
     LOGI << "Running " << allTests.size() << " tests:";
 
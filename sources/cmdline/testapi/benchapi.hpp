@@ -0,0 +1,26 @@
+#ifndef UDP_UDPCMD_TESTAPI_BENCHAPI_HPP_
+#define UDP_UDPCMD_TESTAPI_BENCHAPI_HPP_
+
+
+#include "testapi.hpp"
+
+
+//! @NOTE(stoned_fox): benchmarks reuse the test descriptors and CHECK_* macros, but are collected
+//!                    into a separate executable, since they are too slow for the unit tests run.
+
+
+#define START_BENCH_SUIT_DECLARATION(SuitName) \
+    static TestDesc s ## SuitName ## Benchmarks[] = {
+
+#define DECLARE_BENCH(Method) \
+    TestDesc{ .mMethod = &(Method), .mName = # Method, .mNumIterations = 1 },
+
+#define FINISH_BENCH_SUIT_DECLARATION(SuitName) \
+    }; \
+    EXTERN_TEST void Collect ## SuitName ## Benchmarks(TestDesc** pDescs, int* outDescsNum) { \
+        *pDescs = s ## SuitName ## Benchmarks; \
+        *outDescsNum = sizeof(s ## SuitName ## Benchmarks) / sizeof(s ## SuitName ## Benchmarks[0]); \
+    }
+
+
+#endif//UDP_UDPCMD_TESTAPI_BENCHAPI_HPP_
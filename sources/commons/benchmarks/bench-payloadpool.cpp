@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "commons/logger.hpp"
+#include "commons/macros.h"
+
+#include "commons/payloadpool.hpp"
+#include "commons/queue.hpp"
+
+#include "benchapi.hpp"
+
+
+#pragma mark - Benchmarks Declarations
+
+bool bench__udp_PayloadPool__same_thread_vs_malloc();
+bool bench__udp_PayloadPool__cross_thread_vs_malloc();
+
+
+START_BENCH_SUIT_DECLARATION(PayloadPool)
+    DECLARE_BENCH(bench__udp_PayloadPool__same_thread_vs_malloc)
+    DECLARE_BENCH(bench__udp_PayloadPool__cross_thread_vs_malloc)
+FINISH_BENCH_SUIT_DECLARATION(PayloadPool)
+
+
+#pragma mark - Benchmarks Utils
+
+using udp::PayloadPool;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+namespace {
+
+
+/// typical dgram sizes: an ack, a small message and a full ethernet payload
+const size_t sPayloadSizes[] = { 64, 512, 1400 };
+
+
+struct PoolAllocator {
+    static const char* Name() { return "pool"; }
+
+    static uint8_t* Allocate(size_t szPayload) { return PayloadPool::GetInstancePtr()->allocate(szPayload); }
+    static void Free(uint8_t* pPayload) { PayloadPool::Release(pPayload); }
+};
+
+
+struct MallocAllocator {
+    static const char* Name() { return "malloc"; }
+
+    static uint8_t* Allocate(size_t szPayload) { return (uint8_t*)std::malloc(szPayload); }
+    static void Free(uint8_t* pPayload) { std::free(pPayload); }
+};
+
+
+//! allocates a batch of payloads (like a recieve batch does) and frees it on the same thread.
+template < typename Allocator >
+bool MeasureSameThread() {
+
+    static const size_t sNbRounds = 100000;
+    static const size_t sBatchSize = 64;
+
+    uint8_t* payloads[sBatchSize];
+
+    std_clock::time_point startTp = std_clock::now();
+
+    for (size_t round = 0; round < sNbRounds; ++round) {
+        for (size_t i = 0; i < sBatchSize; ++i) {
+            size_t szPayload = sPayloadSizes[(round + i) % 3];
+
+            payloads[i] = Allocator::Allocate(szPayload);
+            CHECK_TRUE(!!payloads[i]);
+
+            payloads[i][0] = (uint8_t)i; // touch it, as a recieve does
+        }
+
+        for (size_t i = 0; i < sBatchSize; ++i) {
+            Allocator::Free(payloads[i]);
+        }
+    }
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000000000.0f;
+
+    LOGI << "BENCH " << Allocator::Name() << ", same thread: "
+         << (elapsed.count() / (sNbRounds * sBatchSize)) << " ns per allocation and free";
+
+    return true;
+}
+
+
+//! the producer allocates payloads, the consumer frees them - the way the engine thread recieves
+//! dgrams and a user thread drops them after processing.
+template < typename Allocator >
+bool MeasureCrossThread() {
+
+    static const size_t sNbPayloads = 2000000;
+
+    udp::MpmcBoundedQueue<uint8_t*> queue(4096);
+
+    std::thread consumer([&queue]() {
+        size_t nbFreed = 0;
+        while (nbFreed < sNbPayloads) {
+            uint8_t* pPayload;
+            if (!queue.dequeue(pPayload)) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            Allocator::Free(pPayload);
+            ++nbFreed;
+        }
+    });
+
+    std_clock::time_point startTp = std_clock::now();
+
+    for (size_t i = 0; i < sNbPayloads; ++i) {
+        uint8_t* pPayload = Allocator::Allocate(sPayloadSizes[i % 3]);
+        CHECK_TRUE(!!pPayload);
+
+        pPayload[0] = (uint8_t)i;
+
+        while (!queue.enqueue(std::move(pPayload)))
+            std::this_thread::yield();
+    }
+
+    consumer.join();
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+
+    LOGI << "BENCH " << Allocator::Name() << ", freed on another thread: "
+         << (sNbPayloads / elapsed.count() / 1000.0f) << " M payloads/s, "
+         << (elapsed.count() * 1000000.0f / sNbPayloads) << " ns per payload";
+
+    return true;
+}
+
+
+}
+
+
+#pragma mark - same thread
+
+bool bench__udp_PayloadPool__same_thread_vs_malloc() {
+
+    if (!MeasureSameThread<MallocAllocator>())
+        return false;
+
+    return MeasureSameThread<PoolAllocator>();
+}
+
+
+#pragma mark - cross thread
+
+bool bench__udp_PayloadPool__cross_thread_vs_malloc() {
+
+    if (!MeasureCrossThread<MallocAllocator>())
+        return false;
+
+    LOGI << "BENCH pool system allocations before: " << PayloadPool::GetInstancePtr()->stats().mNbSystemAllocations;
+
+    if (!MeasureCrossThread<PoolAllocator>())
+        return false;
+
+    LOGI << "BENCH pool system allocations after: " << PayloadPool::GetInstancePtr()->stats().mNbSystemAllocations;
+
+    return true;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "commons/logger.hpp"
+#include "commons/macros.h"
+
+#include "commons/queue.hpp"
+
+#include "benchapi.hpp"
+
+
+#pragma mark - Benchmarks Declarations
+
+bool bench__udp_MpmcBoundedQueue__bulk_vs_single();
+bool bench__udp_MpmcBoundedQueue__wait_strategies();
+
+
+START_BENCH_SUIT_DECLARATION(MpmcBoundedQueue)
+    DECLARE_BENCH(bench__udp_MpmcBoundedQueue__bulk_vs_single)
+    DECLARE_BENCH(bench__udp_MpmcBoundedQueue__wait_strategies)
+FINISH_BENCH_SUIT_DECLARATION(MpmcBoundedQueue)
+
+
+bool bench__udp_SpscBoundedQueue__spsc_vs_mpmc();
+
+
+START_BENCH_SUIT_DECLARATION(SpscBoundedQueue)
+    DECLARE_BENCH(bench__udp_SpscBoundedQueue__spsc_vs_mpmc)
+FINISH_BENCH_SUIT_DECLARATION(SpscBoundedQueue)
+
+
+#pragma mark - Benchmarks Utils
+
+using udp::MpmcBoundedQueue;
+using udp::SpscBoundedQueue;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+namespace {
+
+
+//! producers push items in batches of `szBatch`, consumers pop them in batches of the same size;
+//! a batch of 1 uses the single item operations.
+template < template <typename> class Queue >
+bool MeasureThroughput(const char* name, int nbProducers, int nbConsumers, size_t szBatch) {
+
+    static const size_t sNbItems = 4000000;
+    static const size_t sQueueSize = 4096;
+
+    Queue<size_t> queue(sQueueSize);
+
+    const size_t nbPerProducer = sNbItems / nbProducers;
+    const size_t nbTotal = nbPerProducer * nbProducers;
+
+    std::atomic<size_t> nbConsumed{0};
+    std::atomic<bool>   isStarted{false};
+
+    std::vector<std::thread> threads;
+
+    for (int producer = 0; producer < nbProducers; ++producer) {
+        threads.emplace_back([&]() {
+            std::vector<size_t> items(szBatch);
+
+            while (!isStarted.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            for (size_t nbProduced = 0; nbProduced < nbPerProducer;) {
+                size_t nbItems = std::min(szBatch, nbPerProducer - nbProduced);
+                for (size_t i = 0; i < nbItems; ++i) {
+                    items[i] = nbProduced + i;
+                }
+
+                for (size_t nbDone = 0; nbDone < nbItems;) {
+                    size_t nbMoved = 0;
+                    if (1 == szBatch) {
+                        nbMoved = queue.enqueue(std::move(items[0])) ? 1 : 0;
+                    } else {
+                        nbMoved = queue.enqueueBulk(items.data() + nbDone, nbItems - nbDone);
+                    }
+
+                    if (0 == nbMoved)
+                        std::this_thread::yield();
+
+                    nbDone += nbMoved;
+                }
+
+                nbProduced += nbItems;
+            }
+        });
+    }
+
+    for (int consumer = 0; consumer < nbConsumers; ++consumer) {
+        threads.emplace_back([&]() {
+            std::vector<size_t> items(szBatch);
+
+            while (nbConsumed.load(std::memory_order_relaxed) < nbTotal) {
+                size_t nbMoved = 0;
+                if (1 == szBatch) {
+                    nbMoved = queue.dequeue(items[0]) ? 1 : 0;
+                } else {
+                    nbMoved = queue.dequeueBulk(items.data(), szBatch);
+                }
+
+                if (0 == nbMoved) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                nbConsumed.fetch_add(nbMoved, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std_clock::time_point startTp = std_clock::now();
+    isStarted.store(true, std::memory_order_release);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::chrono::duration<float> elapsed = std_clock::now() - startTp;
+
+    CHECK_EQUAL(nbConsumed.load(), nbTotal);
+
+    LOGI << "BENCH " << name << ", " << nbProducers << " producers, " << nbConsumers << " consumers, batch of " << szBatch
+         << ": " << (nbTotal / elapsed.count() / 1000000.0f) << " M items/s";
+
+    return true;
+}
+
+
+float ThreadCpuTimeInMs() {
+
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1000.0f + ts.tv_nsec / 1000000.0f;
+}
+
+
+//! the producer sends a timestamp every `interval`, the consumer waits for it with dequeueWait;
+//! reports the latency from the enqueue to the dequeue and the cpu time the consumer burns.
+template < typename WaitStrategy >
+bool MeasureWaitLatency(const char* name, std::chrono::microseconds interval) {
+
+    static const size_t sNbItems = 5000;
+
+    MpmcBoundedQueue<int64_t, WaitStrategy> queue(1024);
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(sNbItems);
+
+    float consumerCpuMs = 0.0f;
+
+    std::thread consumer([&]() {
+        float startCpuMs = ThreadCpuTimeInMs();
+
+        int64_t sentNs;
+        while (latencies.size() < sNbItems) {
+            if (!queue.dequeueWait(sentNs, std::chrono::seconds(1)))
+                break;
+
+            int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std_clock::now().time_since_epoch()).count();
+            latencies.push_back(nowNs - sentNs);
+        }
+
+        consumerCpuMs = ThreadCpuTimeInMs() - startCpuMs;
+    });
+
+    std_clock::time_point startTp = std_clock::now();
+    std_clock::time_point nextTp = startTp;
+
+    for (size_t i = 0; i < sNbItems; ++i) {
+        // paced by spinning, since sleeps are too coarse for short intervals
+        nextTp += interval;
+        while (std_clock::now() < nextTp) {
+            CPU_RELAX();
+        }
+
+        int64_t sentNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std_clock::now().time_since_epoch()).count();
+        CHECK_TRUE(queue.enqueue(std::move(sentNs)));
+    }
+
+    consumer.join();
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+
+    CHECK_EQUAL(latencies.size(), sNbItems);
+
+    std::sort(latencies.begin(), latencies.end());
+
+    LOGI << "BENCH " << name << ", an item every " << interval.count() << " us: "
+         << latencies[sNbItems / 2] << " ns median, " << latencies[sNbItems * 99 / 100] << " ns p99 latency, "
+         << (100.0f * consumerCpuMs / elapsed.count()) << "% of a core";
+
+    return true;
+}
+
+
+}
+
+
+#pragma mark - Benchmarks Implementation
+
+bool bench__udp_MpmcBoundedQueue__bulk_vs_single() {
+
+    static const int sThreadCounts[][2] = { { 1, 1 }, { 2, 2 }, { 4, 4 }, { 1, 4 }, { 4, 1 } };
+
+    for (const auto& counts : sThreadCounts) {
+        for (size_t szBatch : { (size_t)1, (size_t)4, (size_t)16, (size_t)64 }) {
+            if (!MeasureThroughput<MpmcBoundedQueue>("mpmc", counts[0], counts[1], szBatch))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool bench__udp_MpmcBoundedQueue__wait_strategies() {
+
+    for (long us : { 10L, 100L, 1000L }) {
+        std::chrono::microseconds interval(us);
+
+        bool isOk = MeasureWaitLatency<udp::BusySpinWait>("busy spin", interval)
+                 && MeasureWaitLatency<udp::SpinYieldWait>("spin then yield", interval)
+                 && MeasureWaitLatency<udp::ParkingWait>("park", interval);
+        if (!isOk)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool bench__udp_SpscBoundedQueue__spsc_vs_mpmc() {
+
+    // the engine thread and one user thread on the ends of a socket queue
+    for (size_t szBatch : { (size_t)1, (size_t)16 }) {
+        if (!MeasureThroughput<MpmcBoundedQueue>("mpmc", 1, 1, szBatch) || !MeasureThroughput<SpscBoundedQueue>("spsc", 1, 1, szBatch))
+            return false;
+    }
+
+    return true;
+}
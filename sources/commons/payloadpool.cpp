@@ -0,0 +1,332 @@
+#include "commons/payloadpool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "commons/utils.hpp"
+
+
+/// a thread caches at most this many buffers per class, or this many bytes for the big classes
+#define PAYLOAD_CACHE_MAX_BLOCKS 64
+#define PAYLOAD_CACHE_MAX_BYTES  (256 * 1024)
+
+/// a depot keeps at most this many bytes of buffers per class, in chains of half a thread cache
+#define PAYLOAD_DEPOT_MAX_BYTES  (16 * 1024 * 1024)
+#define PAYLOAD_DEPOT_MIN_CHAINS 16
+#define PAYLOAD_DEPOT_MAX_CHAINS 1024
+
+#define PAYLOAD_OVERSIZED_CLASS ((uint16_t)PayloadPool::NbClasses)
+#define PAYLOAD_BLOCK_MAGIC     0x5044u
+
+
+using namespace udp;
+
+
+namespace {
+
+
+//! precedes every buffer; keeps the payload aligned by 16.
+struct alignas(16) BlockHeader {
+    uint16_t mSizeClass;
+    uint16_t mMagic;
+
+    std::atomic<uint32_t> mNbRefs; ///< owners of the buffer, while it is allocated (see PayloadPool::Share)
+
+    BlockHeader* mpNext; ///< the next block of the chain, while the block waits in a depot
+};
+
+static_assert(sizeof(BlockHeader) == 16, "payloads must stay aligned by 16");
+
+
+inline BlockHeader* HeaderOf(const uint8_t* pPayload) noexcept {
+
+    return (BlockHeader*)(pPayload - sizeof(BlockHeader));
+}
+
+
+inline size_t ClassSize(size_t sizeClass) noexcept {
+
+    return PayloadPool::MinClassSize << sizeClass;
+}
+
+
+inline size_t ClassOf(size_t szPayload) noexcept {
+
+    if (szPayload <= PayloadPool::MinClassSize)
+        return 0;
+
+    unsigned int r;
+    BUILTIN_MSNZB64(szPayload - 1, &r);
+
+    // 65..128 bytes -> r == 6 -> class 1
+    return (size_t)r - 5;
+}
+
+
+inline size_t CacheCapacity(size_t sizeClass) noexcept {
+
+    return std::clamp<size_t>(PAYLOAD_CACHE_MAX_BYTES / ClassSize(sizeClass), 4, PAYLOAD_CACHE_MAX_BLOCKS);
+}
+
+
+//! caches exchange this many blocks at once.
+inline size_t ChainLength(size_t sizeClass) noexcept {
+
+    return CacheCapacity(sizeClass) / 2;
+}
+
+
+}
+
+
+//! buffers of the thread; given back to the depots (or freed), when the thread exits.
+struct PayloadPool::ThreadCache {
+
+    struct Bin {
+        uint8_t* mBlocks[PAYLOAD_CACHE_MAX_BLOCKS];
+        size_t   mCount{0};
+    };
+
+    Bin mBins[NbClasses];
+
+    ~ThreadCache() noexcept {
+
+        PayloadPool* pPool = PayloadPool::GetInstancePtr();
+
+        for (size_t sizeClass = 0; sizeClass < NbClasses; ++sizeClass) {
+            Bin& bin = mBins[sizeClass];
+            while (bin.mCount > 0) {
+                pPool->PushChain(sizeClass, *this, std::min(bin.mCount, ChainLength(sizeClass)));
+            }
+        }
+
+        // thread_locals constructed before the cache (e.g. the main thread's statics holding
+        // dgrams) are destroyed after it and still release buffers
+        tIsCacheDestroyed = true;
+    }
+};
+
+
+thread_local PayloadPool::ThreadCache PayloadPool::tThreadCache;
+thread_local bool PayloadPool::tIsCacheDestroyed = false;
+
+
+/*static*/
+PayloadPool* PayloadPool::GetInstancePtr() noexcept {
+
+    static PayloadPool* sInstancePtr = new PayloadPool();
+
+    return sInstancePtr;
+}
+
+
+PayloadPool::PayloadPool() noexcept {
+
+    for (size_t sizeClass = 0; sizeClass < NbClasses; ++sizeClass) {
+        size_t nbChains = std::clamp<size_t>( PAYLOAD_DEPOT_MAX_BYTES / ClassSize(sizeClass) / ChainLength(sizeClass)
+                                            , PAYLOAD_DEPOT_MIN_CHAINS, PAYLOAD_DEPOT_MAX_CHAINS );
+
+        _depots[sizeClass] = std::make_unique<MpmcBoundedQueue<uint8_t*>>(nbChains);
+    }
+}
+
+
+uint8_t* PayloadPool::allocate(size_t szPayload) noexcept {
+
+    if (szPayload > MaxClassSize) {
+        uint8_t* pBlock = AllocateBlock(PAYLOAD_OVERSIZED_CLASS, szPayload);
+        if (!pBlock)
+            return nullptr;
+
+        ((BlockHeader*)pBlock)->mNbRefs.store(1, std::memory_order_relaxed);
+
+        return pBlock + sizeof(BlockHeader);
+    }
+
+    const size_t sizeClass = ClassOf(szPayload);
+
+    uint8_t* pBlock;
+    if (tIsCacheDestroyed) {
+        // the thread is exiting, its cache is gone already
+        pBlock = AllocateBlock(sizeClass, ClassSize(sizeClass));
+    } else {
+        ThreadCache::Bin& bin = tThreadCache.mBins[sizeClass];
+
+        if (0 == bin.mCount) {
+            PopChain(sizeClass, tThreadCache);
+        }
+
+        pBlock = (bin.mCount > 0) ? bin.mBlocks[--bin.mCount] : AllocateBlock(sizeClass, ClassSize(sizeClass));
+    }
+
+    if (!pBlock)
+        return nullptr;
+
+    ((BlockHeader*)pBlock)->mNbRefs.store(1, std::memory_order_relaxed);
+
+    return pBlock + sizeof(BlockHeader);
+}
+
+
+/*static*/
+void PayloadPool::Release(uint8_t* pPayload) noexcept {
+
+    if (!pPayload)
+        return;
+
+    BlockHeader* pHeader = HeaderOf(pPayload);
+    assert(PAYLOAD_BLOCK_MAGIC == pHeader->mMagic);
+    assert(pHeader->mNbRefs.load(std::memory_order_relaxed) > 0);
+
+    // the sole owner doesn't need the read-modify-write: nobody else can share the buffer now
+    if (1 != pHeader->mNbRefs.load(std::memory_order_acquire)
+        && 1 != pHeader->mNbRefs.fetch_sub(1, std::memory_order_acq_rel))
+    {
+        return;
+    }
+
+    GetInstancePtr()->Deallocate((uint8_t*)pHeader, pHeader->mSizeClass);
+}
+
+
+/*static*/
+uint8_t* PayloadPool::Share(uint8_t* pPayload) noexcept {
+
+    if (!pPayload)
+        return nullptr;
+
+    BlockHeader* pHeader = HeaderOf(pPayload);
+    assert(PAYLOAD_BLOCK_MAGIC == pHeader->mMagic);
+
+    // a new owner comes from an existing one, which keeps the buffer alive meanwhile
+    pHeader->mNbRefs.fetch_add(1, std::memory_order_relaxed);
+
+    return pPayload;
+}
+
+
+/*static*/
+bool PayloadPool::IsShared(const uint8_t* pPayload) noexcept {
+
+    return pPayload && HeaderOf(pPayload)->mNbRefs.load(std::memory_order_acquire) > 1;
+}
+
+
+/*static*/
+size_t PayloadPool::Capacity(const uint8_t* pPayload) noexcept {
+
+    if (!pPayload)
+        return 0;
+
+    const BlockHeader* pHeader = HeaderOf(pPayload);
+
+    return (pHeader->mSizeClass < NbClasses) ? ClassSize(pHeader->mSizeClass) : 0;
+}
+
+
+auto PayloadPool::stats() const noexcept -> Stats {
+
+    Stats result;
+    result.mNbSystemAllocations = _nbSystemAllocations.load(std::memory_order_relaxed);
+    result.mNbSystemFrees = _nbSystemFrees.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+
+void PayloadPool::Deallocate(uint8_t* pBlock, size_t sizeClass) noexcept {
+
+    if (sizeClass >= NbClasses) {
+        FreeBlock(pBlock);
+        return;
+    }
+
+    if (tIsCacheDestroyed) {
+        // the thread is exiting, its cache is gone already - the block goes to the depot alone
+        ((BlockHeader*)pBlock)->mpNext = nullptr;
+        DepositChain(sizeClass, pBlock);
+        return;
+    }
+
+    ThreadCache::Bin& bin = tThreadCache.mBins[sizeClass];
+
+    if (bin.mCount >= CacheCapacity(sizeClass)) {
+        // hand half of the cache over to the threads, which allocate more than they release
+        PushChain(sizeClass, tThreadCache, ChainLength(sizeClass));
+    }
+
+    bin.mBlocks[bin.mCount++] = pBlock;
+}
+
+
+void PayloadPool::PushChain(size_t sizeClass, ThreadCache& cache, size_t nbBlocks) noexcept {
+
+    ThreadCache::Bin& bin = cache.mBins[sizeClass];
+
+    BlockHeader* pHead = nullptr;
+    for (size_t i = 0; i < nbBlocks; ++i) {
+        BlockHeader* pHeader = (BlockHeader*)bin.mBlocks[--bin.mCount];
+        pHeader->mpNext = pHead;
+        pHead = pHeader;
+    }
+
+    DepositChain(sizeClass, (uint8_t*)pHead);
+}
+
+
+void PayloadPool::DepositChain(size_t sizeClass, uint8_t* pChain) noexcept {
+
+    BlockHeader* pHead = (BlockHeader*)pChain;
+    if (!pChain || _depots[sizeClass]->enqueue(std::move(pChain)))
+        return;
+
+    // the depot is full - there are more spare blocks around than anybody needs
+    while (pHead) {
+        BlockHeader* pNext = pHead->mpNext;
+        FreeBlock((uint8_t*)pHead);
+        pHead = pNext;
+    }
+}
+
+
+void PayloadPool::PopChain(size_t sizeClass, ThreadCache& cache) noexcept {
+
+    ThreadCache::Bin& bin = cache.mBins[sizeClass];
+
+    uint8_t* pChain;
+    if (!_depots[sizeClass]->dequeue(pChain))
+        return;
+
+    // chains are never longer than half of the cache, which is empty here
+    for (BlockHeader* pHeader = (BlockHeader*)pChain; pHeader; pHeader = pHeader->mpNext) {
+        bin.mBlocks[bin.mCount++] = (uint8_t*)pHeader;
+    }
+}
+
+
+uint8_t* PayloadPool::AllocateBlock(size_t sizeClass, size_t szBlock) noexcept {
+
+    uint8_t* pBlock = (uint8_t*)std::malloc(sizeof(BlockHeader) + szBlock);
+    if (!pBlock)
+        return nullptr;
+
+    BlockHeader* pHeader = new (pBlock) BlockHeader;
+    pHeader->mSizeClass = (uint16_t)sizeClass;
+    pHeader->mMagic = PAYLOAD_BLOCK_MAGIC;
+    pHeader->mNbRefs.store(0, std::memory_order_relaxed);
+    pHeader->mpNext = nullptr;
+
+    _nbSystemAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    return pBlock;
+}
+
+
+void PayloadPool::FreeBlock(uint8_t* pBlock) noexcept {
+
+    _nbSystemFrees.fetch_add(1, std::memory_order_relaxed);
+
+    std::free(pBlock);
+}
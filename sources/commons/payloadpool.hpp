@@ -0,0 +1,93 @@
+#ifndef UDP_COMMONS_PAYLOADPOOL_HPP_
+#define UDP_COMMONS_PAYLOADPOOL_HPP_
+
+
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+
+#include "commons/macros.h"
+#include "commons/queue.hpp"
+
+
+namespace udp { ;
+
+
+//! process-wide pool of payload buffers in power of two size classes (MinClassSize .. MaxClassSize).
+//! Every thread keeps a small cache of buffers per class; caches exchange buffers in batches through
+//! lock-free per-class depots, so a buffer allocated on one thread and released on another returns
+//! to the allocating one without locks and without malloc. Bigger buffers are allocated by malloc.
+class PayloadPool final {
+    NOCOPY(PayloadPool)
+    NOMOVE(PayloadPool)
+public:
+
+    struct Stats {
+        size_t mNbSystemAllocations{0}; ///< buffers allocated by malloc: the pool was cold or the payload oversized
+        size_t mNbSystemFrees{0};       ///< buffers freed by free: oversized ones or the depot was full
+    };
+
+    static constexpr size_t MinClassSize = 64;
+    static constexpr size_t MaxClassSize = 64 * 1024;
+    static constexpr size_t NbClasses    = 11;
+
+    //! the pool is never destroyed: buffers can outlive any static object.
+    static PayloadPool* GetInstancePtr() noexcept;
+
+    //! returns a buffer for at least `szPayload` bytes (aligned by 16), or nullptr if out of memory.
+    uint8_t* allocate(size_t szPayload) noexcept;
+
+    //! drops one owner of the buffer; the last one returns it to the pool it came from.
+    //! Can be called on any thread, ignores nullptr.
+    static void Release(uint8_t* pPayload) noexcept;
+
+    //! adds an owner to the buffer and returns it; every owner releases the buffer once. Owners
+    //! must treat a shared buffer as immutable (see IsShared).
+    static uint8_t* Share(uint8_t* pPayload) noexcept;
+
+    //! whether the buffer has more than one owner; false for nullptr.
+    static bool IsShared(const uint8_t* pPayload) noexcept;
+
+    //! how many bytes the buffer can hold.
+    static size_t Capacity(const uint8_t* pPayload) noexcept;
+
+    Stats stats() const noexcept;
+
+private:
+
+    struct ThreadCache;
+
+    static thread_local ThreadCache tThreadCache;
+    static thread_local bool        tIsCacheDestroyed; ///< thread_locals destroyed later bypass the cache
+
+    PayloadPool() noexcept;
+   ~PayloadPool() noexcept = default;
+
+    void Deallocate(uint8_t* pBlock, size_t sizeClass) noexcept;
+
+    //! move `nbBlocks` of the cache bin to the depot in one chain, or take one chain from the depot.
+    void PushChain(size_t sizeClass, ThreadCache& cache, size_t nbBlocks) noexcept;
+    void PopChain (size_t sizeClass, ThreadCache& cache) noexcept;
+
+    //! moves a chain of blocks to the depot, or frees it, if the depot is full.
+    void DepositChain(size_t sizeClass, uint8_t* pChain) noexcept;
+
+    uint8_t* AllocateBlock(size_t sizeClass, size_t szBlock) noexcept;
+    void     FreeBlock(uint8_t* pBlock) noexcept;
+
+    /// chains of buffers released by threads with full caches, waiting for threads with empty ones
+    std::unique_ptr<MpmcBoundedQueue<uint8_t*>> _depots[NbClasses];
+
+    CACHELINE(0);
+
+    std::atomic<size_t> _nbSystemAllocations{0};
+    std::atomic<size_t> _nbSystemFrees{0};
+
+    CACHELINE(1);
+};
+
+
+} // namespace udp
+
+
+#endif//UDP_COMMONS_PAYLOADPOOL_HPP_
@@ -3,17 +3,19 @@
 
 
 #include <atomic>
+#include <chrono>
 #include <cinttypes>
 #include <memory>
 
 #include "commons/macros.h"
 #include "commons/utils.hpp"
+#include "commons/waitstrategy.hpp"
 
 
 namespace udp { ;
 
 
-template <typename T>
+template <typename T, typename WaitStrategy = BusySpinWait>
 class MpmcBoundedQueue final {
     NOCOPY(MpmcBoundedQueue)
     NOMOVE(MpmcBoundedQueue)
@@ -55,6 +57,13 @@ public:
     }
 
 
+    //! the requested size rounded up to a power of 2.
+    size_t capacity() const noexcept {
+
+        return _buffer ? _mask + 1 : 0;
+    }
+
+
     bool enqueue(T&& data) noexcept {
 
         Cell* cell;
@@ -77,6 +86,8 @@ public:
         cell->mData = std::move(data);
         cell->mSeq.store(pos + 1, std::memory_order_release);
 
+        _wait.notify();
+
         return true;
     }
 
@@ -106,6 +117,75 @@ public:
         return true;
     }
 
+
+    //! dequeues an item, waiting for it up to `timeout` the way WaitStrategy does.
+    bool dequeueWait(T& outData, std::chrono::nanoseconds timeout) noexcept {
+
+        return _wait.wait([this, &outData]() { return dequeue(outData); }, timeout);
+    }
+
+
+    //! enqueues as many of `nbItems` items, as there is room for, with a single claim of the
+    //! enqueue position; returns the number of items moved from the front of `pItems`.
+    size_t enqueueBulk(T* pItems, size_t nbItems) noexcept {
+
+        size_t pos = _posEnqueue.load(std::memory_order_relaxed);
+        size_t nbClaimed;
+        bool   isStale;
+
+        while(true) {
+            nbClaimed = CountReady(pos, nbItems, 0, &isStale);
+            if (nbClaimed > 0) {
+                if (_posEnqueue.compare_exchange_weak(pos, pos + nbClaimed, std::memory_order_relaxed))
+                    break;
+            } else if (!isStale) {
+                return 0;
+            } else {
+                pos = _posEnqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (size_t i = 0; i < nbClaimed; ++i) {
+            Cell& cell = _buffer[(pos + i) & _mask];
+            cell.mData = std::move(pItems[i]);
+            cell.mSeq.store(pos + i + 1, std::memory_order_release);
+        }
+
+        _wait.notify();
+
+        return nbClaimed;
+    }
+
+
+    //! dequeues up to `nbMaxItems` items with a single claim of the dequeue position; returns
+    //! the number of items moved to the front of `pItems`.
+    size_t dequeueBulk(T* pItems, size_t nbMaxItems) noexcept {
+
+        size_t pos = _posDequeue.load(std::memory_order_relaxed);
+        size_t nbClaimed;
+        bool   isStale;
+
+        while(true) {
+            nbClaimed = CountReady(pos, nbMaxItems, 1, &isStale);
+            if (nbClaimed > 0) {
+                if (_posDequeue.compare_exchange_weak(pos, pos + nbClaimed, std::memory_order_relaxed))
+                    break;
+            } else if (!isStale) {
+                return 0;
+            } else {
+                pos = _posDequeue.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (size_t i = 0; i < nbClaimed; ++i) {
+            Cell& cell = _buffer[(pos + i) & _mask];
+            pItems[i] = std::move(cell.mData);
+            cell.mSeq.store(pos + i + _mask + 1, std::memory_order_release);
+        }
+
+        return nbClaimed;
+    }
+
 private:
 
     struct Cell {
@@ -113,6 +193,28 @@ private:
         T                   mData;
     };
 
+    //! counts consecutive cells from `pos` on, which are ready to be claimed: their sequence is
+    //! `pos + i + lag` (0 - free for producers, 1 - filled for consumers). `*pIsStale` tells, that
+    //! the first cell is claimed by somebody else already, so `pos` must be reloaded.
+    size_t CountReady(size_t pos, size_t nbMax, size_t lag, bool* pIsStale) const noexcept {
+
+        *pIsStale = false;
+
+        size_t nbReady = 0;
+        while (nbReady < nbMax && nbReady <= _mask) {
+            size_t seq = _buffer[(pos + nbReady) & _mask].mSeq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + nbReady + lag);
+            if (0 != diff) {
+                *pIsStale = (0 == nbReady && diff > 0);
+                break;
+            }
+
+            ++nbReady;
+        }
+
+        return nbReady;
+    }
+
     CACHELINE(0);
 
     Cell*  _buffer;
@@ -128,6 +230,158 @@ private:
 
     CACHELINE(3);
 
+    WaitStrategy _wait;
+
+    CACHELINE(4);
+
+};
+
+
+//! bounded ring for exactly one producer thread and one consumer thread. Every side owns its
+//! position and keeps a cached copy of the other side's one, so it touches the shared cache line
+//! only when the cached copy says the ring is full (or empty).
+template <typename T, typename WaitStrategy = BusySpinWait>
+class SpscBoundedQueue final {
+    NOCOPY(SpscBoundedQueue)
+    NOMOVE(SpscBoundedQueue)
+public:
+
+    using SPtr = std::shared_ptr<SpscBoundedQueue>;
+    using UPtr = std::unique_ptr<SpscBoundedQueue>;
+
+
+    explicit SpscBoundedQueue(size_t szBuffer) noexcept {
+
+        size_t size = ToPowerOf2(szBuffer);
+
+        if (size > 0) {
+            _buffer = new T[size];
+            _mask = (size - 1);
+        } else {
+            _buffer = nullptr;
+            _mask = 0;
+        }
+
+        _posEnqueue.store(0, std::memory_order_relaxed);
+        _posDequeue.store(0, std::memory_order_relaxed);
+
+        _cachedPosDequeue = 0;
+        _cachedPosEnqueue = 0;
+    }
+
+
+    ~SpscBoundedQueue() noexcept {
+
+        delete[] _buffer;
+    }
+
+
+    bool valid() const noexcept {
+
+        return !!_buffer;
+    }
+
+
+    //! the requested size rounded up to a power of 2.
+    size_t capacity() const noexcept {
+
+        return _buffer ? _mask + 1 : 0;
+    }
+
+
+    //! producer only.
+    bool enqueue(T&& data) noexcept {
+
+        return enqueueBulk(&data, 1) > 0;
+    }
+
+
+    //! consumer only.
+    bool dequeue(T& outData) noexcept {
+
+        return dequeueBulk(&outData, 1) > 0;
+    }
+
+
+    //! consumer only: dequeues an item, waiting for it up to `timeout` the way WaitStrategy does.
+    bool dequeueWait(T& outData, std::chrono::nanoseconds timeout) noexcept {
+
+        return _wait.wait([this, &outData]() { return dequeue(outData); }, timeout);
+    }
+
+
+    //! producer only: enqueues as many of `nbItems` items, as there is room for; returns the
+    //! number of items moved from the front of `pItems`.
+    size_t enqueueBulk(T* pItems, size_t nbItems) noexcept {
+
+        const size_t pos = _posEnqueue.load(std::memory_order_relaxed);
+
+        size_t nbFree = capacity() - (pos - _cachedPosDequeue);
+        if (nbFree < nbItems) {
+            _cachedPosDequeue = _posDequeue.load(std::memory_order_acquire);
+            nbFree = capacity() - (pos - _cachedPosDequeue);
+        }
+
+        size_t nbEnqueued = nbItems < nbFree ? nbItems : nbFree;
+        for (size_t i = 0; i < nbEnqueued; ++i) {
+            _buffer[(pos + i) & _mask] = std::move(pItems[i]);
+        }
+
+        if (nbEnqueued > 0) {
+            _posEnqueue.store(pos + nbEnqueued, std::memory_order_release);
+            _wait.notify();
+        }
+
+        return nbEnqueued;
+    }
+
+
+    //! consumer only: dequeues up to `nbMaxItems` items; returns the number of items moved to
+    //! the front of `pItems`.
+    size_t dequeueBulk(T* pItems, size_t nbMaxItems) noexcept {
+
+        const size_t pos = _posDequeue.load(std::memory_order_relaxed);
+
+        size_t nbReady = _cachedPosEnqueue - pos;
+        if (nbReady < nbMaxItems) {
+            _cachedPosEnqueue = _posEnqueue.load(std::memory_order_acquire);
+            nbReady = _cachedPosEnqueue - pos;
+        }
+
+        size_t nbDequeued = nbMaxItems < nbReady ? nbMaxItems : nbReady;
+        for (size_t i = 0; i < nbDequeued; ++i) {
+            pItems[i] = std::move(_buffer[(pos + i) & _mask]);
+        }
+
+        if (nbDequeued > 0)
+            _posDequeue.store(pos + nbDequeued, std::memory_order_release);
+
+        return nbDequeued;
+    }
+
+private:
+
+    CACHELINE(0);
+
+    T*     _buffer;
+    size_t _mask;
+
+    CACHELINE(1);
+
+    std::atomic<size_t> _posEnqueue;
+    size_t              _cachedPosDequeue; ///< producer's copy of _posDequeue
+
+    CACHELINE(2);
+
+    std::atomic<size_t> _posDequeue;
+    size_t              _cachedPosEnqueue; ///< consumer's copy of _posEnqueue
+
+    CACHELINE(3);
+
+    WaitStrategy _wait;
+
+    CACHELINE(4);
+
 };
 
 
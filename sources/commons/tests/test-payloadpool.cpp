@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "commons/macros.h"
+
+#include "commons/payloadpool.hpp"
+#include "commons/queue.hpp"
+
+#include "testapi.hpp"
+
+
+bool test__udp_PayloadPool__correctness_size_classes();
+bool test__udp_PayloadPool__correctness_reuse_on_thread();
+bool test__udp_PayloadPool__correctness_shared_release();
+bool test__udp_PayloadPool__correctness_cross_thread_release();
+bool test__udp_PayloadPool__correctness_release_after_thread_cache();
+
+
+START_TEST_SUIT_DECLARATION(PayloadPool)
+    DECLARE_TEST(test__udp_PayloadPool__correctness_size_classes)
+    DECLARE_TEST(test__udp_PayloadPool__correctness_reuse_on_thread)
+    DECLARE_TEST(test__udp_PayloadPool__correctness_shared_release)
+    DECLARE_TEST_ITERATED(test__udp_PayloadPool__correctness_cross_thread_release, 4)
+    DECLARE_TEST(test__udp_PayloadPool__correctness_release_after_thread_cache)
+FINISH_TEST_SUIT_DECLARATION(PayloadPool)
+
+
+using udp::PayloadPool;
+
+
+bool test__udp_PayloadPool__correctness_size_classes() {
+
+    static const size_t sSizes[] = { 0, 1, 63, 64, 65, 1000, 1500, 4096, 65535, 65536, 65537, 200000 };
+
+    PayloadPool* pPool = PayloadPool::GetInstancePtr();
+    CHECK_TRUE(!!pPool);
+
+    for (size_t szPayload : sSizes) {
+        uint8_t* pPayload = pPool->allocate(szPayload);
+        CHECK_TRUE(!!pPayload);
+        CHECK_EQUAL((uintptr_t)pPayload % 16, (uintptr_t)0);
+
+        if (szPayload <= PayloadPool::MaxClassSize) {
+            CHECK_GREATER(PayloadPool::Capacity(pPayload), szPayload > 0 ? szPayload - 1 : 0);
+            CHECK_LESS(PayloadPool::Capacity(pPayload), 2 * std::max<size_t>(szPayload, PayloadPool::MinClassSize) + 1);
+        } else {
+            // oversized payloads are malloc-ed as is
+            CHECK_EQUAL(PayloadPool::Capacity(pPayload), (size_t)0);
+        }
+
+        memset(pPayload, 0xAB, szPayload);
+
+        PayloadPool::Release(pPayload);
+    }
+
+    PayloadPool::Release(nullptr);
+
+    return true;
+}
+
+
+bool test__udp_PayloadPool__correctness_reuse_on_thread() {
+
+    PayloadPool* pPool = PayloadPool::GetInstancePtr();
+
+    uint8_t* pFirst = pPool->allocate(512);
+    CHECK_TRUE(!!pFirst);
+
+    PayloadPool::Release(pFirst);
+
+    // the thread cache gives the latest released buffer of the class back
+    uint8_t* pSecond = pPool->allocate(300);
+    CHECK_TRUE(pFirst == pSecond);
+
+    PayloadPool::Release(pSecond);
+
+    return true;
+}
+
+
+bool test__udp_PayloadPool__correctness_shared_release() {
+
+    PayloadPool* pPool = PayloadPool::GetInstancePtr();
+
+    uint8_t* pPayload = pPool->allocate(512);
+    CHECK_TRUE(!!pPayload);
+    CHECK_FALSE(PayloadPool::IsShared(pPayload));
+
+    CHECK_TRUE(PayloadPool::Share(pPayload) == pPayload);
+    CHECK_TRUE(PayloadPool::Share(pPayload) == pPayload);
+    CHECK_TRUE(PayloadPool::IsShared(pPayload));
+
+    PayloadPool::Release(pPayload);
+    PayloadPool::Release(pPayload);
+    CHECK_FALSE(PayloadPool::IsShared(pPayload));
+
+    // the last owner still holds the buffer - it isn't back in the cache yet
+    uint8_t* pAnother = pPool->allocate(512);
+    CHECK_TRUE(pAnother != pPayload);
+    PayloadPool::Release(pAnother);
+
+    PayloadPool::Release(pPayload);
+
+    uint8_t* pReused = pPool->allocate(512);
+    CHECK_TRUE(pReused == pPayload);
+    CHECK_FALSE(PayloadPool::IsShared(pReused));
+
+    PayloadPool::Release(pReused);
+
+    CHECK_TRUE(nullptr == PayloadPool::Share(nullptr));
+    CHECK_FALSE(PayloadPool::IsShared(nullptr));
+
+    return true;
+}
+
+
+bool test__udp_PayloadPool__correctness_cross_thread_release() {
+
+    static const size_t sNbPayloads = 100000;
+    static const size_t sSzPayload = 1400;
+
+    PayloadPool* pPool = PayloadPool::GetInstancePtr();
+
+    udp::MpmcBoundedQueue<uint8_t*> queue(1024);
+
+    std::atomic<size_t> nbCorrupted{0};
+
+    // the consumer releases everything the producer allocates, so the producer has to get
+    // its buffers back through the depot instead of malloc
+    std::thread consumer([&]() {
+        size_t nbReleased = 0;
+        while (nbReleased < sNbPayloads) {
+            uint8_t* pPayload;
+            if (!queue.dequeue(pPayload)) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (pPayload[0] != (uint8_t)nbReleased || pPayload[sSzPayload - 1] != (uint8_t)nbReleased)
+                nbCorrupted.fetch_add(1, std::memory_order_relaxed);
+
+            PayloadPool::Release(pPayload);
+            ++nbReleased;
+        }
+    });
+
+    size_t nbSystemAllocationsBefore = pPool->stats().mNbSystemAllocations;
+
+    for (size_t i = 0; i < sNbPayloads; ++i) {
+        uint8_t* pPayload = pPool->allocate(sSzPayload);
+        CHECK_TRUE(!!pPayload);
+
+        pPayload[0] = (uint8_t)i;
+        pPayload[sSzPayload - 1] = (uint8_t)i;
+
+        while (!queue.enqueue(std::move(pPayload)))
+            std::this_thread::yield();
+    }
+
+    consumer.join();
+
+    CHECK_EQUAL(nbCorrupted.load(), (size_t)0);
+
+    // at most the queue, the consumer cache and the depot transfers in flight are malloc-ed
+    size_t nbSystemAllocations = pPool->stats().mNbSystemAllocations - nbSystemAllocationsBefore;
+    CHECK_LESS(nbSystemAllocations, sNbPayloads / 20);
+
+    return true;
+}
+
+
+bool test__udp_PayloadPool__correctness_release_after_thread_cache() {
+
+    static const size_t sSzPayload = 20000;
+
+    struct LateRelease {
+        uint8_t* mpPayload{nullptr};
+        ~LateRelease() { PayloadPool::Release(mpPayload); }
+    };
+
+    PayloadPool* pPool = PayloadPool::GetInstancePtr();
+
+    size_t nbSystemFreesBefore = pPool->stats().mNbSystemFrees;
+
+    // thread_locals are destroyed in the reverse order of their construction, so the holder,
+    // constructed before the first allocation of the thread, outlives the thread cache
+    uint8_t* pReleased = nullptr;
+    std::thread releaser([&]() {
+        static thread_local LateRelease tLate;
+        tLate.mpPayload = pPool->allocate(sSzPayload);
+        pReleased = tLate.mpPayload;
+    });
+    releaser.join();
+
+    CHECK_TRUE(!!pReleased);
+    CHECK_EQUAL(pPool->stats().mNbSystemFrees, nbSystemFreesBefore);
+
+    // the buffer went to the depot, so a fresh thread finds it before running out of spare ones
+    bool isFound = false;
+    std::thread taker([&]() {
+        std::vector<uint8_t*> payloads;
+
+        size_t nbSystemAllocationsBefore = pPool->stats().mNbSystemAllocations;
+        while (!isFound && pPool->stats().mNbSystemAllocations == nbSystemAllocationsBefore) {
+            payloads.push_back(pPool->allocate(sSzPayload));
+            isFound = payloads.back() == pReleased;
+        }
+
+        for (uint8_t* pPayload : payloads) {
+            PayloadPool::Release(pPayload);
+        }
+    });
+    taker.join();
+
+    CHECK_TRUE(isFound);
+
+    return true;
+}
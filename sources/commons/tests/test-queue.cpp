@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "commons/macros.h"
+
+#include "commons/queue.hpp"
+
+#include "testapi.hpp"
+
+
+bool test__udp_MpmcBoundedQueue__correctness_bulk_operations();
+bool test__udp_MpmcBoundedQueue__correctness_multithread_bulk_operations();
+template < typename WaitStrategy >
+bool test__udp_MpmcBoundedQueue__correctness_dequeue_wait();
+
+
+START_TEST_SUIT_DECLARATION(MpmcBoundedQueue)
+    DECLARE_TEST(test__udp_MpmcBoundedQueue__correctness_bulk_operations)
+    DECLARE_TEST_ITERATED(test__udp_MpmcBoundedQueue__correctness_multithread_bulk_operations, 4)
+    DECLARE_TEST_ITERATED(test__udp_MpmcBoundedQueue__correctness_dequeue_wait<udp::BusySpinWait>, 1)
+    DECLARE_TEST_ITERATED(test__udp_MpmcBoundedQueue__correctness_dequeue_wait<udp::SpinYieldWait>, 1)
+    DECLARE_TEST_ITERATED(test__udp_MpmcBoundedQueue__correctness_dequeue_wait<udp::ParkingWait>, 1)
+FINISH_TEST_SUIT_DECLARATION(MpmcBoundedQueue)
+
+
+bool test__udp_SpscBoundedQueue__correctness_singlethread();
+bool test__udp_SpscBoundedQueue__correctness_producer_consumer();
+bool test__udp_SpscBoundedQueue__correctness_dequeue_wait();
+
+
+START_TEST_SUIT_DECLARATION(SpscBoundedQueue)
+    DECLARE_TEST(test__udp_SpscBoundedQueue__correctness_singlethread)
+    DECLARE_TEST_ITERATED(test__udp_SpscBoundedQueue__correctness_producer_consumer, 4)
+    DECLARE_TEST_ITERATED(test__udp_SpscBoundedQueue__correctness_dequeue_wait, 1)
+FINISH_TEST_SUIT_DECLARATION(SpscBoundedQueue)
+
+
+using udp::MpmcBoundedQueue;
+using udp::SpscBoundedQueue;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+bool test__udp_MpmcBoundedQueue__correctness_bulk_operations() {
+
+    MpmcBoundedQueue<int> queue(8);
+
+    int items[16];
+    for (int i = 0; i < 16; ++i) {
+        items[i] = i;
+    }
+
+    // a bulk takes as many items, as there is room for
+    CHECK_EQUAL(queue.enqueueBulk(items, 5), (size_t)5);
+    CHECK_EQUAL(queue.enqueueBulk(items + 5, 5), (size_t)3);
+    CHECK_EQUAL(queue.enqueueBulk(items + 8, 5), (size_t)0);
+    CHECK_FALSE(queue.enqueue(100));
+
+    int out[16] = {};
+    CHECK_EQUAL(queue.dequeueBulk(out, 3), (size_t)3);
+    CHECK_EQUAL(out[0], 0);
+    CHECK_EQUAL(out[2], 2);
+
+    // bulks and single operations mix and wrap around the buffer in order
+    CHECK_TRUE(queue.enqueue(100));
+    CHECK_EQUAL(queue.enqueueBulk(items + 8, 4), (size_t)2);
+
+    CHECK_EQUAL(queue.dequeueBulk(out, 16), (size_t)8);
+
+    static const int sExpected[] = { 3, 4, 5, 6, 7, 100, 8, 9 };
+    for (int i = 0; i < 8; ++i) {
+        CHECK_EQUAL(out[i], sExpected[i]);
+    }
+
+    CHECK_EQUAL(queue.dequeueBulk(out, 16), (size_t)0);
+    CHECK_EQUAL(queue.dequeueBulk(out, 0), (size_t)0);
+
+    int single;
+    CHECK_FALSE(queue.dequeue(single));
+
+    return true;
+}
+
+
+bool test__udp_MpmcBoundedQueue__correctness_multithread_bulk_operations() {
+
+    static const int sNbProducers = 4;
+    static const int sNbConsumers = 4;
+    static const int sNbItemsPerProducer = 100000;
+    static const size_t sBatchSize = 16;
+
+    MpmcBoundedQueue<int> queue(256);
+
+    std::atomic<int> nbConsumed{0};
+    std::atomic<int> nbDisordered{0};
+    std::atomic<long long> sum{0};
+
+    std::vector<std::thread> threads;
+
+    for (int producer = 0; producer < sNbProducers; ++producer) {
+        threads.emplace_back([&queue, producer]() {
+            int items[sBatchSize];
+
+            // items are numbered per producer: producer id in the high bits, sequence number in the low ones
+            for (int seq = 0; seq < sNbItemsPerProducer;) {
+                size_t nbItems = std::min<size_t>(sBatchSize, (size_t)(sNbItemsPerProducer - seq));
+                for (size_t i = 0; i < nbItems; ++i) {
+                    items[i] = (producer << 24) | (seq + (int)i);
+                }
+
+                size_t nbEnqueued = 0;
+                while (nbEnqueued < nbItems) {
+                    size_t nbDone = queue.enqueueBulk(items + nbEnqueued, nbItems - nbEnqueued);
+                    if (0 == nbDone)
+                        std::this_thread::yield();
+
+                    nbEnqueued += nbDone;
+                }
+
+                seq += (int)nbItems;
+            }
+        });
+    }
+
+    for (int consumer = 0; consumer < sNbConsumers; ++consumer) {
+        threads.emplace_back([&]() {
+            // every consumer sees the items of a producer in the order they were produced
+            int lastSeqs[sNbProducers];
+            for (int& lastSeq : lastSeqs) {
+                lastSeq = -1;
+            }
+
+            int items[sBatchSize];
+            while (nbConsumed.load(std::memory_order_relaxed) < sNbProducers * sNbItemsPerProducer) {
+                size_t nbItems = queue.dequeueBulk(items, sBatchSize);
+                if (0 == nbItems) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for (size_t i = 0; i < nbItems; ++i) {
+                    int producer = items[i] >> 24;
+                    int seq = items[i] & 0xFFFFFF;
+
+                    if (seq <= lastSeqs[producer])
+                        nbDisordered.fetch_add(1, std::memory_order_relaxed);
+
+                    lastSeqs[producer] = seq;
+                    sum.fetch_add(seq, std::memory_order_relaxed);
+                }
+
+                nbConsumed.fetch_add((int)nbItems, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const long long expectedSum = (long long)sNbProducers * sNbItemsPerProducer * (sNbItemsPerProducer - 1) / 2;
+
+    CHECK_EQUAL(nbConsumed.load(), sNbProducers * sNbItemsPerProducer);
+    CHECK_EQUAL(nbDisordered.load(), 0);
+    CHECK_EQUAL(sum.load(), expectedSum);
+
+    return true;
+}
+
+
+template < typename WaitStrategy >
+bool test__udp_MpmcBoundedQueue__correctness_dequeue_wait() {
+
+    static const int sNbItems = 5000;
+
+    MpmcBoundedQueue<int, WaitStrategy> queue(16);
+
+    // an empty queue is waited for until the timeout
+    int item = -1;
+    std_clock::time_point startTp = std_clock::now();
+    CHECK_FALSE(queue.dequeueWait(item, std::chrono::milliseconds(20)));
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_GREATER(elapsed.count(), 19.0f);
+    CHECK_LESS(elapsed.count(), 500.0f);
+
+    CHECK_TRUE(queue.enqueue(7));
+    CHECK_TRUE(queue.dequeueWait(item, std::chrono::milliseconds(0)));
+    CHECK_EQUAL(item, 7);
+
+    // items, which come one by one, wake the waiting consumer every time; a lost wakeup shows
+    // up as a timeout
+    std::thread producer([&queue]() {
+        for (int i = 0; i < sNbItems; ++i) {
+            while (!queue.enqueue(int(i))) {
+                std::this_thread::yield();
+            }
+
+            if (0 == (i % 64))
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    int nbTimedOut = 0, nbDisordered = 0;
+    for (int i = 0; i < sNbItems; ++i) {
+        while (!queue.dequeueWait(item, std::chrono::seconds(1))) {
+            ++nbTimedOut;
+        }
+
+        if (item != i)
+            ++nbDisordered;
+    }
+
+    producer.join();
+
+    CHECK_EQUAL(nbTimedOut, 0);
+    CHECK_EQUAL(nbDisordered, 0);
+
+    return true;
+}
+
+
+bool test__udp_SpscBoundedQueue__correctness_singlethread() {
+
+    SpscBoundedQueue<int> queue(6);
+
+    CHECK_TRUE(queue.valid());
+    CHECK_EQUAL(queue.capacity(), (size_t)8);
+
+    int out[16] = {};
+    CHECK_FALSE(queue.dequeue(out[0]));
+
+    for (int i = 0; i < 8; ++i) {
+        CHECK_TRUE(queue.enqueue(int(i)));
+    }
+    CHECK_FALSE(queue.enqueue(100));
+
+    CHECK_TRUE(queue.dequeue(out[0]));
+    CHECK_EQUAL(out[0], 0);
+
+    // bulks and single operations mix and wrap around the buffer in order
+    int items[4] = { 8, 9, 10, 11 };
+    CHECK_EQUAL(queue.enqueueBulk(items, 4), (size_t)1);
+    CHECK_EQUAL(queue.dequeueBulk(out, 3), (size_t)3);
+    CHECK_EQUAL(queue.enqueueBulk(items + 1, 3), (size_t)3);
+
+    CHECK_EQUAL(queue.dequeueBulk(out, 16), (size_t)8);
+
+    static const int sExpected[] = { 4, 5, 6, 7, 8, 9, 10, 11 };
+    for (int i = 0; i < 8; ++i) {
+        CHECK_EQUAL(out[i], sExpected[i]);
+    }
+
+    CHECK_EQUAL(queue.dequeueBulk(out, 16), (size_t)0);
+
+    SpscBoundedQueue<int> empty(0);
+    CHECK_FALSE(empty.valid());
+    CHECK_FALSE(empty.enqueue(1));
+
+    return true;
+}
+
+
+bool test__udp_SpscBoundedQueue__correctness_producer_consumer() {
+
+    static const int sNbItems = 1000000;
+    static const size_t sBatchSize = 16;
+
+    SpscBoundedQueue<int> queue(64);
+
+    std::thread producer([&queue]() {
+        int items[sBatchSize];
+
+        // mixes single items and bulks, so both paths race with the consumer
+        for (int next = 0; next < sNbItems;) {
+            if (0 == (next & 1)) {
+                int item = next;
+                if (queue.enqueue(std::move(item))) {
+                    ++next;
+                } else {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+
+            size_t nbItems = std::min<size_t>(sBatchSize, (size_t)(sNbItems - next));
+            for (size_t i = 0; i < nbItems; ++i) {
+                items[i] = next + (int)i;
+            }
+
+            size_t nbEnqueued = queue.enqueueBulk(items, nbItems);
+            if (0 == nbEnqueued)
+                std::this_thread::yield();
+
+            next += (int)nbEnqueued;
+        }
+    });
+
+    int nbDisordered = 0;
+    int expected = 0;
+
+    int items[sBatchSize];
+    while (expected < sNbItems) {
+        size_t nbItems = queue.dequeueBulk(items, sBatchSize);
+        if (0 == nbItems) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (size_t i = 0; i < nbItems; ++i) {
+            if (items[i] != expected)
+                ++nbDisordered;
+
+            expected = items[i] + 1;
+        }
+    }
+
+    producer.join();
+
+    CHECK_EQUAL(nbDisordered, 0);
+    CHECK_EQUAL(expected, sNbItems);
+
+    int tail;
+    CHECK_FALSE(queue.dequeue(tail));
+
+    return true;
+}
+
+
+bool test__udp_SpscBoundedQueue__correctness_dequeue_wait() {
+
+    static const int sNbItems = 5000;
+
+    SpscBoundedQueue<int, udp::ParkingWait> queue(16);
+
+    int item = -1;
+    CHECK_FALSE(queue.dequeueWait(item, std::chrono::milliseconds(5)));
+
+    std::thread producer([&queue]() {
+        int items[4];
+
+        for (int i = 0; i < sNbItems; i += 4) {
+            for (int j = 0; j < 4; ++j) {
+                items[j] = i + j;
+            }
+
+            for (size_t nbEnqueued = 0; nbEnqueued < 4;) {
+                nbEnqueued += queue.enqueueBulk(items + nbEnqueued, 4 - nbEnqueued);
+            }
+
+            if (0 == (i % 64))
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    int nbTimedOut = 0, nbDisordered = 0;
+    for (int i = 0; i < sNbItems; ++i) {
+        while (!queue.dequeueWait(item, std::chrono::seconds(1))) {
+            ++nbTimedOut;
+        }
+
+        if (item != i)
+            ++nbDisordered;
+    }
+
+    producer.join();
+
+    CHECK_EQUAL(nbTimedOut, 0);
+    CHECK_EQUAL(nbDisordered, 0);
+
+    return true;
+}
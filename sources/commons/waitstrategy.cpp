@@ -0,0 +1,64 @@
+#include "commons/waitstrategy.hpp"
+
+#if defined(__linux__)
+#   include <cerrno>
+#   include <climits>
+#   include <ctime>
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+
+using namespace udp;
+
+
+#if defined(__linux__)
+
+void ParkingWait::Wake() noexcept {
+
+    _epoch.fetch_add(1, std::memory_order_release);
+
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+bool ParkingWait::Park(uint32_t epoch, std::chrono::steady_clock::time_point deadline) noexcept {
+
+    std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining.count() <= 0)
+        return false;
+
+    timespec timeout;
+    timeout.tv_sec  = (time_t)(remaining.count() / 1000000000);
+    timeout.tv_nsec = (long)(remaining.count() % 1000000000);
+
+    // returns at once, if the epoch has changed since the consumer read it
+    long res = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAIT_PRIVATE, epoch, &timeout, nullptr, 0);
+
+    return !(0 != res && ETIMEDOUT == errno);
+}
+
+#else
+
+void ParkingWait::Wake() noexcept {
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    _condition.notify_all();
+}
+
+
+bool ParkingWait::Park(uint32_t epoch, std::chrono::steady_clock::time_point deadline) noexcept {
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    return _condition.wait_until(lock, deadline, [this, epoch]() {
+        return _epoch.load(std::memory_order_relaxed) != epoch;
+    });
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef UDP_COMMONS_WAITSTRATEGY_HPP_
+#define UDP_COMMONS_WAITSTRATEGY_HPP_
+
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+
+#if !defined(__linux__)
+#   include <condition_variable>
+#   include <mutex>
+#endif
+
+#include "commons/macros.h"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#   define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#   define CPU_RELAX() do {} while(false)
+#endif
+
+
+namespace udp { ;
+
+
+//! How a consumer of a bounded queue waits for the next item (see MpmcBoundedQueue::dequeueWait).
+//! A strategy is a queue template parameter: producers call `notify` after every enqueue, so the
+//! strategies, which don't park, cost nothing on the producer side.
+
+
+//! polls the queue until the deadline; the lowest latency, but burns a core while waiting.
+struct BusySpinWait final {
+
+    void notify() noexcept {}
+
+    template < typename TryTake >
+    bool wait(TryTake&& tryTake, std::chrono::nanoseconds timeout) noexcept {
+
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (!tryTake()) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+
+            CPU_RELAX();
+        }
+
+        return true;
+    }
+};
+
+
+//! polls the queue for a while, then gives the core away between polls.
+struct SpinYieldWait final {
+
+    static constexpr size_t NbSpins = 128;
+
+    void notify() noexcept {}
+
+    template < typename TryTake >
+    bool wait(TryTake&& tryTake, std::chrono::nanoseconds timeout) noexcept {
+
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        for (size_t nbPolls = 0; !tryTake(); ++nbPolls) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+
+            if (nbPolls < NbSpins) {
+                CPU_RELAX();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        return true;
+    }
+};
+
+
+//! polls the queue for a while, then parks the consumer on a futex (a condition variable on
+//! platforms without futexes) until a producer notifies. While nobody is parked, `notify` is a
+//! fence and a load of the parked counter.
+class ParkingWait final {
+    NOCOPY(ParkingWait)
+    NOMOVE(ParkingWait)
+public:
+
+    static constexpr size_t NbSpins = 128;
+
+    ParkingWait() noexcept = default;
+
+    void notify() noexcept {
+
+        // pairs with the fence in wait: either the consumer sees the item or we see it parked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (_nbParked.load(std::memory_order_relaxed) > 0)
+            Wake();
+    }
+
+    template < typename TryTake >
+    bool wait(TryTake&& tryTake, std::chrono::nanoseconds timeout) noexcept {
+
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        for (size_t i = 0; i < NbSpins; ++i) {
+            if (tryTake())
+                return true;
+
+            CPU_RELAX();
+        }
+
+        while (true) {
+            // a notify after this load changes the epoch, so the park returns at once
+            uint32_t epoch = _epoch.load(std::memory_order_acquire);
+
+            _nbParked.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (tryTake()) {
+                _nbParked.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            bool isTimedOut = !Park(epoch, deadline);
+
+            _nbParked.fetch_sub(1, std::memory_order_relaxed);
+
+            if (tryTake())
+                return true;
+
+            if (isTimedOut)
+                return false;
+        }
+    }
+
+private:
+
+    void Wake() noexcept;
+
+    //! returns false, if the deadline has passed.
+    bool Park(uint32_t epoch, std::chrono::steady_clock::time_point deadline) noexcept;
+
+    std::atomic<uint32_t> _epoch{0};
+    std::atomic<uint32_t> _nbParked{0};
+
+#if !defined(__linux__)
+    std::mutex              _mutex;
+    std::condition_variable _condition;
+#endif
+};
+
+
+}
+
+
+#endif//UDP_COMMONS_WAITSTRATEGY_HPP_
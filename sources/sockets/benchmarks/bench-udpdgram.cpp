@@ -0,0 +1,219 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "commons/logger.hpp"
+#include "commons/macros.h"
+
+#include "sockets/udpdgram.hpp"
+
+#include "benchapi.hpp"
+
+
+#pragma mark - Benchmarks Declarations
+
+bool bench__udp_sockets_UdpDgram__fanout_shared_vs_copied();
+bool bench__udp_sockets_UdpDgram__strip_header_slice_vs_copy();
+bool bench__udp_sockets_UdpDgram__header_body_gather_vs_copy();
+
+
+START_BENCH_SUIT_DECLARATION(UdpDgram)
+    DECLARE_BENCH(bench__udp_sockets_UdpDgram__fanout_shared_vs_copied)
+    DECLARE_BENCH(bench__udp_sockets_UdpDgram__strip_header_slice_vs_copy)
+    DECLARE_BENCH(bench__udp_sockets_UdpDgram__header_body_gather_vs_copy)
+FINISH_BENCH_SUIT_DECLARATION(UdpDgram)
+
+
+#pragma mark - Benchmarks Utils
+
+using namespace udp::sockets;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+namespace {
+
+
+//! clones the dgram to every peer and drops the clones, as the engine does once they are sent.
+bool MeasureFanout(const char* name, const UdpDgram& original, const std::vector<UdpAddress>& peers) {
+
+    static const size_t sNbRounds = 20000;
+
+    std::vector<UdpDgram> clones;
+    clones.reserve(peers.size());
+
+    std_clock::time_point startTp = std_clock::now();
+
+    for (size_t round = 0; round < sNbRounds; ++round) {
+        for (const UdpAddress& peer : peers) {
+            clones.push_back(original.clone(peer));
+        }
+
+        CHECK_TRUE(clones.back().valid());
+
+        clones.clear();
+    }
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000000000.0f;
+
+    LOGI << "BENCH " << name << ", " << original.size() << " bytes to " << peers.size() << " peers: "
+         << (elapsed.count() / (sNbRounds * peers.size())) << " ns per clone";
+
+    return true;
+}
+
+
+//! strips the header of every dgram of a batch, as a consumer of the input queue does.
+template < typename Strip >
+bool MeasureStripHeader(const char* name, Strip strip) {
+
+    static const size_t sNbRounds = 20000;
+    static const size_t sBatchSize = 64;
+    static const size_t sDgramSize = 1400;
+    static const size_t sHeaderSize = 16;
+
+    std::vector<UdpDgram> bodies;
+    bodies.reserve(sBatchSize);
+
+    std::chrono::duration<float> elapsed{0.0f};
+
+    for (size_t round = 0; round < sNbRounds; ++round) {
+        std::vector<UdpDgram> received;
+        for (size_t i = 0; i < sBatchSize; ++i) {
+            received.push_back(UdpDgram::Allocate(UdpAddress(), sDgramSize));
+        }
+
+        std_clock::time_point startTp = std_clock::now();
+
+        for (UdpDgram& dgram : received) {
+            bodies.push_back(strip(dgram, sHeaderSize));
+        }
+
+        received.clear();
+        bodies.clear();
+
+        elapsed += (std_clock::now() - startTp) * 1000000000.0f;
+    }
+
+    LOGI << "BENCH " << name << ", " << sDgramSize << " bytes dgrams: "
+         << (elapsed.count() / (sNbRounds * sBatchSize)) << " ns per dgram";
+
+    return true;
+}
+
+
+
+//! prefixes the same body with a header per peer, as a server broadcasting a state update does.
+template < typename Compose >
+bool MeasureCompose(const char* name, size_t szBody, Compose compose) {
+
+    static const size_t sNbRounds = 20000;
+    static const size_t sNbPeers = 64;
+    static const size_t sHeaderSize = 16;
+
+    UdpDgram header = UdpDgram::Allocate(UdpAddress(), sHeaderSize);
+    std::memset(header.data(), 0x11, sHeaderSize);
+
+    UdpDgram body = UdpDgram::Allocate(UdpAddress(), szBody);
+    std::memset(body.data(), 0x5A, szBody);
+
+    std::vector<UdpDgram> composed;
+    composed.reserve(sNbPeers);
+
+    std_clock::time_point startTp = std_clock::now();
+
+    for (size_t round = 0; round < sNbRounds; ++round) {
+        for (size_t i = 0; i < sNbPeers; ++i) {
+            composed.push_back(compose(std::as_const(header), std::as_const(body)));
+        }
+
+        CHECK_EQUAL(composed.back().totalSize(), sHeaderSize + szBody);
+
+        composed.clear();
+    }
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000000000.0f;
+
+    LOGI << "BENCH " << name << ", " << sHeaderSize << " + " << szBody << " bytes: "
+         << (elapsed.count() / (sNbRounds * sNbPeers)) << " ns per dgram";
+
+    return true;
+}
+
+
+}
+
+
+#pragma mark - Benchmarks Implementation
+
+bool bench__udp_sockets_UdpDgram__fanout_shared_vs_copied() {
+
+    static const size_t sNbPeers = 64;
+    static const size_t sDgramSize = 1400;
+
+    std::vector<UdpAddress> peers;
+    for (size_t i = 0; i < sNbPeers; ++i) {
+        peers.push_back(UdpAddress("127.0.0.1", (int)(6000 + i)));
+    }
+
+    // a payload from new[] is copied by every clone, the pooled one is shared
+    std::unique_ptr<uint8_t[]> pData = std::make_unique<uint8_t[]>(sDgramSize);
+    std::memset(pData.get(), 0x5A, sDgramSize);
+
+    const UdpDgram copied(UdpAddress(), std::move(pData), sDgramSize);
+
+    if (!MeasureFanout("copied", copied, peers))
+        return false;
+
+    const UdpDgram shared = copied.clone();
+
+    return MeasureFanout("shared", shared, peers);
+}
+
+
+bool bench__udp_sockets_UdpDgram__strip_header_slice_vs_copy() {
+
+    bool isOk = MeasureStripHeader("copy", [](const UdpDgram& dgram, size_t szHeader) {
+        UdpDgram body = UdpDgram::Allocate(dgram.source(), dgram.size() - szHeader);
+        std::memcpy(body.data(), dgram.data() + szHeader, body.size());
+
+        return body;
+    });
+
+    if (!isOk)
+        return false;
+
+    return MeasureStripHeader("slice", [](const UdpDgram& dgram, size_t szHeader) {
+        return dgram.slice(szHeader);
+    });
+}
+
+
+bool bench__udp_sockets_UdpDgram__header_body_gather_vs_copy() {
+
+    auto copy = [](const UdpDgram& header, const UdpDgram& body) {
+        UdpDgram dgram = UdpDgram::Allocate(UdpAddress(), header.size() + body.size());
+        std::memcpy(dgram.data(), header.data(), header.size());
+        std::memcpy(dgram.data() + header.size(), body.data(), body.size());
+
+        return dgram;
+    };
+
+    auto gather = [](const UdpDgram& header, const UdpDgram& body) {
+        UdpDgram dgram = header.clone();
+        dgram.append(body);
+
+        return dgram;
+    };
+
+    // a mtu-sized body and a body sent with GSO
+    for (size_t szBody : { (size_t)1400, (size_t)16384 }) {
+        if (!MeasureCompose("copy", szBody, copy) || !MeasureCompose("gather", szBody, gather))
+            return false;
+    }
+
+    return true;
+}
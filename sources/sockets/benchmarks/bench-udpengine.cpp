@@ -0,0 +1,631 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "commons/macros.h"
+#include "commons/payloadpool.hpp"
+
+#include "sockets/udpengine.hpp"
+
+#include "benchapi.hpp"
+
+
+#if defined(__GNUC__)
+#   define BENCH_NOINLINE __attribute__((noinline))
+#else
+#   define BENCH_NOINLINE
+#endif
+
+
+#pragma mark - Benchmarks Declarations
+
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_10_sockets();
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_1k_sockets();
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_10k_sockets();
+bool bench__udp_sockets_UdpEngine__loopback_throughput_gso();
+bool bench__udp_sockets_UdpEngine__loopback_throughput_shards();
+bool bench__udp_sockets_UdpEngine__loopback_throughput_threads();
+bool bench__udp_sockets_UdpEngine__loopback_allocations();
+
+
+START_BENCH_SUIT_DECLARATION(UdpEngine)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__select_vs_epoll_10_sockets)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__select_vs_epoll_1k_sockets)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__select_vs_epoll_10k_sockets)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__loopback_throughput_gso)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__loopback_throughput_shards)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__loopback_throughput_threads)
+    DECLARE_BENCH(bench__udp_sockets_UdpEngine__loopback_allocations)
+FINISH_BENCH_SUIT_DECLARATION(UdpEngine)
+
+
+#pragma mark - Benchmarks Utils
+
+using namespace udp::sockets;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+/// heap allocations made by the whole process (all threads); see the replaced operator new below
+static std::atomic<size_t> gNbAllocations{0};
+
+
+void* operator new(size_t szBytes) {
+
+    gNbAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* p = std::malloc(szBytes ? szBytes : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+
+// kept out of line, otherwise gcc sees free() of the pointer from operator new and complains
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+
+namespace {
+
+
+class BenchUdpEngine : public priv::UdpEngine {
+public:
+    explicit BenchUdpEngine(priv::UdpEngineBackend backend) noexcept : UdpEngine(backend) {}
+};
+
+
+class BenchUdpUser : public priv::IUdpUser {
+public:
+    void setUp( int socketId
+              , priv::UdpDgramQueue::SPtr pInputQueue
+              , priv::UdpDgramQueue::SPtr pOutputQueue ) noexcept override
+    {
+        UNUSED(socketId);
+
+        _pInputQueue = pInputQueue;
+        _pOutputQueue = pOutputQueue;
+    }
+
+    void notifyInvalid() noexcept override {}
+
+    priv::UdpDgramQueue* input() const noexcept { return _pInputQueue.get(); }
+    priv::UdpDgramQueue* output() const noexcept { return _pOutputQueue.get(); }
+
+private:
+
+    priv::UdpDgramQueue::SPtr _pInputQueue;
+    priv::UdpDgramQueue::SPtr _pOutputQueue;
+};
+
+
+const char* BackendName(priv::UdpEngineBackend backend) {
+
+    switch (backend) {
+    case priv::UdpEngineBackend::Select: return "select";
+    case priv::UdpEngineBackend::Epoll:  return "epoll";
+    case priv::UdpEngineBackend::IoUring: return "io_uring";
+    default:                             return "auto";
+    }
+}
+
+
+bool RaiseOpenFilesLimit(size_t nbFiles) {
+
+    rlimit limit;
+    if (0 != getrlimit(RLIMIT_NOFILE, &limit))
+        return false;
+
+    if (limit.rlim_cur >= nbFiles)
+        return true;
+
+    if (limit.rlim_max < nbFiles)
+        return false;
+
+    limit.rlim_cur = nbFiles;
+
+    return 0 == setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+
+template < typename Predicate >
+bool WaitFor(Predicate predicate, float msTimeout) {
+
+    std_clock::time_point startTp = std_clock::now();
+    while (!predicate()) {
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        if (elapsed.count() >= msTimeout)
+            return false;
+
+        std::this_thread::yield();
+    }
+
+    return true;
+}
+
+
+//! Ping-pongs a dgram between a server and a client while `nbIdleSockets` more bound
+//! sockets are attached to the same engine; the idle sockets never become readable,
+//! so they only add to the cost of every engine step.
+bool MeasurePingPong(priv::UdpEngineBackend backend, size_t nbIdleSockets, int port) {
+
+    static const float sDurationInMs = 2000.0f;
+    static const float sTimeoutInMs  = 1000.0f;
+
+    if (!RaiseOpenFilesLimit(nbIdleSockets + 64)) {
+        LOGW << BackendName(backend) << ": can't open " << nbIdleSockets << " sockets - skipped";
+        return true;
+    }
+
+    BenchUdpEngine engine(backend);
+    if (engine.backend() != backend) {
+        LOGI << "BENCH " << BackendName(backend) << ": not supported by the kernel - skipped";
+        return true;
+    }
+
+    std::vector<std::unique_ptr<BenchUdpUser>> idleUsers(nbIdleSockets);
+    BenchUdpUser server, client;
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    bool isSupported = true;
+    size_t nbAttached = 0;
+    for (; nbAttached < nbIdleSockets; ++nbAttached) {
+        idleUsers[nbAttached] = std::make_unique<BenchUdpUser>();
+        udpres = engine.attachSocket(idleUsers[nbAttached].get(), priv::UdpRole::Server, UdpAddress("127.0.0.1", 0));
+        if (eUdpResult_Ok != udpres) {
+            isSupported = false;
+            break;
+        }
+    }
+
+    if (isSupported) {
+        udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", port));
+        isSupported = isSupported && eUdpResult_Ok == udpres;
+    }
+
+    if (isSupported) {
+        udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", port));
+        isSupported = isSupported && eUdpResult_Ok == udpres;
+    }
+
+    if (!isSupported) {
+        LOGI << "BENCH " << BackendName(backend) << ", " << nbIdleSockets << " idle sockets: not supported by the backend";
+    } else {
+        UdpDgram ping({0, 1, 2, 3, 4, 5, 6, 7});
+        UdpDgram received;
+
+        size_t nbRoundTrips = 0;
+
+        std_clock::time_point startTp = std_clock::now();
+        std::chrono::duration<float> elapsed;
+        while (true) {
+            elapsed = (std_clock::now() - startTp) * 1000.0f;
+            if (elapsed.count() >= sDurationInMs)
+                break;
+
+            CHECK_TRUE(client.output()->enqueue(ping.clone()));
+            CHECK_TRUE(WaitFor([&]() { return server.input()->dequeue(received); }, sTimeoutInMs));
+
+            CHECK_TRUE(server.output()->enqueue(received.clone(received.source())));
+            CHECK_TRUE(WaitFor([&]() { return client.input()->dequeue(received); }, sTimeoutInMs));
+
+            ++nbRoundTrips;
+        }
+
+        LOGI << "BENCH " << BackendName(backend) << ", " << nbIdleSockets << " idle sockets: "
+             << (nbRoundTrips * 1000.0f / elapsed.count()) << " round trips/s, "
+             << (elapsed.count() * 1000.0f / nbRoundTrips) << " us per round trip";
+
+        engine.detachSocket(&client);
+        engine.detachSocket(&server);
+    }
+
+    for (size_t i = 0; i < nbAttached; ++i) {
+        engine.detachSocket(idleUsers[i].get());
+    }
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+//! Pushes equal-sized dgrams from a client to a server over loopback as fast as the
+//! output queue accepts them and counts what the server gets.
+bool MeasureThroughput(bool isGsoEnabled, int port) {
+
+    static const float sDurationInMs = 2000.0f;
+    static const size_t sDgramSize = 512;
+
+    const char* modeName = isGsoEnabled ? "gso" : "sendmmsg";
+
+    BenchUdpEngine engine(priv::UdpEngineBackend::Auto);
+    BenchUdpUser server, client;
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", port));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", port));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    if (eUdpResult_Ok != engine.setSegmentationOffload(&client, isGsoEnabled)) {
+        LOGI << "BENCH " << modeName << ": not supported - skipped";
+
+        engine.detachSocket(&client);
+        engine.detachSocket(&server);
+
+        return true;
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::unique_ptr<uint8_t[]> pPayload = std::make_unique<uint8_t[]>(sDgramSize);
+    UdpDgram payload(UdpAddress(), std::move(pPayload), sDgramSize);
+    UdpDgram received;
+
+    size_t nbEnqueued = 0, nbReceived = 0;
+
+    std_clock::time_point startTp = std_clock::now();
+    std::chrono::duration<float> elapsed;
+    while (true) {
+        elapsed = (std_clock::now() - startTp) * 1000.0f;
+        if (elapsed.count() >= sDurationInMs)
+            break;
+
+        while (client.output()->enqueue(payload.clone()))
+            ++nbEnqueued;
+
+        while (server.input()->dequeue(received))
+            ++nbReceived;
+
+        std::this_thread::yield();
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+
+    LOGI << "BENCH " << modeName << ", " << sDgramSize << " bytes dgrams: "
+         << (stats.mNbSent * 1000.0f / elapsed.count()) << " sent/s, "
+         << (nbReceived * 1000.0f / elapsed.count()) << " recieved/s, "
+         << stats.sentPerCall() << " dgrams per send call, "
+         << stats.mNbSegmentedDgrams << " segmented, "
+         << stats.mNbInputDropped << " dropped";
+
+    engine.detachSocket(&client);
+    engine.detachSocket(&server);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+//! `*pRecievedPerSecond` is the rate the user dequeued the server dgrams at.
+bool MeasureShardedThroughput(size_t nbShards, int port, float* pRecievedPerSecond) {
+
+    static const float sDurationInMs = 2000.0f;
+    static const size_t sDgramSize = 512;
+    static const size_t sNbClients = 32;
+
+    BenchUdpEngine engine(priv::UdpEngineBackend::Auto);
+    BenchUdpUser server;
+    std::vector<BenchUdpUser> clients(sNbClients);
+
+    UdpResult udpres = engine.attachShardedSocket(&server, UdpAddress("127.0.0.1", port), nbShards, priv::UdpShardQueues::Merged);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // many peers, so the kernel has something to spread over the shards
+    for (auto& client : clients) {
+        udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", port));
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::unique_ptr<uint8_t[]> pPayload = std::make_unique<uint8_t[]>(sDgramSize);
+    UdpDgram payload(UdpAddress(), std::move(pPayload), sDgramSize);
+    UdpDgram received;
+
+    size_t nbReceived = 0;
+
+    std_clock::time_point startTp = std_clock::now();
+    std::chrono::duration<float> elapsed;
+    while (true) {
+        elapsed = (std_clock::now() - startTp) * 1000.0f;
+        if (elapsed.count() >= sDurationInMs)
+            break;
+
+        for (auto& client : clients) {
+            while (client.output()->enqueue(payload.clone()));
+        }
+
+        while (server.input()->dequeue(received))
+            ++nbReceived;
+
+        std::this_thread::yield();
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+
+    *pRecievedPerSecond = nbReceived * 1000.0f / elapsed.count();
+
+    LOGI << "BENCH " << nbShards << " shards, " << engine.nbThreads() << " threads: "
+         << *pRecievedPerSecond << " recieved/s, "
+         << (stats.mNbSent * 1000.0f / elapsed.count()) << " sent/s, "
+         << stats.mNbInputDropped << " dropped";
+
+    for (auto& client : clients) {
+        engine.detachSocket(&client);
+    }
+    engine.detachSocket(&server);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+bool MeasureThreadsThroughput(size_t nbThreads, int firstPort) {
+
+    static const float sDurationInMs = 2000.0f;
+    static const size_t sDgramSize = 512;
+    static const size_t sNbPairs = 16;
+
+    BenchUdpEngine engine(priv::UdpEngineBackend::Auto);
+    std::vector<BenchUdpUser> servers(sNbPairs), clients(sNbPairs);
+
+    UdpResult udpres = engine.setNbThreads(nbThreads);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // independent sockets, spread over the threads by the balance policy
+    for (size_t i = 0; i < sNbPairs; ++i) {
+        UdpAddress address("127.0.0.1", firstPort + (int)i);
+
+        udpres = engine.attachSocket(&servers[i], priv::UdpRole::Server, address);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        udpres = engine.attachSocket(&clients[i], priv::UdpRole::Client, address);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::unique_ptr<uint8_t[]> pPayload = std::make_unique<uint8_t[]>(sDgramSize);
+    UdpDgram payload(UdpAddress(), std::move(pPayload), sDgramSize);
+    UdpDgram received;
+
+    size_t nbReceived = 0;
+
+    std_clock::time_point startTp = std_clock::now();
+    std::chrono::duration<float> elapsed;
+    while (true) {
+        elapsed = (std_clock::now() - startTp) * 1000.0f;
+        if (elapsed.count() >= sDurationInMs)
+            break;
+
+        for (size_t i = 0; i < sNbPairs; ++i) {
+            while (clients[i].output()->enqueue(payload.clone()));
+
+            while (servers[i].input()->dequeue(received))
+                ++nbReceived;
+        }
+
+        std::this_thread::yield();
+    }
+
+    LOGI << "BENCH " << nbThreads << " threads, " << sNbPairs << " socket pairs: "
+         << (nbReceived * 1000.0f / elapsed.count()) << " recieved/s";
+
+    std::vector<priv::UdpEngine::ThreadLoad> loads = engine.threadsLoad();
+    for (size_t i = 0; i < loads.size(); ++i) {
+        LOGI << "BENCH   thread " << i << ": " << loads[i].mNbSockets << " sockets, "
+             << loads[i].mDgramsPerSecond << " dgrams/s";
+    }
+
+    for (size_t i = 0; i < sNbPairs; ++i) {
+        engine.detachSocket(&clients[i]);
+        engine.detachSocket(&servers[i]);
+    }
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+//! Sends a fixed number of dgrams from a client to a server over loopback and counts heap
+//! allocations of all threads per recieved dgram (operator new and mallocs of the payload pool).
+bool MeasureAllocations(priv::UdpEngineBackend backend, int port) {
+
+    static const size_t sNbDgrams = 100000;
+    static const size_t sDgramSize = 512;
+    static const float sTimeoutInMs = 1000.0f;
+
+    BenchUdpEngine engine(backend);
+    if (engine.backend() != backend) {
+        LOGI << "BENCH " << BackendName(backend) << ": not supported by the kernel - skipped";
+        return true;
+    }
+
+    BenchUdpUser server, client;
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", port));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", port));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // every dgram is recieved on its own, instead of sharing a coalesced GRO buffer and its source
+    engine.setSegmentationOffload(&client, false);
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::unique_ptr<uint8_t[]> pPayload = std::make_unique<uint8_t[]>(sDgramSize);
+    UdpDgram payload(UdpAddress(), std::move(pPayload), sDgramSize);
+    UdpDgram received;
+
+    size_t nbEnqueued = 0, nbReceived = 0;
+
+    size_t nbAllocationsBefore = gNbAllocations.load();
+    size_t nbPoolAllocationsBefore = udp::PayloadPool::GetInstancePtr()->stats().mNbSystemAllocations;
+
+    // the server is drained as fast as the client fills, so the only losses are the kernel ones
+    while (nbEnqueued < sNbDgrams) {
+        while (nbEnqueued < sNbDgrams && client.output()->enqueue(payload.clone()))
+            ++nbEnqueued;
+
+        while (server.input()->dequeue(received))
+            ++nbReceived;
+
+        std::this_thread::yield();
+    }
+
+    while (WaitFor([&]() { return server.input()->dequeue(received); }, sTimeoutInMs))
+        ++nbReceived;
+
+    // payloads come from the pool, which mallocs only while it is cold
+    size_t nbAllocations = gNbAllocations.load() - nbAllocationsBefore
+                         + udp::PayloadPool::GetInstancePtr()->stats().mNbSystemAllocations - nbPoolAllocationsBefore;
+
+    LOGI << "BENCH " << BackendName(backend) << ", " << sDgramSize << " bytes dgrams: "
+         << nbReceived << " of " << nbEnqueued << " recieved, "
+         << (nbReceived > 0 ? (float)nbAllocations / nbReceived : 0.0f) << " allocations per recieved dgram";
+
+    engine.detachSocket(&client);
+    engine.detachSocket(&server);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+bool CompareBackends(size_t nbIdleSockets) {
+
+    if (!MeasurePingPong(priv::UdpEngineBackend::Select, nbIdleSockets, 5061))
+        return false;
+
+#if defined(__linux__)
+    if (!MeasurePingPong(priv::UdpEngineBackend::Epoll, nbIdleSockets, 5062))
+        return false;
+
+    if (!MeasurePingPong(priv::UdpEngineBackend::IoUring, nbIdleSockets, 5063))
+        return false;
+#endif
+
+    return true;
+}
+
+
+}
+
+
+#pragma mark - select vs epoll
+
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_10_sockets() {
+
+    return CompareBackends(10);
+}
+
+
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_1k_sockets() {
+
+    return CompareBackends(1000);
+}
+
+
+bool bench__udp_sockets_UdpEngine__select_vs_epoll_10k_sockets() {
+
+    return CompareBackends(10000);
+}
+
+
+#pragma mark - udp gso
+
+bool bench__udp_sockets_UdpEngine__loopback_throughput_gso() {
+
+    if (!MeasureThroughput(false, 5064))
+        return false;
+
+    return MeasureThroughput(true, 5065);
+}
+
+
+#pragma mark - reuseport shards
+
+bool bench__udp_sockets_UdpEngine__loopback_throughput_shards() {
+
+    static const size_t sShards[] = { 2, 4 };
+    static const int    sPorts[]  = { 5067, 5068 };
+
+    const unsigned nbCores = std::thread::hardware_concurrency();
+
+    LOGI << "BENCH hardware concurrency: " << nbCores;
+
+    float oneShardRate = 0.0f;
+    if (!MeasureShardedThroughput(1, 5066, &oneShardRate))
+        return false;
+
+    for (size_t i = 0; i < sizeof(sShards) / sizeof(sShards[0]); ++i) {
+        float rate = 0.0f;
+        if (!MeasureShardedThroughput(sShards[i], sPorts[i], &rate))
+            return false;
+
+        // a core per engine thread (clients share them with the shards) and one for this thread
+        const bool hasCores = nbCores > sShards[i] + 1;
+
+        LOGI << "BENCH " << sShards[i] << " shards: x" << (oneShardRate > 0.0f ? rate / oneShardRate : 0.0f)
+             << " of 1 shard" << (hasCores ? "" : " - too few cores, this doesn't measure scaling");
+    }
+
+    return true;
+}
+
+
+#pragma mark - engine threads
+
+bool bench__udp_sockets_UdpEngine__loopback_throughput_threads() {
+
+    if (!MeasureThreadsThroughput(1, 5070))
+        return false;
+
+    if (!MeasureThreadsThroughput(2, 5070))
+        return false;
+
+    return MeasureThreadsThroughput(4, 5070);
+}
+
+
+#pragma mark - allocations
+
+bool bench__udp_sockets_UdpEngine__loopback_allocations() {
+
+    if (!MeasureAllocations(priv::UdpEngineBackend::Select, 5086))
+        return false;
+
+#if defined(__linux__)
+    if (!MeasureAllocations(priv::UdpEngineBackend::Epoll, 5087))
+        return false;
+
+    return MeasureAllocations(priv::UdpEngineBackend::IoUring, 5088);
+#else
+    return true;
+#endif
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "commons/logger.hpp"
+#include "commons/macros.h"
+
+#include "sockets/udpengine.hpp"
+#include "sockets/udppipe.hpp"
+
+#include "benchapi.hpp"
+
+
+#pragma mark - Benchmarks Declarations
+
+bool bench__udp_sockets_UdpPipe__one_way_latency();
+
+
+START_BENCH_SUIT_DECLARATION(UdpPipe)
+    DECLARE_BENCH(bench__udp_sockets_UdpPipe__one_way_latency)
+FINISH_BENCH_SUIT_DECLARATION(UdpPipe)
+
+
+#pragma mark - Benchmarks Utils
+
+using namespace udp::sockets;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+namespace {
+
+
+class BenchUdpEngine : public priv::UdpEngine {
+public:
+    explicit BenchUdpEngine(priv::UdpEngineBackend backend) noexcept : UdpEngine(backend) {}
+};
+
+
+const char* BackendName(priv::UdpEngineBackend backend) {
+
+    switch (backend) {
+    case priv::UdpEngineBackend::Select: return "select";
+    case priv::UdpEngineBackend::Epoll:  return "epoll";
+    case priv::UdpEngineBackend::IoUring: return "io_uring";
+    default:                             return "auto";
+    }
+}
+
+
+int64_t NowInNs() {
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std_clock::now().time_since_epoch()).count();
+}
+
+
+//! the writer sends its clock in every dgram, the reader sleeps in readDatagram until the dgram
+//! arrives and takes the difference: from writeDatagram through the engine and the loopback to
+//! readDatagram of the other pipe.
+bool MeasureOneWayLatency(priv::UdpEngineBackend backend, int port) {
+
+    static const size_t sNbDgrams = 5000;
+    static const std::chrono::microseconds sInterval{100};
+
+    BenchUdpEngine engine(backend);
+
+    UdpPipe reader(&engine), writer(&engine);
+    CHECK_EQUAL(reader.open(UdpPipe::PipeEndType::Read, "127.0.0.1", (int16_t)port), eUdpResult_Ok);
+    CHECK_EQUAL(writer.open(UdpPipe::PipeEndType::Write, "127.0.0.1", (int16_t)port), eUdpResult_Ok);
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(sNbDgrams);
+
+    std::thread reading([&]() {
+        while (latencies.size() < sNbDgrams) {
+            UdpDgram dgram;
+            if (eUdpResult_Ok != reader.readDatagram(dgram, 1000))
+                break;
+
+            int64_t sentNs;
+            std::memcpy(&sentNs, dgram.data(), sizeof(sentNs));
+
+            latencies.push_back(NowInNs() - sentNs);
+        }
+    });
+
+    for (size_t i = 0; i < sNbDgrams; ++i) {
+        std::this_thread::sleep_for(sInterval);
+
+        UdpDgram dgram = UdpDgram::Allocate(UdpAddress(), sizeof(int64_t));
+
+        int64_t sentNs = NowInNs();
+        std::memcpy(dgram.data(), &sentNs, sizeof(sentNs));
+
+        CHECK_EQUAL(writer.writeDatagram(std::move(dgram), 1000), eUdpResult_Ok);
+    }
+
+    reading.join();
+
+    CHECK_EQUAL(writer.close(), eUdpResult_Ok);
+    CHECK_EQUAL(reader.close(), eUdpResult_Ok);
+    CHECK_EQUAL(engine.tearDown(), eUdpResult_Ok);
+
+    // loopback doesn't lose dgrams, unless the reader falls way behind
+    CHECK_GREATER(latencies.size(), sNbDgrams * 99 / 100);
+
+    std::sort(latencies.begin(), latencies.end());
+
+    LOGI << "BENCH " << BackendName(engine.backend()) << ", a dgram every " << sInterval.count() << " us: "
+         << latencies[latencies.size() / 2] / 1000.0f << " us median, "
+         << latencies[latencies.size() * 99 / 100] / 1000.0f << " us p99, "
+         << latencies.back() / 1000.0f << " us max";
+
+    return true;
+}
+
+
+}
+
+
+#pragma mark - Benchmarks Implementation
+
+bool bench__udp_sockets_UdpPipe__one_way_latency() {
+
+    if (!MeasureOneWayLatency(priv::UdpEngineBackend::Select, 5075))
+        return false;
+
+#if defined(__linux__)
+    if (!MeasureOneWayLatency(priv::UdpEngineBackend::Epoll, 5076))
+        return false;
+
+    if (!MeasureOneWayLatency(priv::UdpEngineBackend::IoUring, 5077))
+        return false;
+#endif
+
+    return true;
+}
@@ -0,0 +1,346 @@
+#include "sockets/iouring.hpp"
+
+
+#if defined(__linux__)
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "commons/logger.hpp"
+
+
+#define PROBE_MAX_OPS 256
+
+
+using namespace udp;
+using namespace sockets::priv;
+
+
+static int SysIoUringSetup(unsigned nbEntries, io_uring_params* pParams) {
+
+    return (int)syscall(__NR_io_uring_setup, nbEntries, pParams);
+}
+
+
+static int SysIoUringEnter(int ringId, unsigned nbToSubmit, unsigned nbMinComplete, unsigned flags, void* pArg = nullptr, size_t szArg = 0) {
+
+    return (int)syscall(__NR_io_uring_enter, ringId, nbToSubmit, nbMinComplete, flags, pArg, szArg);
+}
+
+
+static int SysIoUringRegister(int ringId, unsigned opcode, void* pArg, unsigned nbArgs) {
+
+    return (int)syscall(__NR_io_uring_register, ringId, opcode, pArg, nbArgs);
+}
+
+
+IoUring::~IoUring() noexcept {
+
+    tearDown();
+}
+
+
+UdpResult IoUring::setUp(unsigned nbEntries, const int* requiredOps, size_t nbRequiredOps) noexcept {
+
+    if (valid())
+        return eUdpResult_Already;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = nbEntries * 4; // multishot receives produce many completions per submission
+
+    int ringId = SysIoUringSetup(nbEntries, &params);
+    if (ringId < 0 && EINVAL == errno) {
+        memset(&params, 0, sizeof(params));
+        ringId = SysIoUringSetup(nbEntries, &params);
+    }
+
+    if (ringId < 0) {
+        LOGW << "io_uring is not available (errno == " << errno << ")";
+        return eUdpResult_Failed;
+    }
+
+    _ringId = ringId;
+
+    _szSqRing = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _szCqRing = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    _features = params.features;
+
+    bool isSingleMmap = !!(params.features & IORING_FEAT_SINGLE_MMAP);
+    if (isSingleMmap) {
+        _szSqRing = _szCqRing = std::max(_szSqRing, _szCqRing);
+    }
+
+    _pSqRing = mmap(nullptr, _szSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringId, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == _pSqRing) {
+        _pSqRing = nullptr;
+        LOGE << "Failed to map io_uring submission ring (errno == " << errno << ")";
+        tearDown();
+        return eUdpResult_Failed;
+    }
+
+    if (isSingleMmap) {
+        _pCqRing = _pSqRing;
+    } else {
+        _pCqRing = mmap(nullptr, _szCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringId, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == _pCqRing) {
+            _pCqRing = nullptr;
+            LOGE << "Failed to map io_uring completion ring (errno == " << errno << ")";
+            tearDown();
+            return eUdpResult_Failed;
+        }
+    }
+
+    _szSqes = params.sq_entries * sizeof(io_uring_sqe);
+    _pSqes = (io_uring_sqe*)mmap(nullptr, _szSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringId, IORING_OFF_SQES);
+    if (MAP_FAILED == (void*)_pSqes) {
+        _pSqes = nullptr;
+        LOGE << "Failed to map io_uring submission entries (errno == " << errno << ")";
+        tearDown();
+        return eUdpResult_Failed;
+    }
+
+    uint8_t* pSq = (uint8_t*)_pSqRing;
+    _pSqHead  = (unsigned*)(pSq + params.sq_off.head);
+    _pSqTail  = (unsigned*)(pSq + params.sq_off.tail);
+    _pSqFlags = (unsigned*)(pSq + params.sq_off.flags);
+    _pSqArray = (unsigned*)(pSq + params.sq_off.array);
+    _sqMask   = *(unsigned*)(pSq + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _sqLocalTail = *_pSqTail;
+
+    uint8_t* pCq = (uint8_t*)_pCqRing;
+    _pCqHead = (unsigned*)(pCq + params.cq_off.head);
+    _pCqTail = (unsigned*)(pCq + params.cq_off.tail);
+    _pCqes   = (io_uring_cqe*)(pCq + params.cq_off.cqes);
+    _cqMask  = *(unsigned*)(pCq + params.cq_off.ring_mask);
+
+    size_t szProbe = sizeof(io_uring_probe) + PROBE_MAX_OPS * sizeof(io_uring_probe_op);
+    std::unique_ptr<uint8_t[]> pProbeData = std::make_unique<uint8_t[]>(szProbe);
+    io_uring_probe* pProbe = (io_uring_probe*)pProbeData.get();
+
+    if (SysIoUringRegister(ringId, IORING_REGISTER_PROBE, pProbe, PROBE_MAX_OPS) < 0) {
+        LOGW << "Failed to probe io_uring opcodes (errno == " << errno << ")";
+        tearDown();
+        return eUdpResult_Failed;
+    }
+
+    for (size_t i = 0; i < nbRequiredOps; ++i) {
+        int op = requiredOps[i];
+        if (op > pProbe->last_op || !(pProbe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            LOGW << "io_uring opcode " << op << " is not supported by the kernel";
+            tearDown();
+            return eUdpResult_Failed;
+        }
+    }
+
+    return eUdpResult_Ok;
+}
+
+
+void IoUring::tearDown() noexcept {
+
+    if (_ringId >= 0) {
+        close(_ringId); // cancels all in-flight requests
+        _ringId = -1;
+    }
+
+    if (_pBuffers) {
+        munmap(_pBuffers, (size_t)(_bufMask + 1) * _szBuffer);
+        _pBuffers = nullptr;
+    }
+
+    if (_pBufRing) {
+        munmap(_pBufRing, _szBufRing);
+        _pBufRing = nullptr;
+    }
+
+    if (_pSqes) {
+        munmap(_pSqes, _szSqes);
+        _pSqes = nullptr;
+    }
+
+    if (_pCqRing && _pCqRing != _pSqRing) {
+        munmap(_pCqRing, _szCqRing);
+    }
+    _pCqRing = nullptr;
+
+    if (_pSqRing) {
+        munmap(_pSqRing, _szSqRing);
+        _pSqRing = nullptr;
+    }
+}
+
+
+UdpResult IoUring::setUpBuffers(uint16_t groupId, unsigned nbBuffers, unsigned szBuffer) noexcept {
+
+    if (!valid())
+        return eUdpResult_Failed;
+
+    if (_pBufRing)
+        return eUdpResult_Already;
+
+    if (0 == nbBuffers || (nbBuffers & (nbBuffers - 1)) != 0 || nbBuffers > 32768) {
+        LOGE << "Number of provided buffers must be a power of 2 not larger than 32768";
+        return eUdpResult_Failed;
+    }
+
+    _szBufRing = nbBuffers * sizeof(io_uring_buf);
+    void* pBufRing = mmap(nullptr, _szBufRing, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == pBufRing) {
+        LOGE << "Failed to allocate provided buffers ring (errno == " << errno << ")";
+        return eUdpResult_Failed;
+    }
+
+    void* pBuffers = mmap(nullptr, (size_t)nbBuffers * szBuffer, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == pBuffers) {
+        LOGE << "Failed to allocate provided buffers (errno == " << errno << ")";
+        munmap(pBufRing, _szBufRing);
+        return eUdpResult_Failed;
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)pBufRing;
+    reg.ring_entries = nbBuffers;
+    reg.bgid = groupId;
+
+    if (SysIoUringRegister(_ringId, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        LOGW << "Failed to register provided buffers ring (errno == " << errno << ")";
+        munmap(pBuffers, (size_t)nbBuffers * szBuffer);
+        munmap(pBufRing, _szBufRing);
+        return eUdpResult_Failed;
+    }
+
+    _pBufRing = (io_uring_buf*)pBufRing;
+    _pBuffers = (uint8_t*)pBuffers;
+    _bufMask = nbBuffers - 1;
+    _szBuffer = szBuffer;
+    _bufLocalTail = 0;
+    _bufGroupId = groupId;
+
+    for (unsigned i = 0; i < nbBuffers; ++i) {
+        recycleBuffer((uint16_t)i);
+    }
+
+    commitBuffers();
+
+    return eUdpResult_Ok;
+}
+
+
+void IoUring::recycleBuffer(uint16_t bufferId) noexcept {
+
+    io_uring_buf* pBuf = &_pBufRing[_bufLocalTail & _bufMask];
+    pBuf->addr = (uint64_t)buffer(bufferId);
+    pBuf->len = _szBuffer;
+    pBuf->bid = bufferId;
+
+    ++_bufLocalTail;
+}
+
+
+void IoUring::commitBuffers() noexcept {
+
+    // the ring tail overlays the reserved field of the first entry
+    __atomic_store_n(&_pBufRing[0].resv, _bufLocalTail, __ATOMIC_RELEASE);
+}
+
+
+io_uring_sqe* IoUring::getSqe() noexcept {
+
+    unsigned head = __atomic_load_n(_pSqHead, __ATOMIC_ACQUIRE);
+    if (_sqLocalTail - head >= _sqEntries)
+        return nullptr;
+
+    unsigned index = _sqLocalTail & _sqMask;
+    _pSqArray[index] = index;
+    ++_sqLocalTail;
+
+    io_uring_sqe* pSqe = &_pSqes[index];
+    memset(pSqe, 0, sizeof(io_uring_sqe));
+
+    return pSqe;
+}
+
+
+unsigned IoUring::nbPendingSqes() const noexcept {
+
+    return _sqLocalTail - __atomic_load_n(_pSqHead, __ATOMIC_ACQUIRE);
+}
+
+
+int IoUring::submit(unsigned nbWaitCompletions, int msTimeout) noexcept {
+
+    __atomic_store_n(_pSqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+    unsigned nbToSubmit = nbPendingSqes();
+    if (0 == nbToSubmit && 0 == nbWaitCompletions)
+        return 0;
+
+    unsigned flags = nbWaitCompletions > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    // without the extended argument (linux 5.11+) the wait is unbounded
+    __kernel_timespec timeout;
+    io_uring_getevents_arg waitArg;
+    memset(&waitArg, 0, sizeof(waitArg));
+
+    bool isTimed = nbWaitCompletions > 0 && msTimeout >= 0 && (_features & IORING_FEAT_EXT_ARG);
+    if (isTimed) {
+        timeout.tv_sec = msTimeout / 1000;
+        timeout.tv_nsec = (long long)(msTimeout % 1000) * 1000000;
+
+        waitArg.ts = (uint64_t)&timeout;
+
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int res;
+    do {
+        if (isTimed) {
+            res = SysIoUringEnter(_ringId, nbToSubmit, nbWaitCompletions, flags, &waitArg, sizeof(waitArg));
+        } else {
+            res = SysIoUringEnter(_ringId, nbToSubmit, nbWaitCompletions, flags);
+        }
+    } while (res < 0 && EINTR == errno);
+
+    return res < 0 ? -errno : res;
+}
+
+
+io_uring_cqe* IoUring::peekCqe() noexcept {
+
+    unsigned head = *_pCqHead;
+    unsigned tail = __atomic_load_n(_pCqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return nullptr;
+
+    return &_pCqes[head & _cqMask];
+}
+
+
+void IoUring::seenCqe() noexcept {
+
+    __atomic_store_n(_pCqHead, *_pCqHead + 1, __ATOMIC_RELEASE);
+}
+
+
+void IoUring::flushOverflow() noexcept {
+
+    if (__atomic_load_n(_pSqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+        SysIoUringEnter(_ringId, 0, 0, IORING_ENTER_GETEVENTS);
+    }
+}
+
+
+#endif//defined(__linux__)
@@ -0,0 +1,115 @@
+#ifndef UDP_SOCKETS_IOURING_HPP_
+#define UDP_SOCKETS_IOURING_HPP_
+
+
+#if defined(__linux__)
+
+
+#include <cinttypes>
+#include <cstddef>
+
+#include <linux/io_uring.h>
+
+#include "commons/macros.h"
+#include "commons/types.h"
+
+
+namespace udp { ;
+namespace sockets { ;
+namespace priv { ;
+
+
+//! @NOTE(stoned_fox): minimal io_uring wrapper over raw syscalls - only what the UdpEngine needs,
+//!                    so we don't drag liburing as a dependency. Not thread-safe: the owner must
+//!                    serialize access to the submission side.
+class IoUring final {
+    NOCOPY(IoUring)
+    NOMOVE(IoUring)
+public:
+
+    IoUring() noexcept = default;
+   ~IoUring() noexcept;
+
+    //! creates the ring and checks that the kernel supports every opcode in `requiredOps`.
+    UdpResult setUp(unsigned nbEntries, const int* requiredOps, size_t nbRequiredOps) noexcept;
+    void tearDown() noexcept;
+
+    bool valid() const noexcept { return _ringId >= 0; }
+
+    //! registers a kernel-provided buffers ring; buffers are handed out by the kernel to
+    //! requests flagged with IOSQE_BUFFER_SELECT and must be returned with `recycleBuffer`.
+    UdpResult setUpBuffers(uint16_t groupId, unsigned nbBuffers, unsigned szBuffer) noexcept;
+
+    uint16_t buffersGroup() const noexcept { return _bufGroupId; }
+    unsigned bufferSize() const noexcept { return _szBuffer; }
+
+    uint8_t* buffer(uint16_t bufferId) const noexcept { return _pBuffers + (size_t)bufferId * _szBuffer; }
+
+    void recycleBuffer(uint16_t bufferId) noexcept;
+    void commitBuffers() noexcept;
+
+    //! returns nullptr if the submission queue is full; the returned entry is zeroed.
+    io_uring_sqe* getSqe() noexcept;
+
+    unsigned nbPendingSqes() const noexcept;
+
+    //! submits all pending entries and waits for `nbWaitCompletions` completions, but no longer
+    //! than `msTimeout` if it isn't negative (-ETIME); returns the number of submitted entries or -errno.
+    int submit(unsigned nbWaitCompletions = 0, int msTimeout = -1) noexcept;
+
+    //! returns the next completion or nullptr; `seenCqe` must be called after processing it.
+    io_uring_cqe* peekCqe() noexcept;
+    void seenCqe() noexcept;
+
+    //! moves completions, which didn't fit into the completion queue, back to it.
+    void flushOverflow() noexcept;
+
+private:
+
+    int _ringId{-1};
+
+    unsigned _features{0};
+
+    void*  _pSqRing{nullptr};
+    size_t _szSqRing{0};
+    void*  _pCqRing{nullptr};
+    size_t _szCqRing{0};
+
+    io_uring_sqe* _pSqes{nullptr};
+    size_t        _szSqes{0};
+
+    unsigned* _pSqHead{nullptr};
+    unsigned* _pSqTail{nullptr};
+    unsigned* _pSqFlags{nullptr};
+    unsigned* _pSqArray{nullptr};
+    unsigned  _sqMask{0};
+    unsigned  _sqEntries{0};
+    unsigned  _sqLocalTail{0};
+
+    unsigned*     _pCqHead{nullptr};
+    unsigned*     _pCqTail{nullptr};
+    io_uring_cqe* _pCqes{nullptr};
+    unsigned      _cqMask{0};
+
+    //! @NOTE(stoned_fox): the ring is addressed as a plain array of entries - in C++ the uapi
+    //!                    io_uring_buf_ring::bufs gets shifted by the empty struct of
+    //!                    __DECLARE_FLEX_ARRAY, so the kernel and we would disagree on the layout.
+    io_uring_buf* _pBufRing{nullptr};
+    size_t        _szBufRing{0};
+    uint8_t*      _pBuffers{nullptr};
+    unsigned      _bufMask{0};
+    unsigned      _szBuffer{0};
+    uint16_t      _bufLocalTail{0};
+    uint16_t      _bufGroupId{0};
+};
+
+
+} // namespace priv
+} // namespace sockets
+} // namespace udp
+
+
+#endif//defined(__linux__)
+
+
+#endif//UDP_SOCKETS_IOURING_HPP_
@@ -0,0 +1,296 @@
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "commons/macros.h"
+#include "commons/payloadpool.hpp"
+
+#include "sockets/udpdgram.hpp"
+
+#include "testapi.hpp"
+
+
+#pragma mark - Tests Declarations
+
+bool test__udp_sockets_UdpDgram__correctness_shared_clones();
+bool test__udp_sockets_UdpDgram__correctness_copy_on_write();
+bool test__udp_sockets_UdpDgram__correctness_unpooled_clones();
+bool test__udp_sockets_UdpDgram__correctness_slices();
+bool test__udp_sockets_UdpDgram__correctness_slices_copy_on_write();
+bool test__udp_sockets_UdpDgram__correctness_segments();
+
+
+START_TEST_SUIT_DECLARATION(UdpDgram)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_shared_clones)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_copy_on_write)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_unpooled_clones)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_slices)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_slices_copy_on_write)
+    DECLARE_TEST(test__udp_sockets_UdpDgram__correctness_segments)
+FINISH_TEST_SUIT_DECLARATION(UdpDgram)
+
+
+#pragma mark - Tests Utils
+
+using namespace udp::sockets;
+
+using udp::PayloadPool;
+
+
+namespace {
+
+
+UdpDgram MakePooledDgram(size_t szData, uint8_t seed) {
+
+    UdpDgram dgram = UdpDgram::Allocate(UdpAddress(), szData);
+    for (size_t i = 0; i < szData; ++i) {
+        dgram.data()[i] = (uint8_t)(seed + i);
+    }
+
+    return dgram;
+}
+
+
+}
+
+
+#pragma mark - Tests Implementation
+
+bool test__udp_sockets_UdpDgram__correctness_shared_clones() {
+
+    static const size_t sNbPeers = 64;
+
+    const UdpDgram original = MakePooledDgram(1400, 7);
+    CHECK_TRUE(original.valid());
+
+    std::vector<UdpDgram> clones;
+    for (size_t i = 0; i < sNbPeers; ++i) {
+        clones.push_back(original.clone(UdpAddress("127.0.0.1", (int)(6000 + i))));
+    }
+
+    clones.push_back(original.clone((UdpPeerId)42));
+    clones.push_back(original.clone());
+
+    // every clone refers to the very same payload, but carries its own address
+    for (size_t i = 0; i < clones.size(); ++i) {
+        const UdpDgram& clone = clones[i];
+
+        CHECK_TRUE(clone.data() == original.data());
+        CHECK_EQUAL(clone.size(), original.size());
+
+        if (i < sNbPeers) {
+            CHECK_TRUE(clone.source() == UdpAddress("127.0.0.1", (int)(6000 + i)));
+        }
+    }
+
+    CHECK_EQUAL(clones[sNbPeers].peer(), (UdpPeerId)42);
+    CHECK_FALSE(clones[sNbPeers].source().valid());
+
+    CHECK_TRUE(PayloadPool::IsShared(original.data()));
+
+    // the payload outlives any owner, the last one gives it back
+    clones.clear();
+    CHECK_FALSE(PayloadPool::IsShared(original.data()));
+
+    for (size_t i = 0; i < original.size(); ++i) {
+        CHECK_EQUAL(original.data()[i], (uint8_t)(7 + i));
+    }
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpDgram__correctness_copy_on_write() {
+
+    UdpDgram original = MakePooledDgram(512, 3);
+    UdpDgram clone = original.clone();
+
+    const uint8_t* pShared = std::as_const(original).data();
+    CHECK_TRUE(std::as_const(clone).data() == pShared);
+
+    // mutable access of a shared payload makes a private copy; the clone keeps the original
+    uint8_t* pWritable = clone.data();
+    CHECK_TRUE(!!pWritable);
+    CHECK_TRUE(pWritable != pShared);
+
+    pWritable[0] = 0xFF;
+
+    CHECK_EQUAL(std::as_const(original).data()[0], (uint8_t)3);
+    CHECK_EQUAL(std::as_const(clone).data()[0], (uint8_t)0xFF);
+    CHECK_EQUAL(std::memcmp(std::as_const(original).data() + 1, std::as_const(clone).data() + 1, 511), 0);
+
+    // the sole owner writes in place
+    CHECK_FALSE(PayloadPool::IsShared(pShared));
+    CHECK_TRUE(original.data() == pShared);
+    CHECK_TRUE(clone.data() == pWritable);
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpDgram__correctness_unpooled_clones() {
+
+    std::unique_ptr<uint8_t[]> pData = std::make_unique<uint8_t[]>(100);
+    std::memset(pData.get(), 0x5A, 100);
+
+    const UdpDgram original(UdpAddress(), std::move(pData), 100);
+
+    // a payload from new[] can't be shared: the first clone copies it into the pool
+    UdpDgram clone = original.clone();
+    CHECK_TRUE(clone.data() != original.data());
+    CHECK_EQUAL(std::memcmp(clone.data(), original.data(), 100), 0);
+
+    // ...and clones of the clone share the pooled copy
+    UdpDgram grandClone = std::as_const(clone).clone();
+    CHECK_TRUE(std::as_const(grandClone).data() == std::as_const(clone).data());
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpDgram__correctness_slices() {
+
+    static const size_t sHeaderSize = 12;
+
+    UdpDgram body;
+    const uint8_t* pPayload;
+    {
+        UdpDgram received = MakePooledDgram(200, 0);
+        received.setSource(UdpAddress("127.0.0.1", 6000), 5);
+
+        pPayload = std::as_const(received).data();
+
+        // strip the header: the body refers to the same buffer and keeps it alive
+        body = received.slice(sHeaderSize);
+    }
+
+    CHECK_TRUE(body.valid());
+    CHECK_EQUAL(body.size(), (size_t)(200 - sHeaderSize));
+    CHECK_TRUE(std::as_const(body).data() == pPayload + sHeaderSize);
+    CHECK_TRUE(body.source() == UdpAddress("127.0.0.1", 6000));
+    CHECK_EQUAL(body.peer(), (UdpPeerId)5);
+
+    for (size_t i = 0; i < body.size(); ++i) {
+        CHECK_EQUAL(std::as_const(body).data()[i], (uint8_t)(sHeaderSize + i));
+    }
+
+    // slices of slices, clones of slices
+    UdpDgram field = body.slice(8, 4);
+    CHECK_EQUAL(field.size(), (size_t)4);
+    CHECK_TRUE(std::as_const(field).data() == pPayload + sHeaderSize + 8);
+
+    UdpDgram copy = field.clone(UdpAddress("127.0.0.1", 6001));
+    CHECK_TRUE(std::as_const(copy).data() == std::as_const(field).data());
+    CHECK_EQUAL(copy.size(), (size_t)4);
+
+    // the range is clamped to the payload
+    CHECK_EQUAL(body.slice(180).size(), (size_t)8);
+    CHECK_EQUAL(body.slice(100, 1000).size(), (size_t)88);
+    CHECK_FALSE(body.slice(188).valid());
+    CHECK_FALSE(body.slice(5, 0).valid());
+    CHECK_TRUE(body.slice(188).source() == body.source());
+
+    // slices of dgrams with a payload from new[] are copies
+    std::unique_ptr<uint8_t[]> pData = std::make_unique<uint8_t[]>(16);
+    std::memset(pData.get(), 0x11, 16);
+
+    const UdpDgram unpooled(UdpAddress(), std::move(pData), 16);
+    UdpDgram unpooledSlice = unpooled.slice(4, 8);
+    CHECK_EQUAL(unpooledSlice.size(), (size_t)8);
+    CHECK_TRUE(std::as_const(unpooledSlice).data() != unpooled.data() + 4);
+    CHECK_EQUAL(std::memcmp(std::as_const(unpooledSlice).data(), unpooled.data() + 4, 8), 0);
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpDgram__correctness_slices_copy_on_write() {
+
+    UdpDgram original = MakePooledDgram(64, 100);
+    UdpDgram slice = original.slice(16, 16);
+
+    // writing to the slice copies just its bytes; the original stays intact
+    uint8_t* pWritable = slice.data();
+    CHECK_TRUE(!!pWritable);
+    CHECK_TRUE(pWritable != std::as_const(original).data() + 16);
+
+    std::memset(pWritable, 0, 16);
+
+    for (size_t i = 0; i < 64; ++i) {
+        CHECK_EQUAL(std::as_const(original).data()[i], (uint8_t)(100 + i));
+    }
+
+    // the slice owns its copy now, the original isn't shared anymore
+    CHECK_FALSE(PayloadPool::IsShared(std::as_const(original).data()));
+    CHECK_TRUE(slice.data() == pWritable);
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpDgram__correctness_segments() {
+
+    static const uint8_t sBorrowed[4] = { 0xB0, 0xB1, 0xB2, 0xB3 };
+
+    int nbReleased = 0;
+    auto release = [](void* pContext) { ++*(int*)pContext; };
+
+    const UdpDgram header = MakePooledDgram(8, 0);
+    const UdpDgram body = MakePooledDgram(32, 50);
+    {
+        UdpDgram dgram = header.clone();
+        CHECK_EQUAL(dgram.nbSegments(), (size_t)1);
+
+        // pooled segments are shared, borrowed ones are referred to as is
+        CHECK_EQUAL(dgram.append(body), eUdpResult_Ok);
+        CHECK_EQUAL(dgram.append(sBorrowed, sizeof(sBorrowed), release, &nbReleased), eUdpResult_Ok);
+
+        CHECK_EQUAL(dgram.nbSegments(), (size_t)3);
+        CHECK_EQUAL(dgram.totalSize(), (size_t)(8 + 32 + 4));
+        CHECK_EQUAL(dgram.size(), (size_t)8);
+
+        CHECK_TRUE(dgram.segmentData(0) == header.data());
+        CHECK_TRUE(dgram.segmentData(1) == body.data());
+        CHECK_TRUE(dgram.segmentData(2) == sBorrowed);
+        CHECK_EQUAL(dgram.segmentSize(1), (size_t)32);
+        CHECK_TRUE(PayloadPool::IsShared(body.data()));
+
+        // a clone shares pooled segments, but copies the borrowed one: its releaser is called once
+        UdpDgram clone = dgram.clone(UdpAddress("127.0.0.1", 6000));
+        CHECK_EQUAL(clone.nbSegments(), (size_t)3);
+        CHECK_TRUE(clone.segmentData(1) == body.data());
+        CHECK_TRUE(clone.segmentData(2) != sBorrowed);
+        CHECK_EQUAL(std::memcmp(clone.segmentData(2), sBorrowed, sizeof(sBorrowed)), 0);
+
+        // appending a multi-segment dgram appends all of its segments
+        UdpDgram joined = MakePooledDgram(2, 200);
+        CHECK_EQUAL(joined.append(clone), eUdpResult_Ok);
+        CHECK_EQUAL(joined.nbSegments(), (size_t)4);
+        CHECK_EQUAL(joined.totalSize(), (size_t)(2 + 8 + 32 + 4));
+
+        // there's room for MaxSegments segments only; a failed append doesn't call the releaser
+        while (joined.nbSegments() < UdpDgram::MaxSegments) {
+            CHECK_EQUAL(joined.append(body), eUdpResult_Ok);
+        }
+        CHECK_EQUAL(joined.append(body), eUdpResult_Failed);
+        CHECK_EQUAL(joined.append(sBorrowed, sizeof(sBorrowed), release, &nbReleased), eUdpResult_Failed);
+        CHECK_EQUAL(joined.nbSegments(), UdpDgram::MaxSegments);
+
+        // moved dgrams take the segments along
+        UdpDgram moved = std::move(dgram);
+        CHECK_EQUAL(moved.nbSegments(), (size_t)3);
+        CHECK_EQUAL(nbReleased, 0);
+    }
+
+    CHECK_EQUAL(nbReleased, 1);
+    CHECK_FALSE(PayloadPool::IsShared(body.data()));
+    CHECK_FALSE(PayloadPool::IsShared(header.data()));
+
+    // an empty dgram has no segments to append to
+    UdpDgram empty;
+    CHECK_EQUAL(empty.nbSegments(), (size_t)0);
+    CHECK_EQUAL(empty.append(body), eUdpResult_Failed);
+
+    return true;
+}
@@ -3,6 +3,15 @@
 #include <list>
 #include <memory>
 #include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "commons/macros.h"
 
@@ -13,6 +22,9 @@
 
 #pragma mark - Tests Declarations
 
+using udp::sockets::priv::UdpEngineBackend;
+
+
 bool test__udp_sockets_UdpEngine__correctness_start_stop();
 bool test__udp_sockets_UdpEngine__correctness_singlethread_multi_start();
 bool test__udp_sockets_UdpEngine__correctness_singlethread_multi_stop();
@@ -21,10 +33,56 @@ bool test__udp_sockets_UdpEngine__correctness_multithread_multi_start();
 bool test__udp_sockets_UdpEngine__correctness_multithread_multi_stop();
 bool test__udp_sockets_UdpEngine__correctness_multithread_multi_start_stop();
 bool test__udp_sockets_UdpEngine__lifeness_multithread_multi_start_stop();
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_socket_config();
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram();
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram();
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgrams_batch();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgram_sizes();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_large_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_overflow_policies();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_spsc_queues();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_wait_for_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_dgrams_batch();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_segmented_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_gathered_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_oversized_dgram();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_coalesced_dgrams();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_sharded_server_merged_queues();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_sharded_server_per_shard_queues();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_move_socket();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_sockets();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_spsc_socket();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_idle_wakeups();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_attach_latency_under_load();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_drain_quantum();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_peers();
 
 
 START_TEST_SUIT_DECLARATION(UdpEngine)
@@ -40,11 +98,77 @@ START_TEST_SUIT_DECLARATION(UdpEngine)
 
     DECLARE_TEST(test__udp_sockets_UdpEngine__lifeness_multithread_multi_start_stop)
 
-    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users, 1)
-
-    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram, 1)
-    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram, 1)
-    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_socket_config<UdpEngineBackend::Select>, 1)
+
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgrams_batch<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgram_sizes<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_large_dgrams<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_overflow_policies<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_spsc_queues<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_wait_for_dgrams<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_gathered_dgrams<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_oversized_dgram<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_dgrams_batch<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_sharded_server_merged_queues<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_move_socket<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_spsc_socket<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_sockets<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_idle_wakeups<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_attach_latency_under_load<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_drain_quantum<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_peers<UdpEngineBackend::Select>, 1)
+
+#if defined(__linux__)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_socket_config<UdpEngineBackend::Epoll>, 1)
+
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgrams_batch<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgram_sizes<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_large_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_overflow_policies<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_spsc_queues<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_wait_for_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_gathered_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_oversized_dgram<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_dgrams_batch<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_segmented_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_coalesced_dgrams<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_sharded_server_merged_queues<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_sharded_server_per_shard_queues<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_move_socket<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_spsc_socket<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_idle_wakeups<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_attach_latency_under_load<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_drain_quantum<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_peers<UdpEngineBackend::Epoll>, 1)
+
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_socket_config<UdpEngineBackend::IoUring>, 1)
+
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgram_sizes<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_recieve_large_dgrams<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_overflow_policies<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_spsc_queues<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_wait_for_dgrams<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_gathered_dgrams<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_send_oversized_dgram<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_sharded_server_merged_queues<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_move_socket<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_spsc_socket<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_idle_wakeups<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_attach_latency_under_load<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpEngine__correctness_singlethread_peers<UdpEngineBackend::IoUring>, 1)
+#endif
 FINISH_TEST_SUIT_DECLARATION(UdpEngine)
 
 
@@ -62,6 +186,13 @@ namespace {
 class TestUdpEngine : public priv::UdpEngine {
 public:
     TestUdpEngine() noexcept : UdpEngine() {}
+
+    explicit TestUdpEngine(UdpEngineBackend backend) noexcept : UdpEngine(backend) {
+
+        if (this->backend() != backend) {
+            LOGW << "Requested engine backend is not supported - testing the fallback one";
+        }
+    }
 };
 
 
@@ -101,6 +232,45 @@ private:
 };
 
 
+class TestShardedUdpUser : public priv::IUdpUser {
+public:
+    void setUp( int socketId
+              , priv::UdpDgramQueue::SPtr pInputQueue
+              , priv::UdpDgramQueue::SPtr pOutputQueue ) noexcept override
+    {
+        setUpShard(0, socketId, pInputQueue, pOutputQueue);
+    }
+
+    void setUpShard( size_t shardIndex
+                   , int socketId
+                   , priv::UdpDgramQueue::SPtr pInputQueue
+                   , priv::UdpDgramQueue::SPtr pOutputQueue ) noexcept override
+    {
+        UNUSED(socketId);
+
+        if (_inputQueues.size() <= shardIndex) {
+            _inputQueues.resize(shardIndex + 1);
+            _outputQueues.resize(shardIndex + 1);
+        }
+
+        _inputQueues[shardIndex] = pInputQueue;
+        _outputQueues[shardIndex] = pOutputQueue;
+    }
+
+    void notifyInvalid() noexcept override {}
+
+    size_t nbShards() const noexcept { return _inputQueues.size(); }
+
+    priv::UdpDgramQueue* input(size_t shardIndex) const noexcept { return _inputQueues[shardIndex].get(); }
+    priv::UdpDgramQueue* output(size_t shardIndex) const noexcept { return _outputQueues[shardIndex].get(); }
+
+private:
+
+    std::vector<priv::UdpDgramQueue::SPtr> _inputQueues;
+    std::vector<priv::UdpDgramQueue::SPtr> _outputQueues;
+};
+
+
 struct StartStopThreadDelegate {
     enum StateType { eState_Down, eState_Work, eState_Abort };
 
@@ -724,6 +894,7 @@ bool test__udp_sockets_UdpEngine__lifeness_multithread_multi_start_stop() {
 
 #pragma mark - attachSocket/detachSocket
 
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users() {
 
     static const int sNumberOfUsers = 4;
@@ -743,7 +914,7 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users()
     }
 
     {
-        TestUdpEngine engine;
+        TestUdpEngine engine(Backend);
 
         UdpResult udpres = engine.startUp();
         CHECK_EQUAL(udpres, eUdpResult_Ok);
@@ -757,6 +928,9 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users()
         udpres = engine.detachSocket(&users[0]);
         CHECK_EQUAL(udpres, eUdpResult_Ok);
 
+        // the detach returns only after the reactor thread closed the socket
+        CHECK_EQUAL(fcntl(users[0].socketsList().front(), F_GETFD), -1);
+
         udpres = engine.detachSocket(&users[0]);
         CHECK_EQUAL(udpres, eUdpResult_Failed);
 
@@ -789,8 +963,111 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_attach_detach_users()
 }
 
 
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_socket_config() {
+
+    TestUdpUser user;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // invalid settings fail the attach
+    priv::UdpSocketConfig invalid[8];
+    invalid[0].mInputQueueSize = 0;
+    invalid[1].mRecieveBatchSize = 0;
+    invalid[2].mRecieveBatchSize = priv::UdpEngine::MaxRecieveBatchSize + 1;
+    invalid[3].mMaxDgramSize = priv::UdpSocketConfig::MaxDgramSize + 1;
+    invalid[4].mSendBufferSize = -1;
+    invalid[5].mOverflowPolicy = priv::UdpOverflowPolicy::DropOldest;
+    invalid[5].mInputQueueConcurrency = priv::UdpQueueConcurrency::Spsc;
+    // a limit, which the recieve buffers wouldn't honour
+    invalid[6].mMaxDgramSize = 512;
+    invalid[7].mMaxDgramSize = 9000;
+
+    for (const priv::UdpSocketConfig& config : invalid) {
+        udpres = engine.attachSocket(&user, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5044), config);
+        CHECK_EQUAL(udpres, eUdpResult_Failed);
+    }
+
+    priv::UdpSocketConfig effective;
+    udpres = engine.socketConfig(&user, &effective);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    // defaults
+    udpres = engine.attachSocket(&user, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5044));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.socketConfig(&user, &effective);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(effective.mInputQueueSize, priv::UdpSocketConfig::DefaultQueueSize);
+    CHECK_EQUAL(effective.mOutputQueueSize, priv::UdpSocketConfig::DefaultQueueSize);
+    CHECK_EQUAL(effective.mRecieveBatchSize, priv::UdpSocketConfig::DefaultRecieveBatchSize);
+    CHECK_EQUAL(effective.mMaxDgramSize, priv::UdpSocketConfig::DefaultMaxDgramSize);
+    CHECK_GREATER(effective.mRecieveBufferSize, 0);
+    CHECK_GREATER(effective.mSendBufferSize, 0);
+    CHECK_EQUAL(effective.mBusyPollUs, 0);
+    CHECK_FALSE(effective.mIsRecieveOffload);
+    CHECK_TRUE(priv::UdpQueueConcurrency::Mpmc == effective.mInputQueueConcurrency);
+    CHECK_TRUE(priv::UdpQueueConcurrency::Mpmc == effective.mOutputQueueConcurrency);
+
+    udpres = engine.detachSocket(&user);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // a custom socket
+    priv::UdpSocketConfig config;
+    config.mInputQueueSize = 1000;
+    config.mOutputQueueSize = 64;
+    config.mRecieveBatchSize = 32;
+    config.mMaxDgramSize = priv::UdpSocketConfig::MaxDgramSize;
+    config.mRecieveBufferSize = 4096;
+    config.mSendBufferSize = 65536;
+    config.mIsSegmentationOffload = false;
+    config.mInputQueueConcurrency = priv::UdpQueueConcurrency::Spsc;
+
+    udpres = engine.attachSocket(&user, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5044), config);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    CHECK_EQUAL(user.input()->capacity(), (size_t)1024);
+    CHECK_EQUAL(user.output()->capacity(), (size_t)64);
+
+    udpres = engine.socketConfig(&user, &effective);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(effective.mInputQueueSize, (size_t)1024);
+    CHECK_EQUAL(effective.mOutputQueueSize, (size_t)64);
+    CHECK_EQUAL(effective.mRecieveBatchSize, (size_t)32);
+    CHECK_EQUAL(effective.mMaxDgramSize, priv::UdpSocketConfig::MaxDgramSize);
+    CHECK_FALSE(effective.mIsSegmentationOffload);
+    CHECK_TRUE(priv::UdpQueueConcurrency::Spsc == effective.mInputQueueConcurrency);
+    CHECK_TRUE(priv::UdpQueueConcurrency::Mpmc == effective.mOutputQueueConcurrency);
+#if defined(__linux__)
+    // linux doubles the requested sizes for its bookkeeping
+    CHECK_EQUAL(effective.mRecieveBufferSize, 2 * 4096);
+    CHECK_EQUAL(effective.mSendBufferSize, 2 * 65536);
+#endif
+
+    // settings changed since the attach are read back as well
+    udpres = engine.setRecieveBatchSize(&user, 8);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.socketConfig(&user, &effective);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(effective.mRecieveBatchSize, (size_t)8);
+
+    udpres = engine.detachSocket(&user);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
 #pragma mark - dgrams sending/recieving
 
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram() {
 
     static const float sTimoutInMs = 500.0f;
@@ -800,7 +1077,7 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram()
     UdpDgram dgram({0, 1, 2, 3, 4, 5, 6, 7});
     UdpDgram received;
     {
-        TestUdpEngine engine;
+        TestUdpEngine engine(Backend);
 
         UdpResult udpres = engine.startUp();
         CHECK_EQUAL(udpres, eUdpResult_Ok);
@@ -849,6 +1126,7 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_dgram()
 }
 
 
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_dgram() {
 
     static const float sTimoutInMs = 500.0f;
@@ -858,7 +1136,7 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_d
     UdpDgram dgram1({0, 1, 2, 3, 4, 5, 6, 7}), dgram2({0, 1, 4, 8, 16, 32, 64, 128});
     UdpDgram received;
     {
-        TestUdpEngine engine;
+        TestUdpEngine engine(Backend);
 
         UdpResult udpres = engine.startUp();
         CHECK_EQUAL(udpres, eUdpResult_Ok);
@@ -930,6 +1208,7 @@ bool test__udp_sockets_UdpEngine__correctness_singlethread_send_recieve_answer_d
 }
 
 
+template < UdpEngineBackend Backend >
 bool test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams() {
 
     // Two users - server and client; multiple threads; on each thread step,
@@ -947,7 +1226,7 @@ bool test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams() {
     context.mServerPtr = &server;
     context.mClientPtr = &client;
     {
-        TestUdpEngine engine;
+        TestUdpEngine engine(Backend);
 
         UdpResult udpres = engine.startUp();
         CHECK_EQUAL(udpres, eUdpResult_Ok);
@@ -1024,3 +1303,1704 @@ bool test__udp_sockets_UdpEngine__lifeness_multithread_send_recieve_dgrams() {
 
     return true;
 }
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgrams_batch() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 32;
+
+    // the whole burst is waiting in the socket buffer before the engine wakes up
+    auto recieveBurst = [&](const priv::UdpSocketConfig& config) -> bool {
+        TestUdpUser server;
+
+        TestUdpEngine engine(Backend);
+
+        UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5054), config);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        int senderId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        CHECK_GREATER(senderId, -1);
+
+        sockaddr_in serverAddress;
+        memset(&serverAddress, 0, sizeof(serverAddress));
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_port = htons(5054);
+        serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        for (uint8_t i = 0; i < sNbDgrams; ++i) {
+            ssize_t szSent = sendto(senderId, &i, 1, 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+            CHECK_EQUAL(szSent, 1);
+        }
+
+        close(senderId);
+
+        udpres = engine.startUp();
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        UdpDgram received;
+        std_clock::time_point startTp = std_clock::now();
+        for (int nbReceived = 0; nbReceived < sNbDgrams;) {
+            if (server.input()->dequeue(received)) {
+                CHECK_EQUAL(received.size(), 1);
+                CHECK_EQUAL((int)received.data()[0], nbReceived);
+
+                ++nbReceived;
+                continue;
+            }
+
+            std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+            CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+            std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+        }
+
+        priv::UdpEngine::Stats stats = engine.stats();
+        CHECK_EQUAL(stats.mNbRecieved, sNbDgrams);
+#if defined(__linux__)
+        // recvmmsg is linux only - elsewhere it is still one dgram per syscall; io_uring
+        // recieves large dgrams one per op
+        if (UdpEngineBackend::IoUring != engine.backend() || config.mMaxDgramSize <= priv::UdpSocketConfig::DefaultMaxDgramSize) {
+            const int batchSize = (int)config.mRecieveBatchSize;
+
+            CHECK_EQUAL(stats.mNbRecieveCalls, sNbDgrams / batchSize);
+            CHECK_EQUAL(stats.recievedPerCall(), (float)batchSize);
+        }
+#endif
+
+        udpres = engine.detachSocket(&server);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        udpres = engine.tearDown();
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        return true;
+    };
+
+    priv::UdpSocketConfig config;
+    config.mRecieveBatchSize = 8;
+
+    CHECK_TRUE(recieveBurst(config));
+
+    // sockets, which recieve into large storages, use the whole batch as well
+    config.mRecieveBatchSize = 16;
+    config.mMaxDgramSize = priv::UdpSocketConfig::MaxDgramSize;
+
+    CHECK_TRUE(recieveBurst(config));
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_dgram_sizes() {
+
+    static const float sTimoutInMs = 500.0f;
+
+    // small dgrams are copied out of the recieve buffers, the rest take the buffers over
+    static const size_t sSizes[] = { 1, 64, 128, 129, 512, 1000, 1024, 3, 700 };
+    static const int sNbDgrams = (int)(sizeof(sSizes) / sizeof(sSizes[0]));
+
+    TestUdpUser server;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5048));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    int senderId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK_GREATER(senderId, -1);
+
+    sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(5048);
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < sNbDgrams; ++i) {
+        std::vector<uint8_t> data(sSizes[i]);
+        for (size_t j = 0; j < data.size(); ++j) {
+            data[j] = (uint8_t)(i * 31 + j);
+        }
+
+        ssize_t szSent = sendto(senderId, data.data(), data.size(), 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+        CHECK_EQUAL(szSent, (ssize_t)data.size());
+    }
+
+    close(senderId);
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::vector<UdpDgram> received;
+    std_clock::time_point startTp = std_clock::now();
+    while (received.size() < (size_t)sNbDgrams) {
+        UdpDgram dgram;
+        if (server.input()->dequeue(dgram)) {
+            received.push_back(std::move(dgram));
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // the dgrams are checked after the engine is down, so none of them shares memory with the next recieves
+    for (int i = 0; i < sNbDgrams; ++i) {
+        CHECK_EQUAL(received[i].size(), sSizes[i]);
+        CHECK_TRUE(received[i].source().valid());
+
+        for (size_t j = 0; j < sSizes[i]; ++j) {
+            CHECK_EQUAL(received[i].data()[j], (uint8_t)(i * 31 + j));
+        }
+    }
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_large_dgrams() {
+
+    static const float sTimoutInMs = 500.0f;
+
+    static const size_t sSizes[] = { 1025, 100, 65507, 1024, 9000, 1, 2048 };
+    static const int sNbDgrams = (int)(sizeof(sSizes) / sizeof(sSizes[0]));
+
+    TestUdpUser server;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5045));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    int senderId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK_GREATER(senderId, -1);
+
+    sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(5045);
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    auto sendDgram = [&](size_t szData, int seed) -> bool {
+        std::vector<uint8_t> data(szData);
+        for (size_t j = 0; j < data.size(); ++j) {
+            data[j] = (uint8_t)(seed * 31 + j);
+        }
+
+        ssize_t szSent = sendto(senderId, data.data(), data.size(), 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+        CHECK_EQUAL(szSent, (ssize_t)data.size());
+
+        return true;
+    };
+
+    // the first large dgram doesn't fit the recieve buffers and is reported and dropped (unless
+    // the socket has UDP GRO storages) - but it is never delivered truncated
+    CHECK_TRUE(sendDgram(3000, 0));
+
+    int nbTruncated = 0;
+    std_clock::time_point startTp = std_clock::now();
+    while (0 == (nbTruncated = engine.stats().mNbTruncatedDgrams)) {
+        UdpDgram dgram;
+        if (server.input()->dequeue(dgram)) {
+            CHECK_EQUAL(dgram.size(), (size_t)3000);
+            break;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // the socket recieves large dgrams since then; io_uring arms its recieve again for
+    // them within a couple of steps
+    engine.stats();
+    engine.stats();
+
+    for (int i = 0; i < sNbDgrams; ++i) {
+        CHECK_TRUE(sendDgram(sSizes[i], i + 1));
+    }
+
+    close(senderId);
+
+    std::vector<UdpDgram> received;
+    startTp = std_clock::now();
+    while (received.size() < (size_t)sNbDgrams) {
+        UdpDgram dgram;
+        if (server.input()->dequeue(dgram)) {
+            received.push_back(std::move(dgram));
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbTruncatedDgrams, nbTruncated);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    for (int i = 0; i < sNbDgrams; ++i) {
+        CHECK_EQUAL(received[i].size(), sSizes[i]);
+
+        for (size_t j = 0; j < sSizes[i]; ++j) {
+            CHECK_EQUAL(std::as_const(received[i]).data()[j], (uint8_t)((i + 1) * 31 + j));
+        }
+    }
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_overflow_policies() {
+
+    static const float sTimoutInMs = 500.0f;
+
+    static const int sNbDgrams = 10;
+    static const size_t sQueueSize = 4;
+
+    // recieves sNbDgrams into the queue of sQueueSize dgrams, nobody dequeues meanwhile
+    auto overflow = [&](const priv::UdpSocketConfig& config, priv::UdpEngine::Stats* pStats, std::vector<int>* pQueued) -> bool {
+        TestUdpUser server;
+
+        TestUdpEngine engine(Backend);
+
+        UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5043), config);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        udpres = engine.startUp();
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        int senderId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        CHECK_GREATER(senderId, -1);
+
+        sockaddr_in serverAddress;
+        memset(&serverAddress, 0, sizeof(serverAddress));
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_port = htons(5043);
+        serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        for (int i = 0; i < sNbDgrams; ++i) {
+            uint8_t data = (uint8_t)i;
+            ssize_t szSent = sendto(senderId, &data, 1, 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+            CHECK_EQUAL(szSent, (ssize_t)1);
+        }
+
+        close(senderId);
+
+        std_clock::time_point startTp = std_clock::now();
+        while (engine.stats().mNbRecieved < sNbDgrams) {
+            std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+            CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        *pStats = engine.stats();
+
+        // spilled dgrams follow the queued ones, as soon as there's room
+        UdpDgram dgram;
+        while (server.input()->dequeue(dgram)) {
+            pQueued->push_back(dgram.data()[0]);
+
+            if (priv::UdpOverflowPolicy::Spill == config.mOverflowPolicy) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        udpres = engine.detachSocket(&server);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        udpres = engine.tearDown();
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        return true;
+    };
+
+    priv::UdpSocketConfig config;
+    config.mInputQueueSize = sQueueSize;
+
+    priv::UdpEngine::Stats stats;
+    std::vector<int> queued;
+
+    // the queue keeps the oldest dgrams
+    CHECK_TRUE(overflow(config, &stats, &queued));
+    CHECK_TRUE(queued == std::vector<int>({ 0, 1, 2, 3 }));
+    CHECK_EQUAL(stats.mNbDroppedNewest, 6);
+    CHECK_EQUAL(stats.mNbInputDropped, 6);
+    CHECK_EQUAL(stats.mNbDroppedOldest + stats.mNbSpilled + stats.mNbSpillDropped, 0);
+
+    // the queue keeps the latest dgrams
+    config.mOverflowPolicy = priv::UdpOverflowPolicy::DropOldest;
+
+    queued.clear();
+    CHECK_TRUE(overflow(config, &stats, &queued));
+    CHECK_TRUE(queued == std::vector<int>({ 6, 7, 8, 9 }));
+    CHECK_EQUAL(stats.mNbDroppedOldest, 6);
+    CHECK_EQUAL(stats.mNbInputDropped, 6);
+    CHECK_EQUAL(stats.mNbDroppedNewest + stats.mNbSpilled + stats.mNbSpillDropped, 0);
+
+    // dgrams spill over in order, until the spill ring is full as well
+    config.mOverflowPolicy = priv::UdpOverflowPolicy::Spill;
+    config.mSpillSize = sQueueSize;
+
+    queued.clear();
+    CHECK_TRUE(overflow(config, &stats, &queued));
+    CHECK_TRUE(queued == std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7 }));
+    CHECK_EQUAL(stats.mNbSpilled, 4);
+    CHECK_EQUAL(stats.mNbSpillDropped, 2);
+    CHECK_EQUAL(stats.mNbInputDropped, 2);
+    CHECK_EQUAL(stats.mNbDroppedNewest + stats.mNbDroppedOldest, 0);
+
+    // spilling needs a spill ring
+    config.mSpillSize = 0;
+
+    TestUdpUser user;
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&user, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5043), config);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_spsc_queues() {
+
+    static const float sTimoutInMs = 1000.0f;
+    static const int sNbDgrams = 64;
+
+    // the engine thread and this thread are the only ends of every queue
+    priv::UdpSocketConfig config;
+    config.mInputQueueConcurrency = priv::UdpQueueConcurrency::Spsc;
+    config.mOutputQueueConcurrency = priv::UdpQueueConcurrency::Spsc;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5071), config);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5071), config);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    CHECK_TRUE(priv::UdpQueueConcurrency::Spsc == server.input()->concurrency());
+    CHECK_TRUE(priv::UdpQueueConcurrency::Spsc == client.output()->concurrency());
+
+    for (int i = 0; i < sNbDgrams; ++i) {
+        CHECK_TRUE(client.output()->enqueue(UdpDgram({(uint8_t)i})));
+    }
+
+    // the server echoes every dgram back, the client gets them in the order they were sent
+    int nbEchoed = 0, nbAnswered = 0;
+    std_clock::time_point startTp = std_clock::now();
+    while (nbAnswered < sNbDgrams) {
+        UdpDgram received;
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.data()[0], (uint8_t)nbEchoed);
+            CHECK_TRUE(server.output()->enqueue(received.clone(received.source())));
+            ++nbEchoed;
+            continue;
+        }
+
+        if (client.input()->dequeue(received)) {
+            CHECK_EQUAL(received.data()[0], (uint8_t)nbAnswered);
+            ++nbAnswered;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // merged queues of several shards have several engine threads on their ends
+    udpres = engine.attachShardedSocket(&server, UdpAddress("127.0.0.1", 5071), 2, priv::UdpShardQueues::Merged, config);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_wait_for_dgrams() {
+
+    static const int sNbDgrams = 200;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5072));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5072));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // the server sleeps in between dgrams, which come with pauses
+    std::thread sender([&client]() {
+        for (int i = 0; i < sNbDgrams; ++i) {
+            while (!client.output()->enqueue(UdpDgram({(uint8_t)i}))) {
+                std::this_thread::yield();
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    int nbReceived = 0, nbTimedOut = 0;
+    while (nbReceived < sNbDgrams && nbTimedOut < 10) {
+        UdpDgram received;
+        if (!server.input()->dequeueWait(received, std::chrono::milliseconds(100))) {
+            ++nbTimedOut;
+            continue;
+        }
+
+        CHECK_EQUAL(received.data()[0], (uint8_t)nbReceived);
+        ++nbReceived;
+    }
+
+    sender.join();
+
+    CHECK_EQUAL(nbReceived, sNbDgrams);
+
+    // nothing else comes, so the wait ends with the timeout
+    UdpDgram tmp;
+    std_clock::time_point startTp = std_clock::now();
+    CHECK_FALSE(server.input()->dequeueWait(tmp, std::chrono::milliseconds(20)));
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_GREATER(elapsed.count(), 19.0f);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_dgrams_batch() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 32;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5055));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5055));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // plain sendmmsg batch - segmentation offload is tested separately
+    engine.setSegmentationOffload(&client, false);
+
+    // the whole burst is waiting in the output queue before the engine wakes up
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        bool queres = client.output()->enqueue(UdpDgram({i}));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    for (int nbReceived = 0; nbReceived < sNbDgrams;) {
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.size(), 1);
+            CHECK_EQUAL((int)received.data()[0], nbReceived);
+
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbSent, sNbDgrams);
+#if defined(__linux__)
+    // sendmmsg is linux only - elsewhere it is still one dgram per syscall
+    CHECK_EQUAL(stats.mNbSendCalls, 1);
+    CHECK_EQUAL(stats.sentPerCall(), (float)sNbDgrams);
+#endif
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_segmented_dgrams() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 32;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5056));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5056));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    if (eUdpResult_Ok != engine.setSegmentationOffload(&client, true)) {
+        LOGW << "UDP GSO is not supported - skipped";
+
+        engine.detachSocket(&client);
+        engine.detachSocket(&server);
+
+        return true;
+    }
+
+    // two runs of different sizes - each run must be coalesced separately
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        bool queres = (i < sNbDgrams / 2)
+            ? client.output()->enqueue(UdpDgram({i, i, i, i, i, i, i, i}))
+            : client.output()->enqueue(UdpDgram({i, i, i, i}));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    for (int nbReceived = 0; nbReceived < sNbDgrams;) {
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.size(), (nbReceived < sNbDgrams / 2) ? 8 : 4);
+            CHECK_EQUAL((int)received.data()[0], nbReceived);
+            CHECK_EQUAL((int)received.data()[received.size() - 1], nbReceived);
+
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbSent, sNbDgrams);
+    CHECK_EQUAL(stats.mNbSegmentedDgrams, sNbDgrams);
+    CHECK_EQUAL(stats.mNbSendCalls, 1);
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_gathered_dgrams() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 32;
+    static const size_t sHeaderSize = 4;
+    static const size_t sBodySize = 16;
+    static const uint8_t sBody[sBodySize] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5046));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5046));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::atomic<int> nbReleased{0};
+
+    UdpDgram trailer = UdpDgram::Allocate(UdpAddress(), 2);
+    trailer.data()[0] = 0xEE;
+    trailer.data()[1] = 0xFF;
+
+    // own header, borrowed body and shared trailer - gathered into one dgram on the wire
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        UdpDgram dgram = UdpDgram::Allocate(UdpAddress(), sHeaderSize);
+        memset(dgram.data(), i, sHeaderSize);
+
+        udpres = dgram.append(sBody, sBodySize, [](void* pContext) {
+            ((std::atomic<int>*)pContext)->fetch_add(1);
+        }, &nbReleased);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        udpres = dgram.append(trailer);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        CHECK_EQUAL(dgram.nbSegments(), (size_t)3);
+
+        bool queres = client.output()->enqueue(std::move(dgram));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    for (int nbReceived = 0; nbReceived < sNbDgrams;) {
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.size(), sHeaderSize + sBodySize + 2);
+            CHECK_EQUAL(received.nbSegments(), (size_t)1);
+
+            const uint8_t* pData = std::as_const(received).data();
+            for (size_t j = 0; j < sHeaderSize; ++j) {
+                CHECK_EQUAL((int)pData[j], nbReceived);
+            }
+            CHECK_EQUAL(memcmp(pData + sHeaderSize, sBody, sBodySize), 0);
+            CHECK_EQUAL(pData[sHeaderSize + sBodySize], (uint8_t)0xEE);
+            CHECK_EQUAL(pData[sHeaderSize + sBodySize + 1], (uint8_t)0xFF);
+
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // every borrowed body is given back once its dgram is sent
+    CHECK_EQUAL(nbReleased.load(), sNbDgrams);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_send_oversized_dgram() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbValidDgrams = 2;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5077));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5077));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // EMSGSIZE never clears, so the dgram is dropped instead of holding back the ones after it
+    UdpDgram oversized = UdpDgram::Allocate(UdpAddress(), priv::UdpSocketConfig::MaxDgramSize + 1);
+    CHECK_TRUE(oversized.valid());
+
+    bool queres = client.output()->enqueue(std::move(oversized));
+    CHECK_TRUE(queres);
+
+    for (uint8_t i = 0; i < sNbValidDgrams; ++i) {
+        queres = client.output()->enqueue(UdpDgram({i}));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    for (int nbReceived = 0; nbReceived < sNbValidDgrams;) {
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.size(), 1);
+            CHECK_EQUAL((int)received.data()[0], nbReceived);
+
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    // the failed dgram isn't retried meanwhile
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbSendFails, 1);
+    CHECK_EQUAL(stats.mNbSent, sNbValidDgrams);
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_recieve_coalesced_dgrams() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 32;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    priv::UdpSocketConfig config;
+    config.mIsRecieveOffload = true;
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5057), config);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5057));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // loopback delivers GSO sends to GRO sockets without segmenting them
+    if (eUdpResult_Ok != engine.setSegmentationOffload(&client, true)) {
+        LOGW << "UDP GSO is not supported - skipped";
+
+        engine.detachSocket(&client);
+        engine.detachSocket(&server);
+
+        return true;
+    }
+
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        bool queres = client.output()->enqueue(UdpDgram({i, i, i, i, i, i, i, i}));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::list<UdpDgram> received;
+    std_clock::time_point startTp = std_clock::now();
+    while (received.size() < sNbDgrams) {
+        UdpDgram dgram;
+        if (server.input()->dequeue(dgram)) {
+            // const access: mutable access of a shared payload would copy it
+            const UdpDgram& readOnly = dgram;
+
+            CHECK_EQUAL(readOnly.size(), 8);
+            CHECK_EQUAL((int)readOnly.data()[0], (int)received.size());
+            CHECK_EQUAL((int)readOnly.data()[7], (int)received.size());
+
+            received.push_back(std::move(dgram));
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbRecieved, sNbDgrams);
+    if (0 == stats.mNbCoalescedDgrams) {
+        LOGW << "UDP GRO is not supported - dgrams were recieved one by one";
+    } else {
+        CHECK_EQUAL(stats.mNbCoalescedDgrams, sNbDgrams);
+        CHECK_EQUAL(stats.mNbRecieveCalls, 1);
+
+        // segments of one coalesced buffer share the storage
+        CHECK_TRUE(std::as_const(received.front()).data() + 8 == std::as_const(*(++received.begin())).data());
+    }
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - sharded sockets
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_sharded_server_merged_queues() {
+
+    static const float sTimoutInMs = 1000.0f;
+    static const size_t sNbShards = 2;
+    static const size_t sNbClients = 16;
+
+    TestUdpUser server;
+    std::vector<TestUdpUser> clients(sNbClients);
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachShardedSocket(&server, UdpAddress("127.0.0.1", 5058), sNbShards, priv::UdpShardQueues::Merged);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(engine.nbThreads(), sNbShards);
+
+    // the shards are spread by the peer address, so many clients cover all of them
+    for (size_t i = 0; i < sNbClients; ++i) {
+        udpres = engine.attachSocket(&clients[i], priv::UdpRole::Client, UdpAddress("127.0.0.1", 5058));
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        bool queres = clients[i].output()->enqueue(UdpDgram({(uint8_t)i}));
+        CHECK_TRUE(queres);
+    }
+
+    // answers go out through the first shard, which owns the merged output queue
+    size_t nbReceived = 0;
+    std_clock::time_point startTp = std_clock::now();
+    while (nbReceived < sNbClients) {
+        UdpDgram received;
+        if (server.input()->dequeue(received)) {
+            CHECK_TRUE(server.output()->enqueue(received.clone(received.source())));
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    for (size_t i = 0; i < sNbClients; ++i) {
+        UdpDgram answer;
+        while (!clients[i].input()->dequeue(answer)) {
+            std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+            CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+            std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+        }
+
+        CHECK_EQUAL(answer.size(), 1);
+        CHECK_EQUAL((size_t)answer.data()[0], i);
+    }
+
+    // sends are counted, when they complete; stats() waits for the threads to publish them
+    while ((size_t)engine.stats().mNbSent < 2 * sNbClients) {
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // the other thread sent only the dgrams of its clients
+    std::vector<priv::UdpEngine::ThreadLoad> loads = engine.threadsLoad();
+    CHECK_EQUAL((size_t)loads[1].mStats.mNbSent, loads[1].mNbSockets - 1);
+
+    for (size_t i = 0; i < sNbClients; ++i) {
+        udpres = engine.detachSocket(&clients[i]);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_sharded_server_per_shard_queues() {
+
+    static const float sTimoutInMs = 1000.0f;
+    static const size_t sNbShards = 2;
+    static const size_t sNbClients = 16;
+
+    TestShardedUdpUser server;
+    std::vector<TestUdpUser> clients(sNbClients);
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachShardedSocket(&server, UdpAddress("127.0.0.1", 5059), sNbShards, priv::UdpShardQueues::PerShard);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(server.nbShards(), sNbShards);
+    CHECK_TRUE(server.input(0) != server.input(1));
+
+    for (size_t i = 0; i < sNbClients; ++i) {
+        udpres = engine.attachSocket(&clients[i], priv::UdpRole::Client, UdpAddress("127.0.0.1", 5059));
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        bool queres = clients[i].output()->enqueue(UdpDgram({(uint8_t)i}));
+        CHECK_TRUE(queres);
+    }
+
+    std::vector<size_t> nbReceivedPerShard(sNbShards, 0);
+    size_t nbReceived = 0;
+
+    std_clock::time_point startTp = std_clock::now();
+    while (nbReceived < sNbClients) {
+        bool hasReceived = false;
+        for (size_t shard = 0; shard < sNbShards; ++shard) {
+            UdpDgram received;
+            if (server.input(shard)->dequeue(received)) {
+                ++nbReceivedPerShard[shard];
+                ++nbReceived;
+                hasReceived = true;
+            }
+        }
+
+        if (hasReceived)
+            continue;
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    LOGI << "Dgrams per shard: " << nbReceivedPerShard[0] << ", " << nbReceivedPerShard[1];
+
+    for (size_t i = 0; i < sNbClients; ++i) {
+        udpres = engine.detachSocket(&clients[i]);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - engine threads
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_move_socket() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sNbDgrams = 8;
+
+    TestUdpUser server;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.setNbThreads(2);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(engine.nbThreads(), 2);
+
+    udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5060));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(engine.threadsLoad()[0].mNbSockets, 1);
+
+    int peerId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK_GREATER(peerId, -1);
+
+    timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = (int)sTimoutInMs * 1000;
+    setsockopt(peerId, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(5060);
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // dgrams are waiting in the socket (or in the completions of the first thread) and in the
+    // output queue while the socket is handed over
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        ssize_t szSent = sendto(peerId, &i, 1, 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+        CHECK_EQUAL(szSent, 1);
+    }
+
+    sockaddr_in peerAddress;
+    socklen_t szPeerAddress = sizeof(peerAddress);
+    CHECK_EQUAL(getsockname(peerId, (sockaddr*)&peerAddress, &szPeerAddress), 0);
+
+    for (uint8_t i = 0; i < sNbDgrams; ++i) {
+        bool queres = server.output()->enqueue(UdpDgram({i}).clone(UdpAddress("127.0.0.1", ntohs(peerAddress.sin_port))));
+        CHECK_TRUE(queres);
+    }
+
+    udpres = engine.moveSocket(&server, 1);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.moveSocket(&server, 1);
+    CHECK_EQUAL(udpres, eUdpResult_Already);
+
+    udpres = engine.moveSocket(&server, 2);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    std::vector<priv::UdpEngine::ThreadLoad> loads = engine.threadsLoad();
+    CHECK_EQUAL(loads.size(), 2);
+    CHECK_EQUAL(loads[0].mNbSockets, 0);
+    CHECK_EQUAL(loads[1].mNbSockets, 1);
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    for (int nbReceived = 0; nbReceived < sNbDgrams;) {
+        if (server.input()->dequeue(received)) {
+            CHECK_EQUAL(received.size(), 1);
+            CHECK_EQUAL((int)received.data()[0], nbReceived);
+
+            ++nbReceived;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    for (int i = 0; i < sNbDgrams; ++i) {
+        uint8_t answer = 0xFF;
+        ssize_t szReceived = recv(peerId, &answer, 1, 0);
+        CHECK_EQUAL(szReceived, 1);
+        CHECK_EQUAL((int)answer, i);
+    }
+
+    close(peerId);
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbRecieved, sNbDgrams);
+    CHECK_EQUAL(stats.mNbSent, sNbDgrams);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_sockets() {
+
+    static const size_t sNbClients = 4;
+
+    std::vector<TestUdpUser> clients(sNbClients);
+
+    TestUdpEngine engine(Backend);
+
+    // every socket goes to the only thread
+    for (size_t i = 0; i < sNbClients - 1; ++i) {
+        UdpResult udpres = engine.attachSocket(&clients[i], priv::UdpRole::Client, UdpAddress("127.0.0.1", 5069));
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    CHECK_EQUAL(engine.threadsLoad()[0].mNbSockets, sNbClients - 1);
+
+    UdpResult udpres = engine.setNbThreads(0);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    udpres = engine.setNbThreads(2);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.rebalanceSocket(&clients[0]);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::vector<priv::UdpEngine::ThreadLoad> loads = engine.threadsLoad();
+    CHECK_EQUAL(loads[0].mNbSockets, 2);
+    CHECK_EQUAL(loads[1].mNbSockets, 1);
+
+    // moving one more socket would just swap the imbalance
+    udpres = engine.rebalanceSocket(&clients[1]);
+    CHECK_EQUAL(udpres, eUdpResult_Already);
+
+    udpres = engine.rebalanceSocket(&clients[0]);
+    CHECK_EQUAL(udpres, eUdpResult_Already);
+
+    // new sockets go to the thread with the fewest sockets
+    udpres = engine.attachSocket(&clients[sNbClients - 1], priv::UdpRole::Client, UdpAddress("127.0.0.1", 5069));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    loads = engine.threadsLoad();
+    CHECK_EQUAL(loads[0].mNbSockets, 2);
+    CHECK_EQUAL(loads[1].mNbSockets, 2);
+
+    for (auto& client : clients) {
+        udpres = engine.detachSocket(&client);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    loads = engine.threadsLoad();
+    CHECK_EQUAL(loads[0].mNbSockets, 0);
+    CHECK_EQUAL(loads[1].mNbSockets, 0);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_rebalance_spsc_socket() {
+
+    static const int sTimoutInMs = 500;
+
+    TestUdpUser servers[2];
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    priv::UdpSocketConfig config;
+    config.mInputQueueConcurrency = priv::UdpQueueConcurrency::Spsc;
+
+    udpres = engine.attachSocket(&servers[0], priv::UdpRole::Server, UdpAddress("127.0.0.1", 5075));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&servers[1], priv::UdpRole::Server, UdpAddress("127.0.0.1", 5076), config);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.setNbThreads(2);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // the io_uring thread refuses to hand the socket over, but keeps serving it
+    const bool isMovable = UdpEngineBackend::IoUring != engine.backend();
+
+    udpres = engine.rebalanceSocket(&servers[1]);
+    CHECK_EQUAL(udpres, isMovable ? eUdpResult_Ok : eUdpResult_Failed);
+
+    std::vector<priv::UdpEngine::ThreadLoad> loads = engine.threadsLoad();
+    CHECK_EQUAL(loads[0].mNbSockets, isMovable ? 1 : 2);
+    CHECK_EQUAL(loads[1].mNbSockets, isMovable ? 1 : 0);
+    CHECK_EQUAL(servers[1].socketsList().size(), 1);
+
+    int peerId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK_GREATER(peerId, -1);
+
+    sockaddr_in serverAddress;
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(5076);
+    serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    uint8_t payload = 0x42;
+    ssize_t szSent = sendto(peerId, &payload, 1, 0, (sockaddr*)&serverAddress, sizeof(serverAddress));
+    CHECK_EQUAL(szSent, 1);
+
+    close(peerId);
+
+    UdpDgram received;
+    CHECK_TRUE(servers[1].input()->dequeueWait(received, std::chrono::milliseconds(sTimoutInMs)));
+    CHECK_EQUAL(received.size(), 1);
+    CHECK_EQUAL((int)received.data()[0], (int)payload);
+
+    for (auto& server : servers) {
+        udpres = engine.detachSocket(&server);
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+        CHECK_EQUAL(server.socketsList().back(), -1);
+    }
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - wakeups
+
+static float ProcessCpuTimeInMs() {
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0f
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0f;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_idle_wakeups() {
+
+    static const float sIdleInMs = 300.0f;
+    static const float sWakeupTimeoutInMs = 100.0f; // way below the engine wait timeout
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // a waiting engine lets attach in right away
+    std_clock::time_point startTp = std_clock::now();
+
+    udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5050));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5050));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_LESS(elapsed.count(), sWakeupTimeoutInMs);
+
+    // writable sockets with empty output queues don't keep the engine thread spinning
+    float cpuStartInMs = ProcessCpuTimeInMs();
+    std::this_thread::sleep_for(std::chrono::milliseconds((int)sIdleInMs));
+    CHECK_LESS(ProcessCpuTimeInMs() - cpuStartInMs, sIdleInMs * 0.1f);
+
+    // an enqueue into the armed output queue wakes the engine up
+    startTp = std_clock::now();
+
+    bool queres = client.output()->enqueue(UdpDgram({1, 2, 3}));
+    CHECK_TRUE(queres);
+
+    UdpDgram received;
+    while (!server.input()->dequeue(received)) {
+        elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sWakeupTimeoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    CHECK_EQUAL(received.size(), 3);
+
+    // neither do sockets, which have just sent everything they had
+    cpuStartInMs = ProcessCpuTimeInMs();
+    std::this_thread::sleep_for(std::chrono::milliseconds((int)sIdleInMs));
+    CHECK_LESS(ProcessCpuTimeInMs() - cpuStartInMs, sIdleInMs * 0.1f);
+
+    // and a waiting engine lets detach through right away as well
+    startTp = std_clock::now();
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_LESS(elapsed.count(), sWakeupTimeoutInMs);
+
+    startTp = std_clock::now();
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_LESS(elapsed.count(), sWakeupTimeoutInMs);
+
+    return true;
+}
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_attach_latency_under_load() {
+
+    static const int sNbAttaches = 64;
+    static const float sAttachLatencyInMs = 50.0f; // way below the engine wait timeout: attach doesn't wait for a step
+    static const float sTimoutInMs = 500.0f;
+
+    TestUdpUser server, client;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5052));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5052));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    // keeps the engine thread sending and recieving all the time
+    std::atomic<bool> isPumping{true};
+    std::atomic<int>  nbPumped{0};
+
+    std::thread pump([&server, &client, &isPumping, &nbPumped]() {
+        UdpDgram received;
+        while (isPumping.load(std::memory_order_acquire)) {
+            for (int i = 0; i < 16; ++i) {
+                client.output()->enqueue(UdpDgram({1, 2, 3, 4}));
+            }
+
+            while (server.input()->dequeue(received)) {
+                nbPumped.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            std::this_thread::yield();
+        }
+    });
+
+    std_clock::time_point startTp = std_clock::now();
+    while (nbPumped.load(std::memory_order_relaxed) == 0) {
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::yield();
+    }
+
+    float maxAttachInMs = 0.0f;
+
+    std::vector<std::unique_ptr<TestUdpUser>> users;
+    for (int i = 0; i < sNbAttaches; ++i) {
+        users.push_back(std::make_unique<TestUdpUser>());
+
+        startTp = std_clock::now();
+
+        udpres = engine.attachSocket(users.back().get(), priv::UdpRole::Client, UdpAddress("127.0.0.1", 5052));
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        maxAttachInMs = std::max(maxAttachInMs, elapsed.count());
+    }
+
+    const int nbPumpedBeforeDetach = nbPumped.load(std::memory_order_relaxed);
+
+    // sockets attached to the busy engine are served as well
+    for (auto& pUser : users) {
+        bool queres = pUser->output()->enqueue(UdpDgram({5, 6, 7, 8, 9}));
+        CHECK_TRUE(queres);
+    }
+
+    for (auto& pUser : users) {
+        udpres = engine.detachSocket(pUser.get());
+        CHECK_EQUAL(udpres, eUdpResult_Ok);
+    }
+
+    isPumping.store(false, std::memory_order_release);
+    pump.join();
+
+    LOGI << "max attach latency " << maxAttachInMs << " ms, pumped " << nbPumped.load() << " dgrams";
+
+    CHECK_LESS(maxAttachInMs, sAttachLatencyInMs);
+
+    // the data path kept going while the users table was changing
+    CHECK_GREATER(nbPumped.load(std::memory_order_relaxed), nbPumpedBeforeDetach);
+
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_GREATER(stats.mNbSent, nbPumped.load(std::memory_order_relaxed) - 1);
+
+    udpres = engine.detachSocket(&client);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - drain quantum
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_drain_quantum() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const int sQuantum = 8;
+    static const int sNbHotDgrams = 128;
+    static const int sNbColdDgrams = 4;
+
+    TestUdpUser hot, cold;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.setDrainQuantum(0);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+
+    udpres = engine.setDrainQuantum(sQuantum);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&hot, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5053));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&cold, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5049));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    int peerId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK_GREATER(peerId, -1);
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // both sockets are readable, when the engine starts; the hot one has way more than a quantum
+    address.sin_port = htons(5053);
+    for (int i = 0; i < sNbHotDgrams; ++i) {
+        uint8_t payload = (uint8_t)i;
+        ssize_t szSent = sendto(peerId, &payload, 1, 0, (sockaddr*)&address, sizeof(address));
+        CHECK_EQUAL(szSent, 1);
+    }
+
+    address.sin_port = htons(5049);
+    for (int i = 0; i < sNbColdDgrams; ++i) {
+        uint8_t payload = (uint8_t)i;
+        ssize_t szSent = sendto(peerId, &payload, 1, 0, (sockaddr*)&address, sizeof(address));
+        CHECK_EQUAL(szSent, 1);
+    }
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    int nbHot = 0, nbCold = 0;
+
+    UdpDgram received;
+    std_clock::time_point startTp = std_clock::now();
+    while (nbHot < sNbHotDgrams || nbCold < sNbColdDgrams) {
+        if (hot.input()->dequeue(received)) {
+            CHECK_EQUAL((int)received.data()[0], nbHot);
+            ++nbHot;
+            continue;
+        }
+
+        if (cold.input()->dequeue(received)) {
+            CHECK_EQUAL((int)received.data()[0], nbCold);
+            ++nbCold;
+            continue;
+        }
+
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+    }
+
+    close(peerId);
+
+    // the hot socket was served a quantum per step, so the cold one didn't wait for it to drain
+    priv::UdpEngine::Stats stats = engine.stats();
+    CHECK_EQUAL(stats.mNbRecieved, sNbHotDgrams + sNbColdDgrams);
+    CHECK_LESS(stats.mMaxDrainedDgrams, sQuantum + 1);
+    CHECK_GREATER(stats.mNbSpentQuantums, sNbHotDgrams / sQuantum - 2);
+    CHECK_GREATER(stats.mNbDrains, sNbHotDgrams / sQuantum);
+    CHECK_LESS(stats.movedPerDrain(), sQuantum + 0.1f);
+
+    udpres = engine.detachSocket(&hot);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&cold);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - peers
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpEngine__correctness_singlethread_peers() {
+
+    static const float sTimoutInMs = 500.0f;
+    static const auto sTtl = std::chrono::milliseconds(100);
+
+    TestUdpUser server, client1, client2;
+
+    TestUdpEngine engine(Backend);
+
+    UdpResult udpres = engine.attachSocket(&server, priv::UdpRole::Server, UdpAddress("127.0.0.1", 5047));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client1, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5047));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.attachSocket(&client2, priv::UdpRole::Client, UdpAddress("127.0.0.1", 5047));
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.setPeerTimeToLive(&server, sTtl);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.startUp();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    auto waitDgram = [](TestUdpUser& user, UdpDgram& dgram) {
+        std_clock::time_point startTp = std_clock::now();
+        while (!user.input()->dequeue(dgram)) {
+            std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+            if (elapsed.count() >= sTimoutInMs)
+                return false;
+
+            std::this_thread::sleep_for(std::chrono::nanoseconds(50));
+        }
+
+        return true;
+    };
+
+    UdpDgram dgram({0, 1, 2, 3, 4, 5, 6, 7});
+    UdpDgram received;
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK_TRUE(client1.output()->enqueue(dgram.clone()));
+    }
+    CHECK_TRUE(client2.output()->enqueue(dgram.clone()));
+
+    // every dgram of a peer is tagged with the same id, distinct from the ids of other peers
+    UdpPeerId peer1 = 0, peer2 = 0;
+    for (int i = 0; i < 4; ++i) {
+        CHECK_TRUE(waitDgram(server, received));
+        CHECK_GREATER(received.peer(), 0u);
+
+        UdpPeerId& peer = (0 == peer1 || received.peer() == peer1) ? peer1 : peer2;
+        if (0 == peer)
+            peer = received.peer();
+
+        CHECK_EQUAL(received.peer(), peer);
+    }
+    CHECK_GREATER(peer2, 0u);
+    CHECK_TRUE(peer1 != peer2);
+
+    std::vector<priv::UdpPeerInfo> peers = engine.peers(&server);
+    CHECK_EQUAL(peers.size(), (size_t)2);
+
+    priv::UdpPeerInfo info;
+    udpres = engine.findPeer(&server, peer1, &info);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+    CHECK_EQUAL(info.mId, peer1);
+
+    // the order of the two peers is up to the engine thread
+    if (3 != info.mNbRecieved) {
+        std::swap(peer1, peer2);
+        CHECK_EQUAL(engine.findPeer(&server, peer1, &info), eUdpResult_Ok);
+    }
+    CHECK_EQUAL(info.mNbRecieved, (uint64_t)3);
+    CHECK_EQUAL(info.mNbRecievedBytes, (uint64_t)(3 * dgram.size()));
+
+    // a reply carries the peer id only - the engine resolves the address
+    UdpDgram reply = dgram.clone(peer1);
+    CHECK_FALSE(reply.source().valid());
+    CHECK_TRUE(server.output()->enqueue(std::move(reply)));
+
+    CHECK_TRUE(waitDgram(client1, received));
+    CHECK_EQUAL(received.size(), dgram.size());
+    CHECK_FALSE(client2.input()->dequeue(received));
+
+    // idle peers expire, and replies to their ids are dropped
+    std::this_thread::sleep_for(sTtl * 2);
+
+    udpres = engine.findPeer(&server, peer1, &info);
+    CHECK_EQUAL(udpres, eUdpResult_Failed);
+    CHECK_EQUAL(engine.peers(&server).size(), (size_t)0);
+
+    CHECK_TRUE(server.output()->enqueue(dgram.clone(peer2)));
+
+    std_clock::time_point startTp = std_clock::now();
+    while (engine.stats().mNbUnresolvedDgrams < 1) {
+        std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+        CHECK_LESS(elapsed.count(), sTimoutInMs);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK_FALSE(client2.input()->dequeue(received));
+
+    // a peer, which comes back, gets a new id
+    CHECK_TRUE(client1.output()->enqueue(dgram.clone()));
+    CHECK_TRUE(waitDgram(server, received));
+    CHECK_GREATER(received.peer(), 0u);
+    CHECK_TRUE(received.peer() != peer1);
+
+    udpres = engine.detachSocket(&client1);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&client2);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.detachSocket(&server);
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    udpres = engine.tearDown();
+    CHECK_EQUAL(udpres, eUdpResult_Ok);
+
+    return true;
+}
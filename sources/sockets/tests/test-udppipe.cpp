@@ -0,0 +1,207 @@
+#include <chrono>
+#include <thread>
+
+#include "commons/logger.hpp"
+#include "commons/macros.h"
+
+#include "sockets/udpengine.hpp"
+#include "sockets/udppipe.hpp"
+
+#include "testapi.hpp"
+
+
+#pragma mark - Tests Declarations
+
+using udp::sockets::priv::UdpEngineBackend;
+
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpPipe__correctness_open_close();
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpPipe__correctness_write_read();
+bool test__udp_sockets_UdpPipe__correctness_write_waits_for_room();
+
+
+START_TEST_SUIT_DECLARATION(UdpPipe)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_open_close<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_write_read<UdpEngineBackend::Select>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_write_waits_for_room, 1)
+
+#if defined(__linux__)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_open_close<UdpEngineBackend::Epoll>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_write_read<UdpEngineBackend::Epoll>, 1)
+
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_open_close<UdpEngineBackend::IoUring>, 1)
+    DECLARE_TEST_ITERATED(test__udp_sockets_UdpPipe__correctness_write_read<UdpEngineBackend::IoUring>, 1)
+#endif
+FINISH_TEST_SUIT_DECLARATION(UdpPipe)
+
+
+#pragma mark - Tests Utils
+
+using namespace udp::sockets;
+
+
+using std_clock = std::chrono::steady_clock;
+
+
+namespace {
+
+
+class TestUdpEngine : public priv::UdpEngine {
+public:
+    explicit TestUdpEngine(UdpEngineBackend backend) noexcept : UdpEngine(backend) {
+
+        if (this->backend() != backend) {
+            LOGW << "Requested engine backend is not supported - testing the fallback one";
+        }
+    }
+};
+
+
+}
+
+
+#pragma mark - open/close
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpPipe__correctness_open_close() {
+
+    TestUdpEngine engine(Backend);
+
+    UdpPipe reader(&engine), writer(&engine);
+    CHECK_FALSE(reader.opened());
+
+    UdpDgram dgram;
+    CHECK_EQUAL(reader.readDatagram(dgram, 0), eUdpResult_Failed);
+    CHECK_EQUAL(reader.close(), eUdpResult_Already);
+
+    // the pipe starts the engine up
+    CHECK_EQUAL(reader.open(UdpPipe::PipeEndType::Read, "127.0.0.1", 5073), eUdpResult_Ok);
+    CHECK_TRUE(reader.opened());
+    CHECK_EQUAL(reader.open(UdpPipe::PipeEndType::Read, "127.0.0.1", 5073), eUdpResult_Already);
+
+    CHECK_EQUAL(writer.open(UdpPipe::PipeEndType::Write, "127.0.0.1", 5073), eUdpResult_Ok);
+
+    // every end goes one way only
+    CHECK_EQUAL(reader.writeDatagram(UdpDgram({1}), 0), eUdpResult_Failed);
+    CHECK_EQUAL(writer.readDatagram(dgram, 0), eUdpResult_Failed);
+
+    // nothing written - the read times out
+    std_clock::time_point startTp = std_clock::now();
+    CHECK_EQUAL(reader.readDatagram(dgram, 20), eUdpResult_Timeout);
+
+    std::chrono::duration<float> elapsed = (std_clock::now() - startTp) * 1000.0f;
+    CHECK_GREATER(elapsed.count(), 19.0f);
+
+    CHECK_EQUAL(writer.close(), eUdpResult_Ok);
+    CHECK_EQUAL(reader.close(), eUdpResult_Ok);
+    CHECK_FALSE(reader.opened());
+
+    // the address is free again
+    CHECK_EQUAL(reader.open(UdpPipe::PipeEndType::Read, "127.0.0.1", 5073), eUdpResult_Ok);
+    CHECK_EQUAL(reader.close(), eUdpResult_Ok);
+
+    CHECK_EQUAL(engine.tearDown(), eUdpResult_Ok);
+
+    return true;
+}
+
+
+#pragma mark - reading/writing
+
+template < UdpEngineBackend Backend >
+bool test__udp_sockets_UdpPipe__correctness_write_read() {
+
+    static const int sNbDgrams = 200;
+
+    TestUdpEngine engine(Backend);
+
+    UdpPipe reader(&engine), writer(&engine);
+    CHECK_EQUAL(reader.open(UdpPipe::PipeEndType::Read, "127.0.0.1", 5074), eUdpResult_Ok);
+    CHECK_EQUAL(writer.open(UdpPipe::PipeEndType::Write, "127.0.0.1", 5074), eUdpResult_Ok);
+
+    // the reader sleeps in between dgrams, which come with pauses
+    std::thread writing([&writer]() {
+        for (int i = 0; i < sNbDgrams; ++i) {
+            writer.writeDatagram(UdpDgram({(uint8_t)i, (uint8_t)(i >> 8)}), -1);
+
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    int nbRead = 0, nbDisordered = 0, nbTimedOut = 0;
+    while (nbRead < sNbDgrams && nbTimedOut < 10) {
+        UdpDgram dgram;
+        UdpResult res = reader.readDatagram(dgram, 100);
+        if (eUdpResult_Timeout == res) {
+            ++nbTimedOut;
+            continue;
+        }
+
+        CHECK_EQUAL(res, eUdpResult_Ok);
+        CHECK_EQUAL(dgram.size(), (size_t)2);
+
+        if ((dgram.data()[0] | (dgram.data()[1] << 8)) != nbRead)
+            ++nbDisordered;
+
+        ++nbRead;
+    }
+
+    writing.join();
+
+    CHECK_EQUAL(nbRead, sNbDgrams);
+    CHECK_EQUAL(nbDisordered, 0);
+
+    // a reader without a timeout waits for the next write
+    std::thread lateWriting([&writer]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        writer.writeDatagram(UdpDgram({42}), 0);
+    });
+
+    UdpDgram late;
+    CHECK_EQUAL(reader.readDatagram(late, -1), eUdpResult_Ok);
+    CHECK_EQUAL(late.data()[0], (uint8_t)42);
+
+    lateWriting.join();
+
+    CHECK_EQUAL(writer.close(), eUdpResult_Ok);
+    CHECK_EQUAL(reader.close(), eUdpResult_Ok);
+
+    CHECK_EQUAL(engine.tearDown(), eUdpResult_Ok);
+
+    return true;
+}
+
+
+bool test__udp_sockets_UdpPipe__correctness_write_waits_for_room() {
+
+    priv::UdpDgramQueue queue(2, priv::UdpQueueConcurrency::Spsc);
+
+    CHECK_TRUE(queue.enqueue(UdpDgram({0})));
+    CHECK_TRUE(queue.enqueue(UdpDgram({1})));
+
+    // the full queue keeps the dgram with the writer, if there is no room in time
+    UdpDgram dgram({2});
+    CHECK_FALSE(queue.enqueueWait(std::move(dgram), std::chrono::milliseconds(10)));
+    CHECK_TRUE(dgram.valid());
+
+    std::thread consumer([&queue]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        UdpDgram taken;
+        queue.dequeue(taken);
+    });
+
+    CHECK_TRUE(queue.enqueueWait(std::move(dgram), std::chrono::seconds(1)));
+
+    consumer.join();
+
+    UdpDgram taken;
+    CHECK_TRUE(queue.dequeue(taken));
+    CHECK_EQUAL(taken.data()[0], (uint8_t)1);
+    CHECK_TRUE(queue.dequeue(taken));
+    CHECK_EQUAL(taken.data()[0], (uint8_t)2);
+
+    return true;
+}
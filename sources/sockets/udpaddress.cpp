@@ -1,9 +1,11 @@
 #include "sockets/udpaddress.hpp"
 
+#include <cstring>
+
 #include <netdb.h>
 #include <unistd.h>
 
-#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "commons/logger.hpp"
 
@@ -14,81 +16,18 @@
 using namespace udp::sockets;
 
 
-enum class NativeDataType {
-    Addrinfo, Sockaddr
-};
-
-struct UdpAddress::NativeData {
-    NativeDataType type;
-    void*          dataptr{nullptr};
-    size_t         size{0};
-
-    ~NativeData() noexcept {
-
-        if (!dataptr)
-            return;
-
-        if (NativeDataType::Addrinfo == type) {
-            freeaddrinfo((addrinfo*)dataptr);
-        } else {
-            delete (sockaddr*)dataptr;
-        }
-    }
-};
-
-
 /*static*/
-UdpAddress UdpAddress::FromNativeData(void* pOpaqueNativeData, size_t szData) noexcept {
-
-    sockaddr* pSockAddr = (sockaddr*)pOpaqueNativeData;
+UdpAddress UdpAddress::FromNativeData(const void* pOpaqueNativeData, size_t szData) noexcept {
 
     UdpAddress result;
-    result._pData = std::make_shared<NativeData>();
-    result._pData->type = NativeDataType::Sockaddr;
-    result._pData->dataptr = pSockAddr;
-    result._pData->size = szData;
-
-    return result;
-}
-
-
-UdpAddress::UdpAddress() noexcept {}
-
-
-UdpAddress::UdpAddress(const char* address, int port) noexcept
-    : _pData(nullptr)
-{
-    _pData.reset(CreateNativeData(address, port));
-}
-
-
-UdpAddress::~UdpAddress() noexcept {}
-
-
-bool UdpAddress::valid() const noexcept {
-
-    return !!_pData;
-}
-
-
-void* UdpAddress::nativeData() const noexcept {
-
-    if (!_pData.get())
-        return nullptr;
-
-    if (_pData->type == NativeDataType::Addrinfo)
-        return ((addrinfo*)_pData->dataptr)->ai_addr;
-
-    return _pData->dataptr;
-}
 
+    if (!pOpaqueNativeData || 0 == szData || szData > sizeof(sockaddr_storage))
+        return result;
 
-size_t UdpAddress::nativeDataSize() const noexcept {
+    memcpy(&result._data, pOpaqueNativeData, szData);
+    result._szData = (socklen_t)szData;
 
-    if (!_pData.get())
-        return 0;
-    
-    return _pData->size;
+    return result;
 }
 
 
@@ -114,9 +53,9 @@ static const char* ConvertGetAddrInfoErrorToString(int result) {
 }
 
 
-/*static*/
-auto UdpAddress::CreateNativeData(const char* address, int port) noexcept -> NativeData* {
-
+UdpAddress::UdpAddress(const char* address, int port) noexcept
+    : UdpAddress()
+{
     char portstr[17];
     snprintf(portstr, sizeof(portstr) - 1, "%d", port);
     portstr[16] = '\0';
@@ -131,14 +70,66 @@ auto UdpAddress::CreateNativeData(const char* address, int port) noexcept -> Nat
     int result = getaddrinfo(address, portstr, &infoHints, &pAddrInfo);
     if (0 != result || !pAddrInfo) {
         LOGE << "ERROR: Failed to get address info (" << address << ":" << port << "; result = " << ConvertGetAddrInfoErrorToString(result) << ")";
+        return;
+    }
+
+    *this = FromNativeData(pAddrInfo->ai_addr, pAddrInfo->ai_addrlen);
+
+    freeaddrinfo(pAddrInfo);
+}
+
+
+bool UdpAddress::operator == (const UdpAddress& another) const noexcept {
+
+    if (_szData != another._szData || _data.ss_family != another._data.ss_family)
+        return false;
+
+    if (AF_INET == _data.ss_family) {
+        const sockaddr_in& a = (const sockaddr_in&)_data;
+        const sockaddr_in& b = (const sockaddr_in&)another._data;
 
-        return nullptr;
+        return a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+    }
+
+    if (AF_INET6 == _data.ss_family) {
+        const sockaddr_in6& a = (const sockaddr_in6&)_data;
+        const sockaddr_in6& b = (const sockaddr_in6&)another._data;
+
+        return a.sin6_port == b.sin6_port
+            && a.sin6_scope_id == b.sin6_scope_id
+            && 0 == memcmp(&a.sin6_addr, &b.sin6_addr, sizeof(in6_addr));
+    }
+
+    return 0 == memcmp(&_data, &another._data, _szData);
+}
+
+
+size_t UdpAddress::hash() const noexcept {
+
+    // 64-bit multiplicative mixing: cheap and good enough for the address-keyed tables
+    static const uint64_t sMultiplier = 0x9E3779B97F4A7C15ull;
+
+    uint64_t value = (uint64_t)_data.ss_family;
+
+    if (AF_INET == _data.ss_family) {
+        const sockaddr_in& a = (const sockaddr_in&)_data;
+
+        value = ((uint64_t)a.sin_addr.s_addr << 16) ^ a.sin_port;
+    } else if (AF_INET6 == _data.ss_family) {
+        const sockaddr_in6& a = (const sockaddr_in6&)_data;
+
+        uint64_t words[2];
+        memcpy(words, &a.sin6_addr, sizeof(words));
+
+        value = (words[0] * sMultiplier) ^ words[1] ^ ((uint64_t)a.sin6_port << 32) ^ a.sin6_scope_id;
+    } else {
+        const uint8_t* pBytes = (const uint8_t*)&_data;
+        for (socklen_t i = 0; i < _szData; ++i) {
+            value = (value ^ pBytes[i]) * sMultiplier;
+        }
     }
 
-    NativeData* pData = new NativeData;
-    pData->type = NativeDataType::Addrinfo;
-    pData->dataptr = pAddrInfo;
-    pData->size = pAddrInfo->ai_addrlen;
+    value *= sMultiplier;
 
-    return pData;
+    return (size_t)(value ^ (value >> 32));
 }
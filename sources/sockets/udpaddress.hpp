@@ -2,43 +2,62 @@
 #define UDP_SOCKETS_UDPADDRESS_HPP_
 
 
-#include <memory>
-#include <string>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+#include <sys/socket.h>
 
 
 namespace udp { ;
 namespace sockets { ;
 
 
+//! socket address stored inline, so copying it (e.g. into every recieved dgram) never allocates.
 class UdpAddress final {
 public:
 
-    static UdpAddress FromNativeData(void* pOpaqueNativeData, size_t szData) noexcept;
+    //! copies `szData` bytes of the sockaddr at `pOpaqueNativeData`; an oversized one gives an invalid address.
+    static UdpAddress FromNativeData(const void* pOpaqueNativeData, size_t szData) noexcept;
+
+    UdpAddress() noexcept : _szData(0) { _data.ss_family = AF_UNSPEC; }
 
-    UdpAddress() noexcept;
+    //! resolves the host (blocking) and keeps the first resolved address.
     UdpAddress(const char* address, int port) noexcept;
-   ~UdpAddress() noexcept;
 
-    UdpAddress(const UdpAddress&) = default;
-    UdpAddress& operator = (const UdpAddress&) = default;
+    bool valid() const noexcept { return _szData > 0; }
 
-    bool valid() const noexcept;
+    const void* nativeData() const noexcept { return valid() ? &_data : nullptr; }
+    void* nativeData() noexcept { return valid() ? &_data : nullptr; }
 
-    void* nativeData() const noexcept;
-    size_t nativeDataSize() const noexcept;
+    size_t nativeDataSize() const noexcept { return _szData; }
 
-private:
+    //! compares the family, the port and the host address only (e.g. not the IPv6 flow info).
+    bool operator == (const UdpAddress& another) const noexcept;
+    bool operator != (const UdpAddress& another) const noexcept { return !(*this == another); }
 
-    struct NativeData;
+    //! consistent with the equality.
+    size_t hash() const noexcept;
 
-    static NativeData* CreateNativeData(const char* address, int port) noexcept;
+private:
 
-    std::shared_ptr<NativeData> _pData;
+    sockaddr_storage _data;
+    socklen_t        _szData;
 };
 
+static_assert(std::is_trivially_copyable<UdpAddress>::value, "UdpAddress must be copied by memcpy");
+
 
 } // namespace sockets
 } // namespace udp
 
 
+namespace std {
+template <>
+struct hash<udp::sockets::UdpAddress> {
+    size_t operator () (const udp::sockets::UdpAddress& address) const noexcept { return address.hash(); }
+};
+}
+
+
 #endif//UDP_SOCKETS_UDPADDRESS_HPP_
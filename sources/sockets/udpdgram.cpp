@@ -1,9 +1,32 @@
 #include "sockets/udpdgram.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
 
+#include "commons/payloadpool.hpp"
+
+
+using namespace udp;
 using namespace udp::sockets;
 
 
+struct UdpDgram::Segment {
+    uint8_t*        mpBuffer;   ///< the pooled buffer the data is in, nullptr for a borrowed segment
+    const uint8_t*  mpData;
+    size_t          mSize;
+    SegmentReleaser mpReleaser; ///< borrowed segments only
+    void*           mpContext;
+};
+
+
+struct UdpDgram::Segments {
+    size_t  mCount;
+    Segment mItems[MaxSegments - 1];
+};
+
+
 UdpDgram::UdpDgram() noexcept
     : _pData(nullptr), _szData(0)
 {}
@@ -11,16 +34,29 @@ UdpDgram::UdpDgram() noexcept
 
 UdpDgram::~UdpDgram() noexcept {
 
-    if (_pData)
-        delete[] _pData;
+    ReleaseSegments();
+
+    if (!_pBuffer)
+        return;
+
+    if (_isPooled) {
+        PayloadPool::Release(_pBuffer);
+    } else {
+        delete[] _pBuffer;
+    }
 }
 
 
 UdpDgram::UdpDgram(std::initializer_list<uint8_t> data) noexcept
     : _source()
     , _pData(0), _szData(data.size())
+    , _isPooled(true)
 {
-    _pData = new uint8_t[data.size()];
+    _pBuffer = _pData = PayloadPool::GetInstancePtr()->allocate(data.size());
+    if (!_pData) {
+        _szData = 0;
+        return;
+    }
 
     size_t i = 0;
     for (const auto& d : data) {
@@ -31,14 +67,49 @@ UdpDgram::UdpDgram(std::initializer_list<uint8_t> data) noexcept
 
 UdpDgram::UdpDgram(UdpAddress sourceAddress, std::unique_ptr<uint8_t[]> && pData, size_t szData) noexcept
     : _source(std::move(sourceAddress))
-    , _pData(pData.release()), _szData(szData)
+    , _pBuffer(pData.release())
+    , _pData(_pBuffer), _szData(szData)
 {}
 
 
+/*static*/
+UdpDgram UdpDgram::Allocate(UdpAddress sourceAddress, size_t szData) noexcept {
+
+    UdpDgram result;
+    result._source = sourceAddress;
+    result._pBuffer = result._pData = PayloadPool::GetInstancePtr()->allocate(szData);
+    result._szData = result._pData ? szData : 0;
+    result._isPooled = true;
+
+    return result;
+}
+
+
+/*static*/
+UdpDgram UdpDgram::Adopt(UdpAddress sourceAddress, uint8_t* pPayload, size_t szData) noexcept {
+
+    assert(!pPayload || 0 == PayloadPool::Capacity(pPayload) || szData <= PayloadPool::Capacity(pPayload));
+
+    UdpDgram result;
+    result._source = sourceAddress;
+    result._pBuffer = result._pData = pPayload;
+    result._szData = pPayload ? szData : 0;
+    result._isPooled = true;
+
+    return result;
+}
+
+
 UdpDgram::UdpDgram(UdpDgram&& another) noexcept
     : _source(std::move(another._source))
+    , _peer(another._peer)
+    , _pBuffer(another._pBuffer)
     , _pData(another._pData), _szData(another._szData)
+    , _isPooled(another._isPooled)
+    , _pSegments(another._pSegments)
 {
+    another._pSegments = nullptr;
+    another._pBuffer = nullptr;
     another._pData = nullptr;
     another._szData = 0;
 }
@@ -55,18 +126,41 @@ UdpDgram& UdpDgram::operator = (UdpDgram&& another) noexcept {
 }
 
 
+uint8_t* UdpDgram::data() noexcept {
+
+    if (!_isPooled || !PayloadPool::IsShared(_pBuffer))
+        return _pData;
+
+    // copy on write: the clones and slices keep the original payload; only the viewed bytes are copied
+    uint8_t* pCopy = PayloadPool::GetInstancePtr()->allocate(_szData);
+    if (!pCopy)
+        return nullptr;
+
+    std::memcpy(pCopy, _pData, _szData);
+
+    PayloadPool::Release(_pBuffer);
+    _pBuffer = _pData = pCopy;
+
+    return _pData;
+}
+
+
 UdpDgram UdpDgram::clone() const noexcept {
 
     if (!_pData) {
-        return UdpDgram(_source, nullptr, 0);
+        UdpDgram result(_source, nullptr, 0);
+        result._peer = _peer;
+
+        return result;
     }
 
-    assert(_szData > 0);
+    UdpDgram result = SharePayload(_source, _pData, _szData);
+    result._peer = _peer;
 
-    std::unique_ptr<uint8_t[]> pDataCopy = std::make_unique<uint8_t[]>(_szData);
-    std::memcpy(pDataCopy.get(), _pData, _szData);
+    if (eUdpResult_Ok != CloneSegments(result))
+        return UdpDgram();
 
-    return UdpDgram(_source, std::move(pDataCopy), _szData);
+    return result;
 }
 
 
@@ -76,12 +170,230 @@ UdpDgram UdpDgram::clone(UdpAddress source) const noexcept {
         return UdpDgram(source, nullptr, 0);
     }
 
-    assert(_szData > 0);
+    UdpDgram result = SharePayload(source, _pData, _szData);
+
+    if (eUdpResult_Ok != CloneSegments(result))
+        return UdpDgram();
+
+    return result;
+}
+
+
+UdpDgram UdpDgram::clone(UdpPeerId peer) const noexcept {
+
+    UdpDgram result = clone(UdpAddress());
+    result._peer = peer;
+
+    return result;
+}
+
+
+UdpDgram UdpDgram::slice(size_t offset, size_t szSlice) const noexcept {
+
+    offset = std::min(offset, _szData);
+    szSlice = std::min(szSlice, _szData - offset);
+
+    UdpDgram result = (szSlice > 0) ? SharePayload(_source, _pData + offset, szSlice)
+                                    : UdpDgram(_source, nullptr, 0);
+    result._peer = _peer;
+
+    return result;
+}
+
+
+UdpDgram UdpDgram::SharePayload(const UdpAddress& source, const uint8_t* pData, size_t szData) const noexcept {
+
+    assert(szData > 0);
+    assert(pData >= _pData && pData + szData <= _pData + _szData);
+
+    if (_isPooled) {
+        UdpDgram result;
+        result._source = source;
+        result._pBuffer = PayloadPool::Share(_pBuffer);
+        result._pData = result._pBuffer + (pData - _pBuffer);
+        result._szData = szData;
+        result._isPooled = true;
+
+        return result;
+    }
+
+    UdpDgram result = Allocate(source, szData);
+    if (result.valid()) {
+        std::memcpy(result._pData, pData, szData);
+    }
+
+    return result;
+}
+
+
+UdpResult UdpDgram::append(const UdpDgram& segment) noexcept {
+
+    if (!valid() || !segment.valid() || nbSegments() + segment.nbSegments() > MaxSegments)
+        return eUdpResult_Failed;
+
+    const size_t nbAppended = _pSegments ? _pSegments->mCount : 0;
+
+    UdpResult res = AppendSegment(segment._isPooled ? segment._pBuffer : nullptr, segment._pData, segment._szData);
+    if (eUdpResult_Ok == res) {
+        res = segment.CloneSegments(*this);
+    }
+
+    if (eUdpResult_Ok != res && _pSegments) {
+        // out of memory - drop what was appended by this call
+        while (_pSegments->mCount > nbAppended) {
+            PayloadPool::Release(_pSegments->mItems[--_pSegments->mCount].mpBuffer);
+        }
+    }
+
+    return res;
+}
+
+
+UdpResult UdpDgram::append(const uint8_t* pData, size_t szData, SegmentReleaser releaser, void* pContext) noexcept {
+
+    if (!valid() || (!pData && szData > 0) || nbSegments() >= MaxSegments)
+        return eUdpResult_Failed;
+
+    Segment* pItem = NextSegment();
+    if (!pItem)
+        return eUdpResult_Failed;
+
+    pItem->mpBuffer = nullptr;
+    pItem->mpData = pData;
+    pItem->mSize = szData;
+    pItem->mpReleaser = releaser;
+    pItem->mpContext = pContext;
+
+    ++_pSegments->mCount;
+
+    return eUdpResult_Ok;
+}
+
+
+size_t UdpDgram::nbSegments() const noexcept {
+
+    if (!valid())
+        return 0;
+
+    return 1 + (_pSegments ? _pSegments->mCount : 0);
+}
+
+
+const uint8_t* UdpDgram::segmentData(size_t index) const noexcept {
+
+    assert(index < nbSegments());
+
+    return (0 == index) ? _pData : _pSegments->mItems[index - 1].mpData;
+}
+
+
+size_t UdpDgram::segmentSize(size_t index) const noexcept {
+
+    assert(index < nbSegments());
+
+    return (0 == index) ? _szData : _pSegments->mItems[index - 1].mSize;
+}
+
+
+size_t UdpDgram::totalSize() const noexcept {
+
+    size_t szTotal = _szData;
+    if (_pSegments) {
+        for (size_t i = 0; i < _pSegments->mCount; ++i) {
+            szTotal += _pSegments->mItems[i].mSize;
+        }
+    }
+
+    return szTotal;
+}
 
-    std::unique_ptr<uint8_t[]> pDataCopy = std::make_unique<uint8_t[]>(_szData);
-    std::memcpy(pDataCopy.get(), _pData, _szData);
 
-    return UdpDgram(source, std::move(pDataCopy), _szData);
+UdpDgram::Segment* UdpDgram::NextSegment() noexcept {
+
+    if (!_pSegments) {
+        uint8_t* pSegments = PayloadPool::GetInstancePtr()->allocate(sizeof(Segments));
+        if (!pSegments)
+            return nullptr;
+
+        _pSegments = new (pSegments) Segments;
+        _pSegments->mCount = 0;
+    }
+
+    if (_pSegments->mCount >= MaxSegments - 1)
+        return nullptr;
+
+    return &_pSegments->mItems[_pSegments->mCount];
+}
+
+
+UdpResult UdpDgram::AppendSegment(uint8_t* pBuffer, const uint8_t* pData, size_t szData) noexcept {
+
+    Segment* pItem = NextSegment();
+    if (!pItem)
+        return eUdpResult_Failed;
+
+    Segment& item = *pItem;
+
+    if (pBuffer) {
+        item.mpBuffer = PayloadPool::Share(pBuffer);
+        item.mpData = pData;
+    } else {
+        item.mpBuffer = PayloadPool::GetInstancePtr()->allocate(szData);
+        if (!item.mpBuffer)
+            return eUdpResult_Failed;
+
+        if (szData > 0) {
+            std::memcpy(item.mpBuffer, pData, szData);
+        }
+        item.mpData = item.mpBuffer;
+    }
+
+    item.mSize = szData;
+    item.mpReleaser = nullptr;
+    item.mpContext = nullptr;
+
+    ++_pSegments->mCount;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpDgram::CloneSegments(UdpDgram& target) const noexcept {
+
+    if (!_pSegments)
+        return eUdpResult_Ok;
+
+    // borrowed segments are copied: the releaser belongs to this dgram
+    const size_t nbSegments = _pSegments->mCount; // the target may be this very dgram
+    for (size_t i = 0; i < nbSegments; ++i) {
+        const Segment& item = _pSegments->mItems[i];
+
+        UdpResult res = target.AppendSegment(item.mpBuffer, item.mpData, item.mSize);
+        if (eUdpResult_Ok != res)
+            return res;
+    }
+
+    return eUdpResult_Ok;
+}
+
+
+void UdpDgram::ReleaseSegments() noexcept {
+
+    if (!_pSegments)
+        return;
+
+    for (size_t i = 0; i < _pSegments->mCount; ++i) {
+        const Segment& item = _pSegments->mItems[i];
+
+        if (item.mpBuffer) {
+            PayloadPool::Release(item.mpBuffer);
+        } else if (item.mpReleaser) {
+            item.mpReleaser(item.mpContext);
+        }
+    }
+
+    PayloadPool::Release((uint8_t*)_pSegments);
+    _pSegments = nullptr;
 }
 
 
@@ -89,6 +401,10 @@ UdpDgram UdpDgram::clone(UdpAddress source) const noexcept {
 void UdpDgram::Swap(UdpDgram& a, UdpDgram& b) {
 
     std::swap(a._source, b._source);
+    std::swap(a._peer, b._peer);
+    std::swap(a._pBuffer, b._pBuffer);
     std::swap(a._pData, b._pData);
     std::swap(a._szData, b._szData);
+    std::swap(a._isPooled, b._isPooled);
+    std::swap(a._pSegments, b._pSegments);
 }
@@ -3,9 +3,11 @@
 
 
 #include <cinttypes>
+#include <cstddef>
 #include <memory>
 
 #include "commons/macros.h"
+#include "commons/types.h"
 
 #include "sockets/udpaddress.hpp"
 
@@ -14,39 +16,123 @@ namespace udp { ;
 namespace sockets { ;
 
 
+//! compact id of a peer in the peer table of a socket (see UdpEngine::peers); 0 means no peer.
+using UdpPeerId = uint32_t;
+
+
 class UdpDgram {
     NOCOPY(UdpDgram)
 public:
 
+    static constexpr size_t MaxSegments = 8; ///< the payload of the dgram and up to 7 appended segments
+
+    //! called with the context, once a borrowed segment isn't needed anymore: the dgram is sent,
+    //! dropped or destroyed (on whatever thread does it, usually an engine thread).
+    using SegmentReleaser = void (*)(void* pContext);
+
     UdpDgram() noexcept;
    ~UdpDgram() noexcept;
 
     UdpDgram(std::initializer_list<uint8_t> data) noexcept;
     UdpDgram(UdpAddress sourceAddress, std::unique_ptr<uint8_t[]> && pData, size_t szData) noexcept;
 
+    //! a dgram with `szData` uninitialized bytes from the payload pool, which gets them back once
+    //! the dgram is destroyed on whatever thread; invalid if out of memory.
+    static UdpDgram Allocate(UdpAddress sourceAddress, size_t szData) noexcept;
+
+    //! takes over `pPayload` of the payload pool holding `szData` bytes (e.g. a recieve buffer),
+    //! so the dgram is built without copying; the pool gets it back with the dgram.
+    static UdpDgram Adopt(UdpAddress sourceAddress, uint8_t* pPayload, size_t szData) noexcept;
+
     UdpDgram(UdpDgram&& another) noexcept;
     UdpDgram& operator = (UdpDgram&& another) noexcept;
 
     bool valid() const noexcept { return !!_pData; }
 
-    uint8_t* data() noexcept { return _pData; }
+    //! copies the payload first, if it is shared with clones (nullptr if out of memory then);
+    //! read-only users should stick to the const overload.
+    uint8_t* data() noexcept;
     const uint8_t* data() const noexcept { return _pData; }
 
     size_t size() const noexcept { return _szData; }
 
     const UdpAddress& source() const noexcept { return _source; }
 
+    //! the peer the dgram was recieved from or is addressed to.
+    UdpPeerId peer() const noexcept { return _peer; }
+
+    //! used by the engine.
+    void setSource(const UdpAddress& source, UdpPeerId peer) noexcept { _source = source; _peer = peer; }
+    void setPeer(UdpPeerId peer) noexcept { _peer = peer; }
+
+    //! clones of a pooled dgram (recieved by the engine, allocated by Allocate or Adopt) share its
+    //! payload, so fanning a dgram out to N peers costs N addresses, not N payloads; the payload of
+    //! other dgrams is copied into a pooled buffer.
     UdpDgram clone() const noexcept;
     UdpDgram clone(UdpAddress source) const noexcept;
 
+    //! a dgram with `szSlice` bytes of the payload starting at `offset` (clamped to the payload),
+    //! with the same source and peer - e.g. the body past a protocol header. Slices of a pooled
+    //! dgram share its payload the way clones do, keep it alive and can be enqueued or sent as
+    //! any other dgram; slices of other dgrams are copied.
+    UdpDgram slice(size_t offset, size_t szSlice = SIZE_MAX) const noexcept;
+
+    //! appends segments of `segment` to the dgram; all segments are sent as one dgram gathered
+    //! from iovecs, so e.g. a header template can be reused with different bodies (or a body
+    //! with different headers) without copying. Pooled payloads are shared, others are copied.
+    //! Fails if the dgram would have more than MaxSegments segments or out of memory.
+    UdpResult append(const UdpDgram& segment) noexcept;
+
+    //! appends `szData` bytes at `pData` borrowed from the caller, who keeps them intact until
+    //! `releaser` is called with `pContext`; it isn't called if the append fails.
+    UdpResult append(const uint8_t* pData, size_t szData, SegmentReleaser releaser, void* pContext) noexcept;
+
+    //! the payload (see `data` and `size`) is the first segment; data(), size() and slice() address
+    //! the first segment only.
+    size_t nbSegments() const noexcept;
+
+    const uint8_t* segmentData(size_t index) const noexcept;
+    size_t         segmentSize(size_t index) const noexcept;
+
+    //! size of the dgram on the wire: all segments together.
+    size_t totalSize() const noexcept;
+
+    //! a copy addressed to the peer of the socket the copy is sent through; the engine resolves
+    //! the id, so the copy doesn't carry the address.
+    UdpDgram clone(UdpPeerId peer) const noexcept;
+
 private:
 
     static void Swap(UdpDgram& a, UdpDgram& b);
 
+    //! a dgram with `szData` bytes at `pData` inside of the payload: shared if pooled, copied otherwise.
+    UdpDgram SharePayload(const UdpAddress& source, const uint8_t* pData, size_t szData) const noexcept;
+
+    struct Segment;
+    struct Segments;
+
+    //! a free slot for the next appended segment, nullptr if full or out of memory.
+    Segment* NextSegment() noexcept;
+
+    //! appends the segment sharing the pooled `pBuffer` or copying the data, if not pooled.
+    UdpResult AppendSegment(uint8_t* pBuffer, const uint8_t* pData, size_t szData) noexcept;
+
+    //! shares (or copies) appended segments of this dgram to `target`.
+    UdpResult CloneSegments(UdpDgram& target) const noexcept;
+
+    void ReleaseSegments() noexcept;
+
     UdpAddress _source;
+    UdpPeerId  _peer{0};
+
+    uint8_t* _pBuffer{nullptr}; ///< the owned allocation, _pData points into it (a slice doesn't start it)
 
     uint8_t* _pData;
     size_t _szData;
+
+    bool _isPooled{false}; ///< _pData owned by the dgram came from the payload pool (and can be shared), not new[]
+
+    Segments* _pSegments{nullptr}; ///< appended segments, kept in a pooled buffer
 };
 
 
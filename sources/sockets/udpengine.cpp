@@ -1,31 +1,43 @@
 #include "sockets/udpengine.hpp"
 
 #include <assert.h>
-#include <netdb.h>
-#include <unistd.h>
 
-#include <sys/types.h>
-#include <sys/socket.h>
-
-#include <list>
+#include <algorithm>
 
 #include "commons/logger.hpp"
 #include "commons/utils.hpp"
 
-
-#define DGRAM_MAXLINE 1024
-#define DGRAM_QUEUE_SIZE 512
+#include "sockets/udpreactor.hpp"
 
 
 using namespace udp;
 using namespace sockets::priv;
 
 
-struct UdpEngine::NativeData {
-    fd_set mAllSockets; /// @NOTE(stoned_fox): since this is a reflection of the udp users table, this
-                        ///                data is guarded by the same mutex as the table.
-    int mMaxSocketId;
-};
+UdpEngine::Stats& UdpEngine::Stats::operator += (const Stats& another) noexcept {
+
+    mNbSent            += another.mNbSent;
+    mNbRecieved        += another.mNbRecieved;
+    mNbInputDropped    += another.mNbInputDropped;
+    mNbSendFails       += another.mNbSendFails;
+    mNbRecievesFails   += another.mNbRecievesFails;
+    mNbRecieveCalls    += another.mNbRecieveCalls;
+    mNbSendCalls       += another.mNbSendCalls;
+    mNbSegmentedDgrams += another.mNbSegmentedDgrams;
+    mNbCoalescedDgrams += another.mNbCoalescedDgrams;
+    mNbDrains          += another.mNbDrains;
+    mNbSpentQuantums   += another.mNbSpentQuantums;
+    mNbUnresolvedDgrams += another.mNbUnresolvedDgrams;
+    mNbTruncatedDgrams += another.mNbTruncatedDgrams;
+    mNbDroppedNewest   += another.mNbDroppedNewest;
+    mNbDroppedOldest   += another.mNbDroppedOldest;
+    mNbSpilled         += another.mNbSpilled;
+    mNbSpillDropped    += another.mNbSpillDropped;
+
+    mMaxDrainedDgrams = std::max(mMaxDrainedDgrams, another.mMaxDrainedDgrams);
+
+    return *this;
+}
 
 
 static UdpEngine* sUdpEngineInstancePtr = nullptr;
@@ -76,57 +88,157 @@ UdpEngine* UdpEngine::GetInstancePtr() noexcept {
 
 UdpResult UdpEngine::startUp() noexcept {
 
-    return _pThreader->syncStart(-1);
+    UdpResult res = eUdpResult_Ok;
+
+    TRY_LOCKED(_reactors) {
+        // the first reactor decides on the engine state, the rest just follow it
+        res = _reactors[0]->startUp();
+        if (eUdpResult_Ok == res) {
+            for (size_t i = 1; i < _reactors.size(); ++i) {
+                _reactors[i]->startUp();
+            }
+        }
+    } UNLOCK;
+
+    return res;
 }
 
 
 UdpResult UdpEngine::tearDown() noexcept {
 
-    return _pThreader->syncStop(-1);
+    UdpResult res = eUdpResult_Ok;
+
+    TRY_LOCKED(_reactors) {
+        res = _reactors[0]->tearDown();
+        if (eUdpResult_Ok == res) {
+            for (size_t i = 1; i < _reactors.size(); ++i) {
+                _reactors[i]->tearDown();
+            }
+        }
+    } UNLOCK;
+
+    return res;
+}
+
+
+UdpResult UdpEngine::attachSocket( IUdpUser* pUser, UdpRole role, const UdpAddress& address
+                                 , const UdpSocketConfig& config ) noexcept
+{
+    if (!IsValidConfig(config))
+        return eUdpResult_Failed;
+
+    UdpDgramQueue::SPtr pInputQueue  = std::make_shared<UdpDgramQueue>(config.mInputQueueSize, config.mInputQueueConcurrency);
+    UdpDgramQueue::SPtr pOutputQueue = std::make_shared<UdpDgramQueue>(config.mOutputQueueSize, config.mOutputQueueConcurrency);
+
+    UdpPeerTable::SPtr pPeers = std::make_shared<UdpPeerTable>(DefaultPeerTimeToLive);
+
+    int socketId = -1;
+
+    TRY_LOCKED(_reactors) {
+        if (_attachments.count(pUser) > 0) {
+            LOGE << "Trying to attach already attached user";
+            return eUdpResult_Already;
+        }
+
+        UdpReactor* pReactor = PickReactor(nullptr);
+
+        UdpResult res = pReactor->attachSocket(pUser, role, address, false, config, pInputQueue, pOutputQueue, true, pPeers, &socketId);
+        if (eUdpResult_Ok != res)
+            return res;
+
+        _attachments.emplace(pUser, std::vector<UdpReactor*>{ pReactor });
+        _peerTables.emplace(pUser, pPeers);
+    } UNLOCK;
+
+    pUser->setUp(socketId, pInputQueue, pOutputQueue);
+
+    return eUdpResult_Ok;
 }
 
 
-UdpResult UdpEngine::attachSocket(IUdpUser* pUser, UdpRole role, const UdpAddress& address) noexcept {
+UdpResult UdpEngine::attachShardedSocket( IUdpUser* pUser, const UdpAddress& address
+                                        , size_t nbShards, UdpShardQueues queues
+                                        , const UdpSocketConfig& config ) noexcept
+{
+    if (0 == nbShards) {
+        LOGE << "Sharded socket needs at least one shard";
+        return eUdpResult_Failed;
+    }
 
-    UserData udata;
-    udata.mAddress = address;
-    udata.mInputQueue  = std::make_shared<UdpDgramQueue>(DGRAM_QUEUE_SIZE);
-    udata.mOutputQueue = std::make_shared<UdpDgramQueue>(DGRAM_QUEUE_SIZE);
-    udata.mRole = role;
+    if (!IsValidConfig(config))
+        return eUdpResult_Failed;
 
-    if ((udata.mSocketId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
-        LOGE << "Failed to create socket";
+    if (nbShards > 1 && UdpShardQueues::Merged == queues
+        && (UdpQueueConcurrency::Spsc == config.mInputQueueConcurrency || UdpQueueConcurrency::Spsc == config.mOutputQueueConcurrency))
+    {
+        LOGE << "Merged queues are shared by the shard threads, so they can't be spsc";
         return eUdpResult_Failed;
     }
 
-    if (UdpRole::Server == role) {
-        int result = bind(udata.mSocketId, (sockaddr*)address.nativeData(), address.nativeDataSize());
-        if (0 != result) {
-            LOGE << "Failed to bind address to a socket (errno == " << errno << ")";
+#if !defined(__linux__)
+    LOGW << "SO_REUSEPORT doesn't balance unicast dgrams on this platform - most shards will stay idle";
+#endif
 
-            close(udata.mSocketId);
+    std::vector<int> socketIds(nbShards, -1);
+    std::vector<UdpDgramQueue::SPtr> inputQueues(nbShards), outputQueues(nbShards);
 
-            return eUdpResult_Failed;
+    // ids of peers are valid for every shard, whichever of them recieved from the peer
+    UdpPeerTable::SPtr pPeers = std::make_shared<UdpPeerTable>(DefaultPeerTimeToLive);
+
+    for (size_t i = 0; i < nbShards; ++i) {
+        if (0 == i || UdpShardQueues::PerShard == queues) {
+            inputQueues[i]  = std::make_shared<UdpDgramQueue>(config.mInputQueueSize, config.mInputQueueConcurrency);
+            outputQueues[i] = std::make_shared<UdpDgramQueue>(config.mOutputQueueSize, config.mOutputQueueConcurrency);
+        } else {
+            // every shard produces into and consumes from the same mpmc queues
+            inputQueues[i]  = inputQueues[0];
+            outputQueues[i] = outputQueues[0];
         }
     }
 
-    TRY_LOCKED(_usersTable) {
-        auto insres = _usersTable.insert(std::make_pair(pUser, udata));
-        if (!insres.second) {
+    TRY_LOCKED(_reactors) {
+        if (_attachments.count(pUser) > 0) {
             LOGE << "Trying to attach already attached user";
-
-            close(udata.mSocketId);
-
             return eUdpResult_Already;
         }
 
-        FD_SET(udata.mSocketId, &_pNativeData->mAllSockets);
+        // every shard gets its own thread
+        while (_reactors.size() < nbShards) {
+            if (!AddReactor())
+                return eUdpResult_Failed;
+        }
+
+        std::vector<UdpReactor*> shardReactors;
+        for (size_t i = 0; i < nbShards; ++i) {
+            UdpReactor* pReactor = _reactors[i].get();
+
+            // the first shard sends everything queued into merged queues
+            const bool isSending = 0 == i || UdpShardQueues::PerShard == queues;
+
+            UdpResult res = pReactor->attachSocket( pUser, UdpRole::Server, address, true, config
+                                                  , inputQueues[i], outputQueues[i], isSending, pPeers, &socketIds[i] );
+            if (eUdpResult_Ok != res) {
+                for (auto pShardReactor : shardReactors) {
+                    pShardReactor->detachSocket(pUser);
+                }
+
+                return res;
+            }
+
+            shardReactors.push_back(pReactor);
+        }
 
-        if (udata.mSocketId + 1 > _pNativeData->mMaxSocketId)
-            _pNativeData->mMaxSocketId = udata.mSocketId + 1;
+        _attachments.emplace(pUser, std::move(shardReactors));
+        _peerTables.emplace(pUser, pPeers);
     } UNLOCK;
 
-    pUser->setUp(udata.mSocketId, udata.mInputQueue, udata.mOutputQueue);
+    if (UdpShardQueues::Merged == queues) {
+        pUser->setUp(socketIds[0], inputQueues[0], outputQueues[0]);
+    } else {
+        for (size_t i = 0; i < nbShards; ++i) {
+            pUser->setUpShard(i, socketIds[i], inputQueues[i], outputQueues[i]);
+        }
+    }
 
     return eUdpResult_Ok;
 }
@@ -134,240 +246,439 @@ UdpResult UdpEngine::attachSocket(IUdpUser* pUser, UdpRole role, const UdpAddres
 
 UdpResult UdpEngine::detachSocket(IUdpUser* pUser) noexcept {
 
-    TRY_LOCKED(_usersTable) {
-        auto foundIt = _usersTable.find(pUser);
-        if (_usersTable.end() == foundIt) {
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _attachments.find(pUser);
+        if (_attachments.end() == foundIt) {
             LOGE << "Trying to detach not attached user";
             return eUdpResult_Failed;
         }
 
         pUser->notifyInvalid();
-        
-        FD_CLR(foundIt->second.mSocketId, &_pNativeData->mAllSockets);
 
-        close(foundIt->second.mSocketId);
+        for (auto pReactor : foundIt->second) {
+            pReactor->detachSocket(pUser);
+        }
 
-        _usersTable.erase(foundIt);
+        _attachments.erase(foundIt);
+        _peerTables.erase(pUser);
     } UNLOCK;
 
     return eUdpResult_Ok;
 }
 
 
-UdpEngine::UdpEngine() noexcept
-    : _pNativeData(new NativeData)
-{
-    FD_ZERO(&_pNativeData->mAllSockets);
+UdpResult UdpEngine::socketConfig(IUdpUser* pUser, UdpSocketConfig* pConfig) noexcept {
 
-    _pNativeData->mMaxSocketId = 0;
+    UdpResult res = eUdpResult_Failed;
 
-    _pThreader = std::make_unique<Threader>(this, &DoEngineStep);
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _attachments.find(pUser);
+        if (_attachments.end() == foundIt) {
+            LOGE << "Trying to read config of not attached user";
+            return eUdpResult_Failed;
+        }
+
+        res = foundIt->second[0]->socketConfig(pUser, pConfig);
+    } UNLOCK;
+
+    return res;
 }
 
 
-UdpEngine::~UdpEngine() noexcept {
+UdpResult UdpEngine::setRecieveBatchSize(IUdpUser* pUser, size_t nbDgrams) noexcept {
+
+    return ForEachUserReactor(pUser, &UdpReactor::setRecieveBatchSize, nbDgrams);
+}
 
-    TRY_LOCKED(_usersTable) {
-        if (_usersTable.size() > 0) {
-            LOGW << "Destroying Udp Engine while still having active users";
-            for (auto& p : _usersTable) {
-                p.first->notifyInvalid();
 
-                close(p.second.mSocketId);
-            }
+UdpResult UdpEngine::setSegmentationOffload(IUdpUser* pUser, bool isEnabled) noexcept {
+
+    return ForEachUserReactor(pUser, &UdpReactor::setSegmentationOffload, isEnabled);
+}
+
+
+UdpResult UdpEngine::setLargeDgrams(IUdpUser* pUser, bool isEnabled) noexcept {
+
+    return ForEachUserReactor(pUser, &UdpReactor::setLargeDgrams, isEnabled);
+}
+
 
-            _usersTable.clear();
+UdpResult UdpEngine::setDrainQuantum(size_t nbDgrams) noexcept {
 
-            FD_ZERO(&_pNativeData->mAllSockets);
+    if (0 == nbDgrams) {
+        LOGE << "Drain quantum must be positive";
+        return eUdpResult_Failed;
+    }
+
+    TRY_LOCKED(_reactors) {
+        _drainQuantum = nbDgrams;
+
+        for (auto& pReactor : _reactors) {
+            pReactor->setDrainQuantum(nbDgrams);
         }
     } UNLOCK;
 
-    _pThreader->syncStop(-1);
+    return eUdpResult_Ok;
+}
+
 
-    delete _pNativeData;
+UdpResult UdpEngine::setPeerTimeToLive(IUdpUser* pUser, std::chrono::milliseconds ttl) noexcept {
+
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _peerTables.find(pUser);
+        if (_peerTables.end() == foundIt) {
+            LOGE << "Trying to configure not attached user";
+            return eUdpResult_Failed;
+        }
+
+        foundIt->second->setTimeToLive(ttl);
+    } UNLOCK;
+
+    return eUdpResult_Ok;
 }
 
 
-void UdpEngine::FindAndFixBadSocketId() noexcept {
+std::vector<UdpPeerInfo> UdpEngine::peers(IUdpUser* pUser) noexcept {
 
-    std::list<IUdpUser*> badIds;
+    UdpPeerTable::SPtr pPeers;
 
-    for (auto& p : _usersTable) {
-        fd_set toTry;
-        FD_ZERO(&toTry);
-        FD_SET(p.second.mSocketId, &toTry);
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _peerTables.find(pUser);
+        if (_peerTables.end() != foundIt)
+            pPeers = foundIt->second;
+    } UNLOCK;
 
-        timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+    // the table has its own lock - don't hold the engine one while copying it
+    return pPeers ? pPeers->peers() : std::vector<UdpPeerInfo>();
+}
 
-        int selectRes = select(p.second.mSocketId + 1, &toTry, 0, 0, &tv);
-        if (EBADF == selectRes) {
-            p.first->notifyInvalid();
-            badIds.push_back(p.first);
-        }
-    }
 
-    for (auto pUser : badIds) {
-        _usersTable.erase(pUser);
+UdpResult UdpEngine::findPeer(IUdpUser* pUser, UdpPeerId peer, UdpPeerInfo* pInfo) noexcept {
+
+    UdpPeerTable::SPtr pPeers;
+
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _peerTables.find(pUser);
+        if (_peerTables.end() != foundIt)
+            pPeers = foundIt->second;
+    } UNLOCK;
+
+    if (!pPeers) {
+        LOGE << "Trying to find a peer of not attached user";
+        return eUdpResult_Failed;
     }
+
+    return pPeers->find(peer, pInfo) ? eUdpResult_Ok : eUdpResult_Failed;
 }
 
 
-void UdpEngine::InvalidateUsersWithLargeSocketId() noexcept {
+UdpResult UdpEngine::setNbThreads(size_t nbThreads) noexcept {
 
-    std::list<IUdpUser*> badIds;
+    TRY_LOCKED(_reactors) {
+        if (nbThreads < _reactors.size()) {
+            LOGE << "Engine threads can't be stopped - there are " << _reactors.size() << " of them already";
+            return eUdpResult_Failed;
+        }
 
-    for (auto& p : _usersTable) {
-        if (p.second.mSocketId >= FD_SETSIZE) {
-            p.first->notifyInvalid();
-            badIds.push_back(p.first);
+        while (_reactors.size() < nbThreads) {
+            if (!AddReactor())
+                return eUdpResult_Failed;
         }
-    }
+    } UNLOCK;
 
-    for (auto pUser : badIds) {
-        _usersTable.erase(pUser);
-    }
+    return eUdpResult_Ok;
 }
 
 
-/*static*/
-Threader::StepResult UdpEngine::DoEngineStep(void *pOpaqueSelf) {
-
-    UdpEngine* pSelf = (UdpEngine*)pOpaqueSelf;
-
-    fd_set toRead, toWrite, withErrors;
-    FD_ZERO(&withErrors);
-
-    TRY_LOCKED(pSelf->_usersTable) {
-        if (pSelf->_pNativeData->mMaxSocketId <= 0)
-            return Threader::StepResult::Continue;
-
-        if (pSelf->_usersTable.size() == 0)
-            return Threader::StepResult::Continue;
-
-        FD_COPY(&pSelf->_pNativeData->mAllSockets, &toRead);
-        FD_COPY(&pSelf->_pNativeData->mAllSockets, &toWrite);
-
-        timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-
-        int selectRes = select(pSelf->_pNativeData->mMaxSocketId, &toRead, &toWrite, &withErrors, &tv);
-        if (EAGAIN == selectRes || EINTR == selectRes) {
-            // just continue and try on the next step
-            return Threader::StepResult::Continue;
-        } else if (EBADF == selectRes) {
-            pSelf->FindAndFixBadSocketId();
-            return Threader::StepResult::Continue;
-        } else if (EINVAL == selectRes) {
-            if (pSelf->_pNativeData->mMaxSocketId >= FD_SETSIZE) {
-                // too many descriptors! lets throw some away
-                pSelf->InvalidateUsersWithLargeSocketId();
-                return Threader::StepResult::Continue;
-            }
+void UdpEngine::setBalancePolicy(UdpBalancePolicy policy) noexcept {
+
+    TRY_LOCKED(_reactors) {
+        _balancePolicy = policy;
+    } UNLOCK;
+}
+
+
+UdpResult UdpEngine::moveSocket(IUdpUser* pUser, size_t threadIndex) noexcept {
+
+    TRY_LOCKED(_reactors) {
+        if (threadIndex >= _reactors.size()) {
+            LOGE << "There is no engine thread " << threadIndex;
+            return eUdpResult_Failed;
+        }
+
+        return MoveSocket(pUser, _reactors[threadIndex].get());
+    } UNLOCK;
+
+    return eUdpResult_Failed;
+}
+
+
+UdpResult UdpEngine::rebalanceSocket(IUdpUser* pUser) noexcept {
 
-            // according to the man page, this is a case, when timeval is wrong.
-            // this is definitely a hardbreak...
-            HARDBREAK;
-        } else if (0 == selectRes) {
-            // timeout case - try on the next step
-            return Threader::StepResult::Continue;
-        } else if (selectRes < 0) {
-            // welp, this is strange - let's break the fuck out of here
-            HARDBREAK;
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _attachments.find(pUser);
+        if (_attachments.end() == foundIt) {
+            LOGE << "Trying to rebalance not attached user";
+            return eUdpResult_Failed;
         }
 
-        assert(selectRes > 0);
+        UdpReactor* pCurrent = foundIt->second[0];
 
-        for (auto& it : pSelf->_usersTable) {
-            if (FD_ISSET(it.second.mSocketId, &toWrite) != 0) {
-                SendUdpUserDgrams(it.second, &pSelf->_stats);
-            }
+        UdpReactor* pTarget = PickReactor(pCurrent);
+        if (!pTarget)
+            return eUdpResult_Already;
 
-            if (FD_ISSET(it.second.mSocketId, &toRead) != 0) {
-                RecieveUdpUserDgrams(it.second, &pSelf->_stats);
-            }
+        ThreadLoad currentLoad = pCurrent->load();
+        ThreadLoad targetLoad = pTarget->load();
+
+        // a socket alone on its thread has nowhere better to go; otherwise it moves only
+        // if the target stays less loaded after taking the socket
+        bool isBetter = currentLoad.mNbSockets > 1;
+        if (UdpBalancePolicy::FewestSockets == _balancePolicy) {
+            isBetter = isBetter && targetLoad.mNbSockets + 1 < currentLoad.mNbSockets;
+        } else {
+            isBetter = isBetter && targetLoad.mDgramsPerSecond < currentLoad.mDgramsPerSecond;
         }
+
+        if (!isBetter)
+            return eUdpResult_Already;
+
+        return MoveSocket(pUser, pTarget);
     } UNLOCK;
 
-    return Threader::StepResult::Continue;
+    return eUdpResult_Failed;
 }
 
 
-/*static*/
-void UdpEngine::SendUdpUserDgrams(UserData& udata, Stats* pStats) {
+UdpEngineBackend UdpEngine::backend() const noexcept {
+
+    return _backend;
+}
+
+
+std::vector<UdpEngine::ThreadLoad> UdpEngine::threadsLoad() noexcept {
+
+    std::vector<ThreadLoad> loads;
+
+    TRY_LOCKED(_reactors) {
+        loads.reserve(_reactors.size());
+        for (auto& pReactor : _reactors) {
+            loads.push_back(pReactor->load());
+        }
+    } UNLOCK;
+
+    return loads;
+}
+
 
-    const UdpAddress* pAddress = nullptr;
-    if (udata.mRole == UdpRole::Client) {
-        pAddress = &udata.mAddress;
+UdpEngine::Stats UdpEngine::stats() noexcept {
+
+    std::vector<UdpReactor*> reactors;
+
+    TRY_LOCKED(_reactors) {
+        reactors.reserve(_reactors.size());
+        for (auto& pReactor : _reactors) {
+            reactors.push_back(pReactor.get());
+        }
+    } UNLOCK;
+
+    // reactors live as long as the engine; each one waits for its thread to make a step here,
+    // which must not hold attaches and moves of other threads back
+    Stats total;
+    for (UdpReactor* pReactor : reactors) {
+        total += pReactor->stats();
     }
 
-    UdpDgram dgram;
-    if (udata.mLeftovers.size() > 0) {
-        dgram = std::move(udata.mLeftovers.front());
-        udata.mLeftovers.pop_front();
-    } else {
-        udata.mOutputQueue->dequeue(dgram);
+    return total;
+}
+
+
+size_t UdpEngine::nbThreads() noexcept {
+
+    size_t nbThreads = 0;
+
+    TRY_LOCKED(_reactors) {
+        nbThreads = _reactors.size();
+    } UNLOCK;
+
+    return nbThreads;
+}
+
+
+UdpEngine::UdpEngine() noexcept
+    : UdpEngine(UdpEngineBackend::Auto)
+{}
+
+
+UdpEngine::UdpEngine(UdpEngineBackend backend) noexcept {
+
+    _reactors.push_back(std::make_unique<UdpReactor>(backend));
+
+    // the first reactor resolves Auto and falls back if the backend isn't supported
+    _backend = _reactors[0]->backend();
+}
+
+
+UdpEngine::~UdpEngine() noexcept {
+
+    TRY_LOCKED(_reactors) {
+        _attachments.clear();
+        _reactors.clear();
+    } UNLOCK;
+}
+
+
+UdpReactor* UdpEngine::AddReactor() noexcept {
+
+    std::unique_ptr<UdpReactor> pReactor = std::make_unique<UdpReactor>(_backend);
+    if (pReactor->backend() != _backend) {
+        LOGE << "Failed to set up one more engine thread with the same backend";
+        return nullptr;
     }
 
-    if (dgram.valid()) {
-        if (!pAddress) {
-            pAddress = &(dgram.source());
+    pReactor->setDrainQuantum(_drainQuantum);
+
+    if (_reactors[0]->isRunning()) {
+        UdpResult res = pReactor->startUp();
+        if (eUdpResult_Ok != res) {
+            LOGE << "Failed to start one more engine thread";
+            return nullptr;
         }
-        sockaddr* pAddrInfo = (sockaddr*)pAddress->nativeData();
-        size_t szSent = sendto(udata.mSocketId, dgram.data(), dgram.size(), 0, pAddrInfo, pAddress->nativeDataSize());
+    }
 
-        if (szSent <= 0) {
-            LOGW << "failed to send data!";
-            if (pStats) {
-                pStats->mNbSendFails += 1;
-            }
+    _reactors.push_back(std::move(pReactor));
 
-            udata.mLeftovers.push_front(std::move(dgram));
-        } else {
-            if (pStats) {
-                pStats->mNbSent += 1;
-            }
+    return _reactors.back().get();
+}
+
+
+UdpReactor* UdpEngine::PickReactor(const UdpReactor* pExcluded) noexcept {
+
+    UdpReactor* pBest = nullptr;
+    ThreadLoad bestLoad;
+
+    for (auto& pReactor : _reactors) {
+        if (pReactor.get() == pExcluded)
+            continue;
 
+        ThreadLoad load = pReactor->load();
 
+        bool isBetter = !pBest;
+        if (!isBetter && UdpBalancePolicy::LowestRate == _balancePolicy) {
+            isBetter = load.mDgramsPerSecond < bestLoad.mDgramsPerSecond
+                    || (load.mDgramsPerSecond == bestLoad.mDgramsPerSecond && load.mNbSockets < bestLoad.mNbSockets);
+        } else if (!isBetter) {
+            isBetter = load.mNbSockets < bestLoad.mNbSockets;
+        }
+
+        if (isBetter) {
+            pBest = pReactor.get();
+            bestLoad = load;
         }
     }
+
+    return pBest;
+}
+
+
+UdpResult UdpEngine::MoveSocket(IUdpUser* pUser, UdpReactor* pTarget) noexcept {
+
+    auto foundIt = _attachments.find(pUser);
+    if (_attachments.end() == foundIt) {
+        LOGE << "Trying to move not attached user";
+        return eUdpResult_Failed;
+    }
+
+    if (foundIt->second.size() > 1) {
+        LOGE << "Sharded sockets can't be moved";
+        return eUdpResult_Failed;
+    }
+
+    if (foundIt->second[0] == pTarget)
+        return eUdpResult_Already;
+
+    UdpResult res = foundIt->second[0]->moveSocket(pUser, *pTarget);
+    if (eUdpResult_NotImplemented == res) {
+        // refused before anything was touched - the socket stays with its thread
+        return eUdpResult_Failed;
+    }
+
+    if (eUdpResult_Ok != res) {
+        // the socket is closed by now - nobody serves the user anymore
+        pUser->notifyInvalid();
+
+        _attachments.erase(foundIt);
+        _peerTables.erase(pUser);
+
+        return res;
+    }
+
+    foundIt->second[0] = pTarget;
+
+    return eUdpResult_Ok;
 }
 
 
 /*static*/
-void UdpEngine::RecieveUdpUserDgrams(UserData& udata, Stats* pStats) {
+bool UdpEngine::IsValidConfig(const UdpSocketConfig& config) noexcept {
 
-    static uint8_t sBuffer[DGRAM_MAXLINE];
-    int nbReadBytes;
-    socklen_t szAddress;
+    if (0 == config.mInputQueueSize || 0 == config.mOutputQueueSize) {
+        LOGE << "Socket queues can't be empty";
+        return false;
+    }
 
-    std::unique_ptr<sockaddr_in> pSrcAddress = std::make_unique<sockaddr_in>();
+    if (0 == config.mRecieveBatchSize || config.mRecieveBatchSize > MaxRecieveBatchSize) {
+        LOGE << "Recieve batch size must be in [1, " << MaxRecieveBatchSize << "]";
+        return false;
+    }
 
-    nbReadBytes = recvfrom(udata.mSocketId, (char*)sBuffer, DGRAM_MAXLINE, MSG_WAITALL, (struct sockaddr*)pSrcAddress.get(), &szAddress);
+    if (UdpSocketConfig::DefaultMaxDgramSize != config.mMaxDgramSize && UdpSocketConfig::MaxDgramSize != config.mMaxDgramSize) {
+        LOGE << "Max dgram size must be either " << UdpSocketConfig::DefaultMaxDgramSize << " or " << UdpSocketConfig::MaxDgramSize;
+        return false;
+    }
 
-    if (nbReadBytes <= 0) {
-        LOGW << "failed to recieve data!";
-        if (pStats) {
-            pStats->mNbRecievesFails += 1;
-        }
+    if (config.mRecieveBufferSize < 0 || config.mSendBufferSize < 0 || config.mBusyPollUs < 0) {
+        LOGE << "Socket buffer sizes and busy poll time can't be negative";
+        return false;
+    }
 
-        return;
+    if (UdpOverflowPolicy::Spill == config.mOverflowPolicy && 0 == config.mSpillSize) {
+        LOGE << "Spill ring can't be empty";
+        return false;
     }
 
-    std::unique_ptr<uint8_t[]> pData = std::make_unique<uint8_t[]>(nbReadBytes);
-    memcpy(pData.get(), sBuffer, nbReadBytes);
+    if (UdpOverflowPolicy::DropOldest == config.mOverflowPolicy && UdpQueueConcurrency::Spsc == config.mInputQueueConcurrency) {
+        LOGE << "DropOldest evicts dgrams on the engine thread, so the input queue can't be spsc";
+        return false;
+    }
 
-    if (pStats) {
-        pStats->mNbRecieved += 1;
+#if !defined(__linux__)
+    if (config.mBusyPollUs > 0) {
+        LOGE << "Busy polling is not available on this platform";
+        return false;
     }
+#endif
+
+    return true;
+}
 
-    UdpDgram dgram(UdpAddress::FromNativeData(pSrcAddress.release(), szAddress), std::move(pData), nbReadBytes);
-    if (!udata.mInputQueue->enqueue(std::move(dgram))) {
-        LOGW << "Failed to enqueue recieved dgram - dropped";
-        if (pStats) {
-            pStats->mNbInputDropped += 1;
+
+template < typename Method, typename ... Args >
+UdpResult UdpEngine::ForEachUserReactor(IUdpUser* pUser, Method method, Args ... args) noexcept {
+
+    TRY_LOCKED(_reactors) {
+        auto foundIt = _attachments.find(pUser);
+        if (_attachments.end() == foundIt) {
+            LOGE << "Trying to configure not attached user";
+            return eUdpResult_Failed;
         }
-    }
+
+        for (auto pReactor : foundIt->second) {
+            UdpResult res = (pReactor->*method)(pUser, args...);
+            if (eUdpResult_Ok != res)
+                return res;
+        }
+    } UNLOCK;
+
+    return eUdpResult_Ok;
 }
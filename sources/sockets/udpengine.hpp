@@ -2,18 +2,23 @@
 #define UDP_SOCKETS_UDPENGINE_HPP_
 
 
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "commons/macros.h"
 #include "commons/types.h"
 
 #include "commons/queue.hpp"
-#include "commons/threader.hpp"
 
 #include "sockets/udpaddress.hpp"
 #include "sockets/udpdgram.hpp"
+#include "sockets/udppeers.hpp"
+#include "sockets/udpwakeup.hpp"
 
 
 namespace udp { ;
@@ -21,7 +26,162 @@ namespace sockets { ;
 namespace priv { ;
 
 
-using UdpDgramQueue = udp::MpmcBoundedQueue<UdpDgram>;
+//! threads, which produce into and consume from a dgram queue.
+enum class UdpQueueConcurrency {
+    Mpmc, ///< any number of threads on both ends
+    Spsc  ///< a single producer and a single consumer thread, e.g. the engine thread and one
+          ///< thread of the user; skips the sequence numbers and the CAS of the mpmc queue
+};
+
+
+//! queue of dgrams between a user and the engine. An engine thread, which runs out of dgrams
+//! to send, arms the output queue and waits for the next enqueue to notify it instead of polling.
+//! A user thread can sleep on the queue as well: for a dgram (dequeueWait) or for room (enqueueWait).
+class UdpDgramQueue final {
+    NOCOPY(UdpDgramQueue)
+    NOMOVE(UdpDgramQueue)
+public:
+
+    using SPtr = std::shared_ptr<UdpDgramQueue>;
+
+    explicit UdpDgramQueue(size_t szBuffer, UdpQueueConcurrency concurrency = UdpQueueConcurrency::Mpmc) noexcept
+        : _isSpsc(UdpQueueConcurrency::Spsc == concurrency)
+        , _mpmcQueue(_isSpsc ? 0 : szBuffer)
+        , _spscQueue(_isSpsc ? szBuffer : 0)
+    {}
+
+    bool valid() const noexcept { return _isSpsc ? _spscQueue.valid() : _mpmcQueue.valid(); }
+
+    size_t capacity() const noexcept { return _isSpsc ? _spscQueue.capacity() : _mpmcQueue.capacity(); }
+
+    UdpQueueConcurrency concurrency() const noexcept {
+        return _isSpsc ? UdpQueueConcurrency::Spsc : UdpQueueConcurrency::Mpmc;
+    }
+
+    bool enqueue(UdpDgram&& dgram) noexcept {
+
+        bool isEnqueued = _isSpsc ? _spscQueue.enqueue(std::move(dgram)) : _mpmcQueue.enqueue(std::move(dgram));
+        if (!isEnqueued)
+            return false;
+
+        NotifyIfArmed();
+
+        return true;
+    }
+
+    //! enqueues as many dgrams, as there is room for, at once; returns the number of dgrams
+    //! moved from the front of `pDgrams`.
+    size_t enqueueBulk(UdpDgram* pDgrams, size_t nbDgrams) noexcept {
+
+        size_t nbEnqueued = _isSpsc ? _spscQueue.enqueueBulk(pDgrams, nbDgrams) : _mpmcQueue.enqueueBulk(pDgrams, nbDgrams);
+        if (nbEnqueued > 0)
+            NotifyIfArmed();
+
+        return nbEnqueued;
+    }
+
+    //! used by the user: waits up to `timeout` for room in the full queue; the dgram is moved
+    //! only if it's enqueued.
+    bool enqueueWait(UdpDgram&& dgram, std::chrono::nanoseconds timeout) noexcept {
+
+        // dequeues notify only while the counter is set; one of them can miss it (the counter
+        // isn't fenced on their side), so the wait is sliced to re-check the queue meanwhile
+        _nbRoomWaiters.fetch_add(1, std::memory_order_relaxed);
+
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+        bool isEnqueued = false;
+        std::chrono::nanoseconds left = timeout;
+        do {
+            isEnqueued = _roomWait.wait([this, &dgram]() { return enqueue(std::move(dgram)); }, std::min(left, RoomWaitSlice));
+            left = deadline - std::chrono::steady_clock::now();
+        } while (!isEnqueued && left.count() > 0);
+
+        _nbRoomWaiters.fetch_sub(1, std::memory_order_relaxed);
+
+        return isEnqueued;
+    }
+
+    bool dequeue(UdpDgram& dgram) noexcept {
+
+        bool isDequeued = _isSpsc ? _spscQueue.dequeue(dgram) : _mpmcQueue.dequeue(dgram);
+        if (isDequeued)
+            NotifyRoom();
+
+        return isDequeued;
+    }
+
+    size_t dequeueBulk(UdpDgram* pDgrams, size_t nbMaxDgrams) noexcept {
+
+        size_t nbDequeued = _isSpsc ? _spscQueue.dequeueBulk(pDgrams, nbMaxDgrams) : _mpmcQueue.dequeueBulk(pDgrams, nbMaxDgrams);
+        if (nbDequeued > 0)
+            NotifyRoom();
+
+        return nbDequeued;
+    }
+
+    //! used by the user: waits up to `timeout` for a dgram - spins for a moment, then sleeps
+    //! until the next enqueue, instead of polling `dequeue`.
+    bool dequeueWait(UdpDgram& dgram, std::chrono::nanoseconds timeout) noexcept {
+
+        bool isDequeued = _isSpsc ? _spscQueue.dequeueWait(dgram, timeout) : _mpmcQueue.dequeueWait(dgram, timeout);
+        if (isDequeued)
+            NotifyRoom();
+
+        return isDequeued;
+    }
+
+    //! used by the engine: sets the wakeup to notify, when a dgram arrives into the armed queue.
+    void setWakeup(UdpWakeup::SPtr pWakeup) noexcept {
+        std::atomic_store_explicit(&_pWakeup, std::move(pWakeup), std::memory_order_release);
+    }
+
+    //! used by the engine: the next enqueue notifies the wakeup; the queue must be checked
+    //! once more after arming, since a dgram could have arrived right before it.
+    void armWakeup() noexcept {
+        _isArmed.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void disarmWakeup() noexcept { _isArmed.store(false, std::memory_order_relaxed); }
+
+private:
+
+    //! the longest a producer sleeps on a missed notification of a dequeue.
+    static constexpr std::chrono::nanoseconds RoomWaitSlice = std::chrono::milliseconds(1);
+
+    void NotifyRoom() noexcept {
+
+        // the fence of the notification is paid only while a producer waits for room
+        if (_nbRoomWaiters.load(std::memory_order_relaxed) > 0)
+            _roomWait.notify();
+    }
+
+    void NotifyIfArmed() noexcept {
+
+        // pairs with the fence in armWakeup: either the engine sees the dgram or we see the flag
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (_isArmed.load(std::memory_order_relaxed) && _isArmed.exchange(false, std::memory_order_acq_rel)) {
+            UdpWakeup::SPtr pWakeup = std::atomic_load_explicit(&_pWakeup, std::memory_order_acquire);
+            if (pWakeup)
+                pWakeup->notify(this);
+        }
+    }
+
+    const bool _isSpsc;
+
+    // only the queue picked at the construction has a buffer
+    udp::MpmcBoundedQueue<UdpDgram, udp::ParkingWait> _mpmcQueue;
+    udp::SpscBoundedQueue<UdpDgram, udp::ParkingWait> _spscQueue;
+
+    udp::ParkingWait      _roomWait;         ///< producers waiting for room, notified by dequeues
+    std::atomic<uint32_t> _nbRoomWaiters{0}; ///< producers inside enqueueWait
+
+    std::atomic<bool> _isArmed{false};
+
+    UdpWakeup::SPtr _pWakeup;
+};
 
 
 class IUdpUser {
@@ -34,6 +194,17 @@ public:
                       , UdpDgramQueue::SPtr pInputQueue
                       , UdpDgramQueue::SPtr pOutputQueue ) noexcept = 0;
 
+    //! called instead of `setUp` for every shard of a socket attached with per-shard queues;
+    //! by default only the first shard is set up, so its queues are the only ones served.
+    virtual void setUpShard( size_t shardIndex
+                           , int socketId
+                           , UdpDgramQueue::SPtr pInputQueue
+                           , UdpDgramQueue::SPtr pOutputQueue ) noexcept
+    {
+        if (0 == shardIndex)
+            setUp(socketId, pInputQueue, pOutputQueue);
+    }
+
     //! might be called from different threads, should not use methods of the UdpEngine.
     virtual void notifyInvalid() noexcept = 0;
 
@@ -45,65 +216,249 @@ enum class UdpRole {
 };
 
 
+//! how dgrams of a sharded socket are exposed to the user.
+enum class UdpShardQueues {
+    Merged,  ///< all shards share one input and one output queue; only the first shard sends
+    PerShard ///< every shard has its own queues (see IUdpUser::setUpShard)
+};
+
+
+//! what the engine thread does with a recieved dgram, which doesn't fit the input queue of a socket.
+enum class UdpOverflowPolicy {
+    DropNewest, ///< the recieved dgram is dropped; the queue keeps the older ones
+    DropOldest, ///< the oldest queued dgram is evicted to make room - consumers see the latest data
+    Spill       ///< the dgram waits in a per-socket spill ring and is moved to the input queue, as soon
+                ///< as there is room; dropped only if the spill ring is full as well
+};
+
+
+//! settings of a socket, which are checked by UdpEngine::attachSocket - the attach fails if any of
+//! them is invalid. The kernel adjusts some of them (e.g. linux doubles the buffer sizes and clamps
+//! them by net.core.rmem_max/wmem_max), so UdpEngine::socketConfig reads back the effective values.
+struct UdpSocketConfig {
+    static constexpr size_t DefaultQueueSize = 512;
+    static constexpr size_t DefaultRecieveBatchSize = 16;
+    static constexpr size_t DefaultMaxDgramSize = 1024; ///< what recieve buffers fit without large dgrams
+    static constexpr size_t MaxDgramSize = 65507;       ///< max udp payload over ipv4
+
+    size_t mInputQueueSize{DefaultQueueSize};  ///< dgrams; rounded up to a power of 2
+    size_t mOutputQueueSize{DefaultQueueSize}; ///< dgrams; rounded up to a power of 2
+
+    //! Spsc only if a single thread of the user consumes the input queue; not allowed with the
+    //! DropOldest policy, since the engine thread evicts dgrams from the input queue then.
+    UdpQueueConcurrency mInputQueueConcurrency{UdpQueueConcurrency::Mpmc};
+    //! Spsc only if a single thread of the user produces into the output queue.
+    UdpQueueConcurrency mOutputQueueConcurrency{UdpQueueConcurrency::Mpmc};
+
+    size_t mRecieveBatchSize{DefaultRecieveBatchSize}; ///< see UdpEngine::setRecieveBatchSize
+
+    //! either DefaultMaxDgramSize or MaxDgramSize, which enables large dgrams (see
+    //! UdpEngine::setLargeDgrams) - recieve buffers don't come in other sizes.
+    size_t mMaxDgramSize{DefaultMaxDgramSize};
+
+    int mRecieveBufferSize{0}; ///< SO_RCVBUF in bytes; zero keeps the system default
+    int mSendBufferSize{0};    ///< SO_SNDBUF in bytes; zero keeps the system default
+    int mBusyPollUs{0};        ///< SO_BUSY_POLL in microseconds (linux only); zero keeps it off
+
+    bool mIsSegmentationOffload{true}; ///< UDP GSO, if the kernel supports it
+    //! UDP GRO, if the kernel supports it (select and epoll backends only): same-size dgrams of a
+    //! peer are recieved as one coalesced buffer and split without copies.
+    bool mIsRecieveOffload{false};
+
+    UdpOverflowPolicy mOverflowPolicy{UdpOverflowPolicy::DropNewest};
+    size_t mSpillSize{DefaultQueueSize}; ///< Spill only: dgrams; rounded up to a power of 2
+};
+
+
+//! readiness backend used by the engine threads; picked once at the engine construction.
+enum class UdpEngineBackend {
+    Auto,   ///< the best backend available on the platform (falls back to Select)
+    Select, ///< portable, but limited by FD_SETSIZE and O(max socket id) per step
+    Epoll,  ///< linux only, edge-triggered; per step cost depends on the ready sockets only
+    IoUring ///< linux only, completion based: multishot recvmsg into kernel-provided buffers and
+            ///< batched sendmsg submissions; falls back to Epoll if the kernel lacks support
+};
+
+
+//! how the engine picks a thread for a newly attached (or rebalanced) socket.
+enum class UdpBalancePolicy {
+    FewestSockets, ///< the thread serving the fewest sockets
+    LowestRate     ///< the thread with the lowest recent rate of sent and recieved dgrams
+};
+
+
+class UdpReactor;
+
+
 class UdpEngine /*final*/ {
     NOCOPY(UdpEngine)
     NOMOVE(UdpEngine)
 public:
 
+    struct Stats {
+        int mNbSent{0};
+        int mNbRecieved{0};
+        int mNbInputDropped{0};
+        int mNbSendFails{0};       ///< dgrams, which failed to send with other errors than EAGAIN - dropped
+        int mNbRecievesFails{0};
+        int mNbRecieveCalls{0};    ///< recieve syscalls, which returned at least one dgram
+        int mNbSendCalls{0};       ///< send syscalls, which sent at least one dgram
+        int mNbSegmentedDgrams{0}; ///< dgrams sent as segments of UDP GSO sends
+        int mNbCoalescedDgrams{0}; ///< dgrams recieved as segments of UDP GRO buffers
+        int mNbDrains{0};          ///< times a socket moved dgrams in one direction within a step
+        int mMaxDrainedDgrams{0};  ///< the most dgrams (or GRO buffers) a socket moved in one drain
+        int mNbSpentQuantums{0};   ///< drains, which spent the whole quantum
+        int mNbUnresolvedDgrams{0}; ///< dgrams addressed to an unknown or expired peer id - dropped
+        int mNbTruncatedDgrams{0};  ///< dgrams larger than the recieve buffers of the socket - dropped
+
+        // overflows of input queues; every dropped dgram is counted in mNbInputDropped as well
+        int mNbDroppedNewest{0}; ///< DropNewest: recieved dgrams, which didn't fit the input queue
+        int mNbDroppedOldest{0}; ///< DropOldest: queued dgrams evicted for the recieved ones
+        int mNbSpilled{0};       ///< Spill: recieved dgrams put into the spill ring
+        int mNbSpillDropped{0};  ///< Spill: recieved dgrams, which didn't fit the spill ring either
+
+        float recievedPerCall() const noexcept {
+            return mNbRecieveCalls > 0 ? (float)mNbRecieved / mNbRecieveCalls : 0.0f;
+        }
+
+        //! average size of the send batch.
+        float sentPerCall() const noexcept {
+            return mNbSendCalls > 0 ? (float)mNbSent / mNbSendCalls : 0.0f;
+        }
+
+        //! average dgrams moved per socket per step (in one direction).
+        float movedPerDrain() const noexcept {
+            return mNbDrains > 0 ? (float)(mNbSent + mNbRecieved) / mNbDrains : 0.0f;
+        }
+
+        Stats& operator += (const Stats& another) noexcept;
+    };
+
+    //! load of one engine thread.
+    struct ThreadLoad {
+        size_t mNbSockets{0};
+        float  mDgramsPerSecond{0.0f}; ///< sent and recieved over the last load window (~0.5 s)
+        Stats  mStats;
+    };
+
+    static constexpr size_t MaxRecieveBatchSize = 64;
+    static constexpr size_t DefaultDrainQuantum = 64;
+
+    static constexpr std::chrono::milliseconds DefaultPeerTimeToLive{60000};
+
     static UdpEngine* GetInstancePtr() noexcept;
 
     UdpResult startUp () noexcept;
     UdpResult tearDown() noexcept;
 
-    UdpResult attachSocket(IUdpUser* pUser, UdpRole role, const UdpAddress& address) noexcept;
+    UdpResult attachSocket( IUdpUser* pUser, UdpRole role, const UdpAddress& address
+                          , const UdpSocketConfig& config = UdpSocketConfig() ) noexcept;
+
+    //! attaches a Server-role user with `nbShards` SO_REUSEPORT sockets bound to the same address,
+    //! each served by its own engine thread; the kernel spreads incoming dgrams over the shards
+    //! by the peer address (linux only - other platforms don't balance unicast dgrams). Recieves
+    //! scale with the shards either way, sends - only with PerShard queues: the merged output
+    //! queue is owned by the thread of the first shard.
+    UdpResult attachShardedSocket( IUdpUser* pUser, const UdpAddress& address
+                                 , size_t nbShards, UdpShardQueues queues
+                                 , const UdpSocketConfig& config = UdpSocketConfig() ) noexcept;
+
     UdpResult detachSocket(IUdpUser* pUser) noexcept;
 
+    //! effective settings of the user socket (of its first shard, if sharded): the kernel values
+    //! of the socket options and the current values of the ones changed since the attach.
+    UdpResult socketConfig(IUdpUser* pUser, UdpSocketConfig* pConfig) noexcept;
+
+    //! sets how many dgrams (or coalesced UDP GRO buffers) the engine pulls from the user socket
+    //! per recieve syscall; the value is clamped to [1, MaxRecieveBatchSize].
+    UdpResult setRecieveBatchSize(IUdpUser* pUser, size_t nbDgrams) noexcept;
+
+    //! enables coalescing of same-size dgrams to the same peer into UDP GSO sends (linux only);
+    //! enabled by default if the kernel supports it. Fails if the kernel doesn't support it.
+    UdpResult setSegmentationOffload(IUdpUser* pUser, bool isEnabled) noexcept;
+
+    //! makes the user socket recieve dgrams of any size (up to 64 KiB), not just 1024 bytes long.
+    //! Small dgrams are recieved the same way, but every slot of the recieve batch takes a 64 KiB
+    //! buffer and, with the io_uring backend, a recieve takes just one dgram. Enabled by the first
+    //! truncated dgram (see Stats::mNbTruncatedDgrams), so enable it beforehand if large dgrams
+    //! are expected.
+    UdpResult setLargeDgrams(IUdpUser* pUser, bool isEnabled) noexcept;
+
+    //! sets how many dgrams an engine thread moves per socket and direction within a step before
+    //! it serves other sockets (a coalesced GRO buffer counts as one), so a busy socket can't
+    //! starve the rest; below the quantum sockets are drained until EAGAIN. Fails for zero.
+    UdpResult setDrainQuantum(size_t nbDgrams) noexcept;
+
+    //! sets how long a peer of the user socket, which sends nothing, keeps its id (see `peers`);
+    //! zero keeps peers forever. Expired ids don't resolve, so replies to them are dropped.
+    UdpResult setPeerTimeToLive(IUdpUser* pUser, std::chrono::milliseconds ttl) noexcept;
+
+    //! peers the user socket recieved dgrams from, with their ids and counters. Recieved dgrams
+    //! are tagged with the peer id, and a dgram addressed by the id only (UdpDgram::clone(UdpPeerId))
+    //! is sent to the peer address.
+    std::vector<UdpPeerInfo> peers(IUdpUser* pUser) noexcept;
+
+    UdpResult findPeer(IUdpUser* pUser, UdpPeerId peer, UdpPeerInfo* pInfo) noexcept;
+
+    //! grows the engine up to `nbThreads` threads; new sockets are spread over the threads by
+    //! the balance policy. The engine never stops threads, so shrinking fails.
+    UdpResult setNbThreads(size_t nbThreads) noexcept;
+
+    void setBalancePolicy(UdpBalancePolicy policy) noexcept;
+
+    //! hands the socket of the user over to the thread `threadIndex`; queued dgrams (in the user
+    //! queues, leftovers and the socket buffer) are kept. Sharded sockets can't be moved, neither
+    //! can sockets with a Spsc input queue on the io_uring backend - they stay on their thread.
+    UdpResult moveSocket(IUdpUser* pUser, size_t threadIndex) noexcept;
+
+    //! moves the socket of the user to the least loaded thread by the balance policy; returns
+    //! eUdpResult_Already if the current thread is the best choice already.
+    UdpResult rebalanceSocket(IUdpUser* pUser) noexcept;
+
+    UdpEngineBackend backend() const noexcept;
+
+    //! load of every engine thread, indexed the same way as in `moveSocket`; doesn't wait for
+    //! the threads, so the stats are the ones published by their last finished steps.
+    std::vector<ThreadLoad> threadsLoad() noexcept;
+
+    //! stats summed over all engine threads.
+    Stats stats() noexcept;
+
+    size_t nbThreads() noexcept;
+
 protected:
 
     UdpEngine() noexcept;
+    explicit UdpEngine(UdpEngineBackend backend) noexcept;
    ~UdpEngine() noexcept;
 
 private:
 
-    void FindAndFixBadSocketId() noexcept;
-    void InvalidateUsersWithLargeSocketId() noexcept;
-
-    struct UserData {
-        UdpAddress mAddress;
-
-        UdpDgramQueue::SPtr mInputQueue;
-        UdpDgramQueue::SPtr mOutputQueue;
-
-        int mSocketId;
-        
-        UdpRole mRole;
+    UdpReactor* AddReactor() noexcept;
 
-        std::list<UdpDgram> mLeftovers;
-    };
+    //! the least loaded reactor by the balance policy, other than `pExcluded`.
+    UdpReactor* PickReactor(const UdpReactor* pExcluded) noexcept;
 
-    struct Stats {
-        int mNbSent{0};
-        int mNbRecieved{0};
-        int mNbInputDropped{0};
-        int mNbSendFails{0};
-        int mNbRecievesFails{0};
-    };
+    UdpResult MoveSocket(IUdpUser* pUser, UdpReactor* pTarget) noexcept;
 
-    struct NativeData;
+    static bool IsValidConfig(const UdpSocketConfig& config) noexcept;
 
-    static Threader::StepResult DoEngineStep(void* pOpaqueSelf);
+    template < typename Method, typename ... Args >
+    UdpResult ForEachUserReactor(IUdpUser* pUser, Method method, Args ... args) noexcept;
 
-    static void SendUdpUserDgrams   (UserData& udata, Stats* pStats);
-    static void RecieveUdpUserDgrams(UserData& udata, Stats* pStats);
+    UdpEngineBackend _backend;
+    UdpBalancePolicy _balancePolicy{UdpBalancePolicy::FewestSockets};
 
-    std::mutex                              _usersTableM;
-    std::unordered_map<IUdpUser*, UserData> _usersTable;
+    size_t _drainQuantum{DefaultDrainQuantum}; ///< guarded by the reactors lock
 
-    NativeData* _pNativeData;
+    std::mutex                               _reactorsM; ///< guards the attachments as well
+    std::vector<std::unique_ptr<UdpReactor>> _reactors;
 
-    Threader::UPtr _pThreader;
+    /// reactors serving the user: a single one or one per shard
+    std::unordered_map<IUdpUser*, std::vector<UdpReactor*>> _attachments;
 
-    Stats _stats;
+    /// peer table of every attached user, shared by the shards of its socket
+    std::unordered_map<IUdpUser*, UdpPeerTable::SPtr> _peerTables;
 };
 
 
@@ -0,0 +1,163 @@
+#include "sockets/udppeers.hpp"
+
+#include <algorithm>
+
+
+/// low bits of a peer id keep the slot index plus one (so 0 is never an id), high bits - the slot generation
+#define PEER_INDEX_BITS 20
+#define PEER_INDEX_MASK ((1u << PEER_INDEX_BITS) - 1)
+
+/// idle peers are looked for at most this many times per time to live
+#define PEER_EXPIRY_CHECKS_PER_TTL 4
+
+
+using namespace udp;
+using namespace sockets::priv;
+
+
+UdpPeerTable::UdpPeerTable(std::chrono::milliseconds ttl) noexcept
+    : _ttl(ttl)
+{}
+
+
+sockets::UdpPeerId UdpPeerTable::intern(const UdpAddress& address, size_t nbDgrams, size_t nbBytes, Clock::time_point now) noexcept {
+
+    TRY_LOCKED(_peers) {
+        uint32_t index;
+
+        auto foundIt = _slotIndices.find(address);
+        if (_slotIndices.end() != foundIt) {
+            index = foundIt->second;
+        } else {
+            if (!_freeSlots.empty()) {
+                index = _freeSlots.back();
+                _freeSlots.pop_back();
+            } else if (_slots.size() < MaxNbPeers) {
+                index = (uint32_t)_slots.size();
+                _slots.emplace_back();
+            } else {
+                return 0;
+            }
+
+            _slotIndices.emplace(address, index);
+
+            Slot& slot = _slots[index];
+            slot.mIsUsed = true;
+            slot.mInfo = UdpPeerInfo();
+            slot.mInfo.mId = ((slot.mGeneration << PEER_INDEX_BITS) | (index + 1));
+            slot.mInfo.mAddress = address;
+        }
+
+        UdpPeerInfo& info = _slots[index].mInfo;
+        info.mNbRecieved += nbDgrams;
+        info.mNbRecievedBytes += nbBytes;
+        info.mLastSeenTp = now;
+
+        return info.mId;
+    } UNLOCK;
+
+    return 0;
+}
+
+
+bool UdpPeerTable::resolve(UdpPeerId id, UdpAddress* pAddress) noexcept {
+
+    TRY_LOCKED(_peers) {
+        Slot* pSlot = FindSlot(id);
+        if (!pSlot)
+            return false;
+
+        *pAddress = pSlot->mInfo.mAddress;
+
+        return true;
+    } UNLOCK;
+
+    return false;
+}
+
+
+bool UdpPeerTable::find(UdpPeerId id, UdpPeerInfo* pInfo) noexcept {
+
+    TRY_LOCKED(_peers) {
+        ExpireIdlePeers(Clock::now());
+
+        Slot* pSlot = FindSlot(id);
+        if (!pSlot)
+            return false;
+
+        *pInfo = pSlot->mInfo;
+
+        return true;
+    } UNLOCK;
+
+    return false;
+}
+
+
+std::vector<UdpPeerInfo> UdpPeerTable::peers() noexcept {
+
+    std::vector<UdpPeerInfo> result;
+
+    TRY_LOCKED(_peers) {
+        ExpireIdlePeers(Clock::now());
+
+        result.reserve(_slotIndices.size());
+        for (const Slot& slot : _slots) {
+            if (slot.mIsUsed)
+                result.push_back(slot.mInfo);
+        }
+    } UNLOCK;
+
+    return result;
+}
+
+
+void UdpPeerTable::expireIdlePeers(Clock::time_point now) noexcept {
+
+    TRY_LOCKED(_peers) {
+        ExpireIdlePeers(now);
+    } UNLOCK;
+}
+
+
+void UdpPeerTable::setTimeToLive(std::chrono::milliseconds ttl) noexcept {
+
+    TRY_LOCKED(_peers) {
+        _ttl = ttl;
+        _nextExpiryTp = Clock::time_point();
+    } UNLOCK;
+}
+
+
+auto UdpPeerTable::FindSlot(UdpPeerId id) noexcept -> Slot* {
+
+    uint32_t indexPlusOne = id & PEER_INDEX_MASK;
+    if (0 == indexPlusOne || indexPlusOne > _slots.size())
+        return nullptr;
+
+    Slot& slot = _slots[indexPlusOne - 1];
+
+    return (slot.mIsUsed && slot.mInfo.mId == id) ? &slot : nullptr;
+}
+
+
+void UdpPeerTable::ExpireIdlePeers(Clock::time_point now) noexcept {
+
+    if (_ttl.count() <= 0 || now < _nextExpiryTp)
+        return;
+
+    _nextExpiryTp = now + std::max<std::chrono::milliseconds>(_ttl / PEER_EXPIRY_CHECKS_PER_TTL, std::chrono::milliseconds(1));
+
+    for (uint32_t index = 0; index < (uint32_t)_slots.size(); ++index) {
+        Slot& slot = _slots[index];
+        if (!slot.mIsUsed || now - slot.mInfo.mLastSeenTp <= _ttl)
+            continue;
+
+        _slotIndices.erase(slot.mInfo.mAddress);
+
+        slot.mIsUsed = false;
+        slot.mGeneration = (slot.mGeneration + 1) & (UINT32_MAX >> PEER_INDEX_BITS);
+
+        _freeSlots.push_back(index);
+    }
+}
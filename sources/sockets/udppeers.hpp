@@ -0,0 +1,93 @@
+#ifndef UDP_SOCKETS_UDPPEERS_HPP_
+#define UDP_SOCKETS_UDPPEERS_HPP_
+
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "commons/macros.h"
+#include "commons/types.h"
+
+#include "sockets/udpaddress.hpp"
+#include "sockets/udpdgram.hpp"
+
+
+namespace udp { ;
+namespace sockets { ;
+namespace priv { ;
+
+
+struct UdpPeerInfo {
+    UdpPeerId  mId{0};
+    UdpAddress mAddress;
+
+    uint64_t mNbRecieved{0};      ///< dgrams recieved from the peer
+    uint64_t mNbRecievedBytes{0};
+
+    std::chrono::steady_clock::time_point mLastSeenTp; ///< when the last dgram was recieved
+};
+
+
+//! source addresses seen by a socket (all shards of a sharded one), interned into compact ids.
+//! Peers, which sent nothing for the time to live, are expired lazily and their ids aren't
+//! reused for a while (4096 generations per slot), so a stale id rather fails to resolve.
+class UdpPeerTable final {
+    NOCOPY(UdpPeerTable)
+    NOMOVE(UdpPeerTable)
+public:
+
+    using SPtr = std::shared_ptr<UdpPeerTable>;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MaxNbPeers = (1u << 20) - 1;
+
+    //! zero `ttl` keeps peers forever.
+    explicit UdpPeerTable(std::chrono::milliseconds ttl) noexcept;
+
+    //! counts `nbDgrams` with `nbBytes` in total from the peer; returns its id, or 0 if the table is full.
+    //! Doesn't expire idle peers, so the recieve path never pays for a sweep.
+    UdpPeerId intern(const UdpAddress& address, size_t nbDgrams, size_t nbBytes, Clock::time_point now) noexcept;
+
+    //! sweeps idle peers out, at most a few times per time to live; called by the engine threads.
+    void expireIdlePeers(Clock::time_point now) noexcept;
+
+    bool resolve(UdpPeerId id, UdpAddress* pAddress) noexcept;
+
+    bool find(UdpPeerId id, UdpPeerInfo* pInfo) noexcept;
+
+    std::vector<UdpPeerInfo> peers() noexcept;
+
+    void setTimeToLive(std::chrono::milliseconds ttl) noexcept;
+
+private:
+
+    struct Slot {
+        UdpPeerInfo mInfo;
+        uint32_t    mGeneration{0};
+        bool        mIsUsed{false};
+    };
+
+    //! must be called with the peers lock taken.
+    Slot* FindSlot(UdpPeerId id) noexcept;
+    void  ExpireIdlePeers(Clock::time_point now) noexcept;
+
+    std::mutex _peersM; ///< guards everything below: the table is shared by the shard threads and readers
+
+    std::unordered_map<UdpAddress, uint32_t> _slotIndices;
+    std::vector<Slot>                        _slots;
+    std::vector<uint32_t>                    _freeSlots;
+
+    std::chrono::milliseconds _ttl;
+    Clock::time_point         _nextExpiryTp;
+};
+
+
+} // namespace priv
+} // namespace sockets
+} // namespace udp
+
+
+#endif//UDP_SOCKETS_UDPPEERS_HPP_
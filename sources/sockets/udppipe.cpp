@@ -1 +1,182 @@
 #include "sockets/udppipe.hpp"
+
+#include "commons/logger.hpp"
+
+#include "sockets/udpaddress.hpp"
+
+
+/// waits without a timeout are split into chunks of this length, so a failed socket is noticed
+#define PIPE_WAIT_CHUNK_MS 100
+
+
+using namespace udp;
+using namespace sockets;
+using namespace sockets::priv;
+
+
+namespace {
+
+
+//! calls `waitFor(timeout)` until it succeeds, the timeout passes or the pipe turns invalid.
+template < typename WaitFor >
+UdpResult WaitInChunks(WaitFor waitFor, int32_t msTimeout, const std::atomic<bool>& isValid) noexcept {
+
+    if (msTimeout >= 0) {
+        if (waitFor(std::chrono::milliseconds(msTimeout)))
+            return eUdpResult_Ok;
+
+        return isValid.load(std::memory_order_acquire) ? eUdpResult_Timeout : eUdpResult_Failed;
+    }
+
+    while (isValid.load(std::memory_order_acquire)) {
+        if (waitFor(std::chrono::milliseconds(PIPE_WAIT_CHUNK_MS)))
+            return eUdpResult_Ok;
+    }
+
+    return eUdpResult_Failed;
+}
+
+
+}
+
+
+UdpPipe::UdpPipe() noexcept
+    : _pEngine(nullptr)
+{}
+
+
+UdpPipe::UdpPipe(UdpEngine* pEngine) noexcept
+    : _pEngine(pEngine)
+{}
+
+
+UdpPipe::~UdpPipe() noexcept {
+
+    if (opened()) {
+        close();
+    }
+}
+
+
+UdpResult UdpPipe::open(PipeEndType type, const char* address, int16_t port) noexcept {
+
+    if (_pAttachedEngine) {
+        LOGE << "Trying to open already opened pipe";
+        return eUdpResult_Already;
+    }
+
+    UdpEngine* pEngine = _pEngine ? _pEngine : UdpEngine::GetInstancePtr();
+    if (!pEngine)
+        return eUdpResult_Failed;
+
+    UdpResult res = pEngine->startUp();
+    if (eUdpResult_Ok != res && eUdpResult_Already != res) {
+        LOGE << "Failed to start the engine for the pipe";
+        return res;
+    }
+
+    // the engine thread and the single reader (or writer) of the pipe are the only ends of its queue
+    UdpSocketConfig config;
+    UdpRole role;
+    if (PipeEndType::Read == type) {
+        role = UdpRole::Server;
+        config.mInputQueueConcurrency = UdpQueueConcurrency::Spsc;
+    } else {
+        role = UdpRole::Client;
+        config.mOutputQueueConcurrency = UdpQueueConcurrency::Spsc;
+    }
+
+    _type = type;
+
+    // set beforehand, so a failure reported right after the attach isn't overwritten
+    _isValid.store(true, std::memory_order_release);
+
+    res = pEngine->attachSocket(this, role, UdpAddress(address, (uint16_t)port), config);
+    if (eUdpResult_Ok != res) {
+        _isValid.store(false, std::memory_order_release);
+        return res;
+    }
+
+    _pAttachedEngine = pEngine;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpPipe::close() noexcept {
+
+    if (!_pAttachedEngine)
+        return eUdpResult_Already;
+
+    UdpResult res = eUdpResult_Ok;
+
+    // the shared engine might be gone already, if the pipe is closed at the app exit
+    if (_pEngine || UdpEngine::GetInstancePtr()) {
+        res = _pAttachedEngine->detachSocket(this);
+    }
+
+    _pAttachedEngine = nullptr;
+    _isValid.store(false, std::memory_order_release);
+
+    _pInputQueue.reset();
+    _pOutputQueue.reset();
+
+    return res;
+}
+
+
+bool UdpPipe::opened() const noexcept {
+
+    return !!_pAttachedEngine;
+}
+
+
+UdpResult UdpPipe::readDatagram(UdpDgram& outPacket, int32_t msTimeout) noexcept {
+
+    if (!_pInputQueue || PipeEndType::Read != _type) {
+        LOGE << "Trying to read from a pipe, which isn't an opened read end";
+        return eUdpResult_Failed;
+    }
+
+    // dgrams recieved before a failure are still read out
+    if (_pInputQueue->dequeue(outPacket))
+        return eUdpResult_Ok;
+
+    return WaitInChunks([this, &outPacket](std::chrono::milliseconds timeout) {
+        return _pInputQueue->dequeueWait(outPacket, timeout);
+    }, msTimeout, _isValid);
+}
+
+
+UdpResult UdpPipe::writeDatagram(UdpDgram&& inPacket, int32_t msTimeout) noexcept {
+
+    if (!_pOutputQueue || PipeEndType::Write != _type) {
+        LOGE << "Trying to write into a pipe, which isn't an opened write end";
+        return eUdpResult_Failed;
+    }
+
+    if (!_isValid.load(std::memory_order_acquire))
+        return eUdpResult_Failed;
+
+    return WaitInChunks([this, &inPacket](std::chrono::milliseconds timeout) {
+        return _pOutputQueue->enqueueWait(std::move(inPacket), timeout);
+    }, msTimeout, _isValid);
+}
+
+
+void UdpPipe::setUp( int socketId
+                   , UdpDgramQueue::SPtr pInputQueue
+                   , UdpDgramQueue::SPtr pOutputQueue ) noexcept
+{
+    UNUSED(socketId);
+
+    _pInputQueue = pInputQueue;
+    _pOutputQueue = pOutputQueue;
+}
+
+
+void UdpPipe::notifyInvalid() noexcept {
+
+    // also comes on the detach, so waits of a closed pipe give up too
+    _isValid.store(false, std::memory_order_release);
+}
@@ -2,6 +2,7 @@
 #define UDP_SOCKETS_UDPPIPE_HPP_
 
 
+#include <atomic>
 #include <cinttypes>
 #include <memory>
 
@@ -9,19 +10,33 @@
 #include "commons/types.h"
 
 #include "sockets/udpdgram.hpp"
+#include "sockets/udpengine.hpp"
 
 
 namespace udp { ;
 namespace sockets { ;
 
 
-class UdpPipe {
+//! an end of a pipe of dgrams served by the UdpEngine: the read end is a server socket bound to
+//! the address, the write end is a client socket sending to it. Timed reads and writes spin for
+//! a moment and then sleep on the pipe queue, until the engine (or the peer thread) wakes them.
+//! A pipe end is read or written by a single thread at a time; `open` and `close` must not race
+//! with the reads and writes.
+class UdpPipe final : private priv::IUdpUser {
+    NOCOPY(UdpPipe)
+    NOMOVE(UdpPipe)
 public:
 
     enum class PipeEndType {
         Read, Write
     };
 
+    //! the pipe is served by the shared engine (see UdpEngine::GetInstancePtr).
+    UdpPipe() noexcept;
+
+    //! the pipe is served by the given engine, which must outlive it.
+    explicit UdpPipe(priv::UdpEngine* pEngine) noexcept;
+
    ~UdpPipe() noexcept;
 
     UdpResult open(PipeEndType type, const char* address, int16_t port) noexcept;
@@ -29,8 +44,31 @@ public:
 
     bool opened() const noexcept;
 
+    //! a negative timeout waits until a dgram arrives or the socket fails; returns
+    //! eUdpResult_Timeout, if no dgram arrived in time.
     UdpResult readDatagram(UdpDgram& outPacket, int32_t msTimeout) noexcept;
+
+    //! waits for room in the pipe queue, if it's full (see readDatagram for the timeout); the
+    //! packet is moved only if it's written.
     UdpResult writeDatagram(UdpDgram&& inPacket, int32_t msTimeout) noexcept;
+
+private:
+
+    void setUp( int socketId
+              , priv::UdpDgramQueue::SPtr pInputQueue
+              , priv::UdpDgramQueue::SPtr pOutputQueue ) noexcept override;
+
+    void notifyInvalid() noexcept override;
+
+    priv::UdpEngine* _pEngine;
+    priv::UdpEngine* _pAttachedEngine{nullptr};
+
+    PipeEndType _type{PipeEndType::Read};
+
+    priv::UdpDgramQueue::SPtr _pInputQueue;
+    priv::UdpDgramQueue::SPtr _pOutputQueue;
+
+    std::atomic<bool> _isValid{false};
 };
 
 
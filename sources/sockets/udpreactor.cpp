@@ -0,0 +1,2624 @@
+#include "sockets/udpreactor.hpp"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+#   include <netinet/udp.h>
+#   include <poll.h>
+#   include <sys/epoll.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "commons/logger.hpp"
+#include "commons/payloadpool.hpp"
+#include "commons/utils.hpp"
+
+#include "sockets/iouring.hpp"
+
+
+#define DGRAM_MAXLINE UdpSocketConfig::DefaultMaxDgramSize
+#define DGRAM_TRIM_SIZE (DGRAM_MAXLINE / 8) /// smaller dgrams are copied out, so they don't pin a whole recieve buffer
+#define DGRAM_RECV_BATCH_MAX UdpEngine::MaxRecieveBatchSize
+#define DGRAM_SEND_BATCH_MAX 64 /// max number of dgrams sent per syscall
+
+#define GSO_MAX_SEGMENTS 64   /// UDP_MAX_SEGMENTS of older kernels
+#define GSO_MAX_SIZE 65507    /// max udp payload over ipv4
+
+#define STORAGE_SIZE 65535 /// fits any udp dgram and any coalesced GRO buffer
+
+#define ENGINE_WAIT_TIMEOUT_MS 1000
+#define SPILL_RETRY_TIMEOUT_MS 1   /// how soon a thread with spilled dgrams looks for room in the input queues again
+#define OVERFLOW_MAX_EVICTIONS 4   /// DropOldest: consumers and other shards may take the freed cell first
+#define LOAD_RATE_WINDOW_MS 500
+#define EPOLL_MAX_EVENTS 256
+
+#define USERS_MAX_PENDING_VERSIONS 16 /// published users table versions the reactor thread may lag behind
+
+#define PEER_CACHE_LOOKBACK 8       /// latest peers of a batch looked through for the source of a dgram
+#define PEERS_EXPIRY_PERIOD_MS 100  /// how often the reactor thread lets the peer tables sweep idle peers
+
+#define URING_QUEUE_SIZE 1024
+#define URING_BUFFERS_GROUP 1
+#define URING_NB_BUFFERS 1024
+#define URING_BUFFER_SIZE (sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + DGRAM_MAXLINE)
+#define URING_NB_SEND_OPS 512
+#define URING_SEND_OP_TAG 1 /// low bit of the completion user data: send op or recieve op
+#define URING_WAKEUP_DATA 2 /// completion user data of the wakeup poll
+
+
+#if !defined(FD_COPY)
+#   define FD_COPY(From, To) memcpy((To), (From), sizeof(fd_set))
+#endif
+
+
+using namespace udp;
+using namespace sockets::priv;
+
+
+//! sources of the dgrams recieved by one batch (or one reap of io_uring completions): dgrams of
+//! a peer are counted together, so a peer table is locked once per batch and peer, rather than
+//! for every dgram; used by the engine thread only.
+struct UdpReactor::PeerCache {
+    struct Entry {
+        UdpPeerTable* mpPeers{nullptr};
+        UdpAddress    mSource;
+        size_t        mNbDgrams{0};
+        size_t        mNbBytes{0};
+        UdpPeerId     mId{0}; ///< set by `intern`
+    };
+
+    std::vector<Entry> mEntries;
+
+    PeerCache() noexcept { mEntries.reserve(DGRAM_RECV_BATCH_MAX); }
+
+    //! returns the index of the entry of the source.
+    size_t add(UdpPeerTable* pPeers, const void* pAddress, size_t szAddress, size_t nbDgrams, size_t nbBytes) noexcept {
+
+        UdpAddress source = UdpAddress::FromNativeData(pAddress, szAddress);
+
+        // dgrams of a peer mostly come in runs, so only the latest peers are looked through;
+        // a peer missed here just takes one more entry
+        const size_t nbEntries = mEntries.size();
+        for (size_t i = nbEntries; i > 0 && i + PEER_CACHE_LOOKBACK > nbEntries; --i) {
+            Entry& entry = mEntries[i - 1];
+            if (entry.mpPeers == pPeers && entry.mSource == source) {
+                entry.mNbDgrams += nbDgrams;
+                entry.mNbBytes += nbBytes;
+                return i - 1;
+            }
+        }
+
+        mEntries.push_back(Entry{pPeers, source, nbDgrams, nbBytes, 0});
+
+        return nbEntries;
+    }
+
+    void intern(UdpPeerTable::Clock::time_point now) noexcept {
+
+        for (Entry& entry : mEntries) {
+            if (entry.mpPeers) {
+                entry.mId = entry.mpPeers->intern(entry.mSource, entry.mNbDgrams, entry.mNbBytes, now);
+            }
+        }
+    }
+
+    const Entry& operator [] (size_t index) const noexcept { return mEntries[index]; }
+
+    void clear() noexcept { mEntries.clear(); }
+};
+
+
+//! pre-allocated storage for batched recieves; used by the engine thread only.
+struct UdpReactor::RecieveBatch {
+    /// dgrams are recieved right into buffers of the payload pool, which are handed over to the
+    /// recieved dgrams; a slot gets a new buffer before the next recieve into it.
+    uint8_t*    mPayloads[DGRAM_RECV_BATCH_MAX]{};
+    sockaddr_in mAddresses[DGRAM_RECV_BATCH_MAX];
+
+    /// sockets with UDP GRO or large dgrams recieve into the payload buffer first and into the
+    /// storage (a pooled buffer) past its first DGRAM_MAXLINE bytes then; a single dgram, which
+    /// fits the payload buffer, is taken over with it, larger ones are copied out of the storage,
+    /// while coalesced dgrams are moved to the head of the storage, which the split dgrams slice.
+    /// A storage is allocated on the first recieve into its slot and again once handed over, so
+    /// the batch holds as many storages, as the largest recieve batch of such sockets.
+    uint8_t* mStorages[DGRAM_RECV_BATCH_MAX]{};
+
+    PeerCache mPeers;
+    size_t    mPeerIndices[DGRAM_RECV_BATCH_MAX]; ///< entries of the dgram sources in `mPeers`
+
+    ~RecieveBatch() noexcept {
+
+        for (uint8_t* pPayload : mPayloads) {
+            PayloadPool::Release(pPayload);
+        }
+
+        for (uint8_t* pStorage : mStorages) {
+            PayloadPool::Release(pStorage);
+        }
+    }
+
+    //! returns false if out of memory.
+    bool preparePayload(size_t index) noexcept {
+
+        if (!mPayloads[index])
+            mPayloads[index] = PayloadPool::GetInstancePtr()->allocate(DGRAM_MAXLINE);
+
+#if defined(__linux__)
+        mIovs[index].iov_base = mPayloads[index];
+#endif
+        return !!mPayloads[index];
+    }
+
+    //! returns false if out of memory.
+    bool prepareStorage(size_t index) noexcept {
+
+        if (!mStorages[index])
+            mStorages[index] = PayloadPool::GetInstancePtr()->allocate(STORAGE_SIZE);
+
+        return !!mStorages[index];
+    }
+
+#if defined(__linux__)
+    iovec   mIovs[DGRAM_RECV_BATCH_MAX];
+    mmsghdr mHeaders[DGRAM_RECV_BATCH_MAX];
+
+    iovec mStorageIovs[DGRAM_RECV_BATCH_MAX][2];
+
+    alignas(cmsghdr) uint8_t mGroControls[DGRAM_RECV_BATCH_MAX][CMSG_SPACE(sizeof(int))];
+
+    RecieveBatch() noexcept {
+
+        memset(mHeaders, 0, sizeof(mHeaders));
+
+        for (size_t i = 0; i < DGRAM_RECV_BATCH_MAX; ++i) {
+            mIovs[i].iov_base = nullptr;
+            mIovs[i].iov_len = DGRAM_MAXLINE;
+
+            mHeaders[i].msg_hdr.msg_iov = &mIovs[i];
+            mHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+#endif
+};
+
+
+//! dgrams dequeued for one batched send; used by the engine thread only.
+struct UdpReactor::SendBatch {
+    UdpDgram mDgrams[DGRAM_SEND_BATCH_MAX];
+
+#if defined(__linux__)
+    iovec   mIovs[DGRAM_SEND_BATCH_MAX * UdpDgram::MaxSegments];
+    mmsghdr mHeaders[DGRAM_SEND_BATCH_MAX];
+    size_t  mNbSegments[DGRAM_SEND_BATCH_MAX]; ///< dgrams coalesced into the header
+
+    alignas(cmsghdr) uint8_t mControls[DGRAM_SEND_BATCH_MAX][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+};
+
+
+struct UdpReactor::NativeData {
+    UdpEngineBackend mBackend;
+
+    UdpWakeup::SPtr mpWakeup;
+
+    /// users with something to send; output queues of the rest are armed to notify the wakeup
+    std::vector<UserData*> mPendingOutput;
+
+    std::vector<UserData*> mPendingSpills; ///< users with spilled dgrams
+
+    std::unordered_map<const void*, UserData*> mOutputQueueUsers; ///< notifier -> user
+    std::vector<const void*>                   mNotifiers;
+
+    std::vector<UsersSnapshot*> mMissedUsers; ///< scratch of ApplyUsersSnapshot
+
+    fd_set mAllSockets; /// @NOTE(stoned_fox): since this is a reflection of the udp users table, this
+                        ///                data is touched by the reactor thread only.
+    int mMaxSocketId;
+
+    RecieveBatch mRecieveBatch;
+    SendBatch    mSendBatch;
+
+#if defined(__linux__)
+    int mEpollId{-1};
+
+    epoll_event mEvents[EPOLL_MAX_EVENTS];
+
+    /// sockets which got an edge and haven't been drained to EAGAIN yet; since epoll
+    /// is edge-triggered, this list is the only memory of the socket readiness.
+    std::vector<UserData*> mReadyToRead;
+
+    struct UringRecvOp {
+        UserData* mpUser; ///< nullptr when the user is detached and the op waits for its cancellation
+        msghdr    mHeader;
+
+        bool mIsCancelled{false};
+        bool mIsSwitching{false}; ///< cancelled to be armed again for large dgrams
+
+        /// provided buffers fit DGRAM_MAXLINE bytes only, so sockets with large dgrams recieve
+        /// one dgram per op (no multishot) into a pooled storage, which the dgram is copied out of.
+        uint8_t*    mpStorage{nullptr};
+        iovec       mStorageIov;
+        sockaddr_in mAddress;
+
+        ~UringRecvOp() noexcept { PayloadPool::Release(mpStorage); }
+
+        /// a moved user lives in another reactor, but dgrams completed before the cancellation
+        /// still have to reach its input queue; this copy keeps the queue until then.
+        std::unique_ptr<UserData> mpMovedUser;
+    };
+
+    /// dgrams of a reap are enqueued once the peers of the whole reap are interned
+    struct ReapedDgram {
+        UserData* mpUser;
+        size_t    mPeerIndex;
+        UdpDgram  mDgram;
+    };
+
+    std::vector<ReapedDgram> mReapedDgrams;
+
+    struct UringSendOp {
+        UserData*  mpUser{nullptr};
+        uint64_t   mSequence{0}; ///< the order of submission
+        UdpDgram   mDgram;
+        UdpAddress mAddress; ///< the destination; the header points to it until the completion
+        msghdr     mHeader;
+        iovec      mIovs[UdpDgram::MaxSegments];
+    };
+
+    IoUring mRing;
+
+    std::unordered_map<UserData*, UringRecvOp*> mRecvOps;
+    std::vector<UringRecvOp*>                   mCancelledRecvOps;
+
+    std::unique_ptr<UringSendOp[]> mSendOps;
+    std::vector<UringSendOp*>      mFreeSendOps;
+    std::vector<UringSendOp*>      mAgainSendOps; ///< scratch of ReapIoUringCompletions
+    uint64_t                       mNbSubmittedSends{0};
+
+    bool mIsWoken{false}; ///< the wakeup poll completed
+
+    void updateEpollEvents(UserData& udata) noexcept {
+
+        // writability is watched only while a send is blocked - udp sockets are almost always writable
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        if (udata.mIsWriteBlocked)
+            ev.events |= EPOLLOUT;
+        ev.data.ptr = &udata;
+
+        if (0 != epoll_ctl(mEpollId, EPOLL_CTL_MOD, udata.mSocketId, &ev)) {
+            LOGE << "Failed to modify socket events in epoll (errno == " << errno << ")";
+        }
+    }
+
+    io_uring_sqe* getSqe() noexcept {
+
+        io_uring_sqe* pSqe = mRing.getSqe();
+        if (!pSqe) {
+            // submission queue is full - flush it and try again
+            mRing.submit();
+            pSqe = mRing.getSqe();
+        }
+
+        return pSqe;
+    }
+
+    void prepareRecieve(io_uring_sqe* pSqe, UringRecvOp* pOp, int socketId) noexcept {
+
+        memset(&pOp->mHeader, 0, sizeof(msghdr));
+        pOp->mHeader.msg_namelen = sizeof(sockaddr_in);
+
+        pOp->mIsSwitching = false;
+
+        if (pOp->mpUser && pOp->mpUser->mIsLargeDgrams) {
+            if (!pOp->mpStorage)
+                pOp->mpStorage = PayloadPool::GetInstancePtr()->allocate(STORAGE_SIZE);
+
+            if (pOp->mpStorage) {
+                pOp->mStorageIov.iov_base = pOp->mpStorage;
+                pOp->mStorageIov.iov_len = STORAGE_SIZE;
+
+                pOp->mHeader.msg_name = &pOp->mAddress;
+                pOp->mHeader.msg_iov = &pOp->mStorageIov;
+                pOp->mHeader.msg_iovlen = 1;
+
+                pSqe->opcode = IORING_OP_RECVMSG;
+                pSqe->fd = socketId;
+                pSqe->addr = (uint64_t)&pOp->mHeader;
+                pSqe->len = 1;
+                pSqe->user_data = (uint64_t)pOp;
+
+                return;
+            }
+
+            LOGW << "Failed to allocate a storage for large dgrams - they are truncated";
+        }
+
+        pSqe->opcode = IORING_OP_RECVMSG;
+        pSqe->fd = socketId;
+        pSqe->addr = (uint64_t)&pOp->mHeader;
+        pSqe->len = 1;
+        pSqe->ioprio = IORING_RECV_MULTISHOT;
+        pSqe->flags = IOSQE_BUFFER_SELECT;
+        pSqe->buf_group = mRing.buffersGroup();
+        pSqe->user_data = (uint64_t)pOp;
+    }
+
+    void prepareWakeupPoll(io_uring_sqe* pSqe) noexcept {
+
+        pSqe->opcode = IORING_OP_POLL_ADD;
+        pSqe->fd = mpWakeup->waitId();
+        pSqe->poll32_events = POLLIN;
+        pSqe->user_data = URING_WAKEUP_DATA;
+    }
+#endif
+};
+
+
+#if defined(__linux__)
+
+static bool IsSegmentationOffloadSupported(int socketId) noexcept {
+
+    int segmentSize = 0;
+    socklen_t szOption = sizeof(segmentSize);
+
+    return 0 == getsockopt(socketId, SOL_UDP, UDP_SEGMENT, &segmentSize, &szOption);
+}
+
+#endif
+
+
+//! points `pIovs` to segments of the dgram and returns their number; const access: the payload
+//! can be shared with clones, which mustn't be copied here.
+static size_t GatherSegments(const sockets::UdpDgram& dgram, iovec* pIovs) noexcept {
+
+    const size_t nbSegments = dgram.nbSegments();
+    for (size_t i = 0; i < nbSegments; ++i) {
+        pIovs[i].iov_base = (void*)dgram.segmentData(i);
+        pIovs[i].iov_len = dgram.segmentSize(i);
+    }
+
+    return nbSegments;
+}
+
+
+//! applies the kernel options of the config, which aren't left to the system defaults.
+static bool ApplySocketOptions(int socketId, const UdpSocketConfig& config) noexcept {
+
+    if (config.mRecieveBufferSize > 0) {
+        if (0 != setsockopt(socketId, SOL_SOCKET, SO_RCVBUF, &config.mRecieveBufferSize, sizeof(int))) {
+            LOGE << "Failed to set SO_RCVBUF (errno == " << errno << ")";
+            return false;
+        }
+    }
+
+    if (config.mSendBufferSize > 0) {
+        if (0 != setsockopt(socketId, SOL_SOCKET, SO_SNDBUF, &config.mSendBufferSize, sizeof(int))) {
+            LOGE << "Failed to set SO_SNDBUF (errno == " << errno << ")";
+            return false;
+        }
+    }
+
+#if defined(__linux__)
+    // raising it above net.core.busy_read needs CAP_NET_ADMIN
+    if (config.mBusyPollUs > 0) {
+        if (0 != setsockopt(socketId, SOL_SOCKET, SO_BUSY_POLL, &config.mBusyPollUs, sizeof(int))) {
+            LOGE << "Failed to set SO_BUSY_POLL (errno == " << errno << ")";
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+
+#if defined(__linux__)
+
+//! the size of the UDP GRO segments of the recieved buffer (`szData`, if nothing was coalesced).
+static size_t GroSegmentSize(const msghdr& header, size_t szData) noexcept {
+
+    size_t szSegment = szData;
+    for (cmsghdr* pCmsg = CMSG_FIRSTHDR(&header); pCmsg; pCmsg = CMSG_NXTHDR((msghdr*)&header, pCmsg)) {
+        if (SOL_UDP == pCmsg->cmsg_level && UDP_GRO == pCmsg->cmsg_type) {
+            int szGroSegment;
+            memcpy(&szGroSegment, CMSG_DATA(pCmsg), sizeof(int));
+
+            if (szGroSegment > 0)
+                szSegment = (size_t)szGroSegment;
+        }
+    }
+
+    return szSegment;
+}
+
+#endif
+
+
+template < typename T >
+static void RemoveUnordered(std::vector<T*>& items, T* pItem) noexcept {
+
+    auto foundIt = std::find(items.begin(), items.end(), pItem);
+    if (items.end() != foundIt) {
+        *foundIt = items.back();
+        items.pop_back();
+    }
+}
+
+
+UdpReactor::UdpReactor(UdpEngineBackend backend) noexcept
+    : _pPublishedUsers(new UsersSnapshot)
+    , _pNativeData(new NativeData)
+{
+    _pUsers = _pPublishedUsers.load(std::memory_order_relaxed);
+
+    FD_ZERO(&_pNativeData->mAllSockets);
+
+    _pNativeData->mMaxSocketId = 0;
+
+    _pNativeData->mpWakeup = std::make_shared<UdpWakeup>();
+
+#if defined(__linux__)
+    if (UdpEngineBackend::IoUring == backend && !SetUpIoUring()) {
+        LOGW << "io_uring backend is not supported - falling back to epoll";
+        backend = UdpEngineBackend::Epoll;
+    }
+
+    if (UdpEngineBackend::Select != backend && UdpEngineBackend::IoUring != backend) {
+        _pNativeData->mEpollId = epoll_create1(EPOLL_CLOEXEC);
+        if (_pNativeData->mEpollId < 0) {
+            LOGW << "Failed to create epoll instance (errno == " << errno << ") - falling back to select";
+            backend = UdpEngineBackend::Select;
+        } else {
+            backend = UdpEngineBackend::Epoll;
+
+            if (_pNativeData->mpWakeup->valid()) {
+                epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.ptr = nullptr; // the only registration without a user
+
+                epoll_ctl(_pNativeData->mEpollId, EPOLL_CTL_ADD, _pNativeData->mpWakeup->waitId(), &ev);
+            }
+        }
+    }
+#else
+    if (UdpEngineBackend::Epoll == backend || UdpEngineBackend::IoUring == backend) {
+        LOGW << "Requested backend is not available on this platform - falling back to select";
+    }
+
+    backend = UdpEngineBackend::Select;
+#endif
+
+    _pNativeData->mBackend = backend;
+
+    _rateWindowTp = std::chrono::steady_clock::now();
+
+    _pThreader = std::make_unique<Threader>(this, &DoEngineStep);
+}
+
+
+UdpReactor::~UdpReactor() noexcept {
+
+    tearDown();
+
+    // nobody reads the users table anymore - catch up with the published versions here
+    ApplyUsersSnapshot();
+
+    if (_pUsers->mUsers.size() > 0) {
+        LOGW << "Destroying Udp Engine while still having active users";
+        for (UserData* pData : _pUsers->mUsers) {
+            pData->mpUser->notifyInvalid();
+
+            if (pData->mIsRegistered)
+                UnregisterSocket(*pData);
+
+            close(pData->mSocketId);
+
+            delete pData;
+        }
+
+        _usersTable.clear();
+    }
+
+    delete _pUsers;
+
+#if defined(__linux__)
+    if (_pNativeData->mEpollId >= 0)
+        close(_pNativeData->mEpollId);
+
+    _pNativeData->mRing.tearDown();
+
+    for (auto& p : _pNativeData->mRecvOps)
+        delete p.second;
+    for (auto pOp : _pNativeData->mCancelledRecvOps)
+        delete pOp;
+#endif
+
+    delete _pNativeData;
+}
+
+
+UdpResult UdpReactor::startUp() noexcept {
+
+    UdpResult res = eUdpResult_Failed;
+
+    // control threads don't apply users versions themselves, while the thread is starting
+    TRY_LOCKED(_running) {
+        res = _pThreader->syncStart(-1);
+    } UNLOCK;
+
+    return res;
+}
+
+
+UdpResult UdpReactor::tearDown() noexcept {
+
+    UdpResult res = eUdpResult_Failed;
+
+    TRY_LOCKED(_running) {
+        _isStopping.store(true, std::memory_order_release);
+        _pNativeData->mpWakeup->wake();
+
+        res = _pThreader->syncStop(-1);
+
+        _isStopping.store(false, std::memory_order_release);
+    } UNLOCK;
+
+    return res;
+}
+
+
+bool UdpReactor::isRunning() const noexcept {
+
+    return _pThreader->isRunning();
+}
+
+
+UdpResult UdpReactor::attachSocket( IUdpUser* pUser, UdpRole role, const UdpAddress& address, bool isReusePort
+                                  , const UdpSocketConfig& config
+                                  , UdpDgramQueue::SPtr pInputQueue, UdpDgramQueue::SPtr pOutputQueue, bool isSending
+                                  , UdpPeerTable::SPtr pPeers, int* pSocketId ) noexcept
+{
+    std::unique_ptr<UserData> pData = std::make_unique<UserData>();
+    pData->mpUser = pUser;
+    pData->mAddress = address;
+    pData->mInputQueue  = pInputQueue;
+    pData->mOutputQueue = pOutputQueue;
+    pData->mIsSending = isSending;
+    pData->mpPeers = pPeers;
+    pData->mRole = role;
+    pData->mRecieveBatchSize = config.mRecieveBatchSize;
+    pData->mIsLargeDgrams = config.mMaxDgramSize > DGRAM_MAXLINE;
+    pData->mOverflowPolicy = config.mOverflowPolicy;
+
+    if (UdpOverflowPolicy::Spill == config.mOverflowPolicy) {
+        pData->mpSpill = std::make_unique<SpillRing>(config.mSpillSize);
+    }
+
+    if ((pData->mSocketId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        LOGE << "Failed to create socket";
+        return eUdpResult_Failed;
+    }
+
+    if (UdpEngineBackend::Select == _pNativeData->mBackend && pData->mSocketId >= FD_SETSIZE) {
+        LOGE << "Socket id " << pData->mSocketId << " doesn't fit into fd_set - use the epoll backend";
+
+        close(pData->mSocketId);
+
+        return eUdpResult_Failed;
+    }
+
+    if (UdpEngineBackend::IoUring != _pNativeData->mBackend) {
+        // sockets are drained until EAGAIN (or the quantum) - a blocked syscall would stall every
+        // socket of the thread; io_uring never blocks the thread and retries on readiness itself
+        int flags = fcntl(pData->mSocketId, F_GETFL, 0);
+        if (flags < 0 || fcntl(pData->mSocketId, F_SETFL, flags | O_NONBLOCK) < 0) {
+            LOGE << "Failed to make socket non-blocking (errno == " << errno << ")";
+
+            close(pData->mSocketId);
+
+            return eUdpResult_Failed;
+        }
+    }
+
+    if (!ApplySocketOptions(pData->mSocketId, config)) {
+        close(pData->mSocketId);
+
+        return eUdpResult_Failed;
+    }
+
+#if defined(__linux__)
+    pData->mIsGsoEnabled = config.mIsSegmentationOffload && IsSegmentationOffloadSupported(pData->mSocketId);
+
+    // io_uring recieves into fixed-size provided buffers, which can't take coalesced dgrams
+    if (config.mIsRecieveOffload && UdpEngineBackend::IoUring != _pNativeData->mBackend) {
+        int isGroEnabled = 1;
+        pData->mIsGroEnabled = 0 == setsockopt(pData->mSocketId, SOL_UDP, UDP_GRO, &isGroEnabled, sizeof(isGroEnabled));
+    }
+#endif
+
+    if (isReusePort) {
+        int isReusePortEnabled = 1;
+        if (0 != setsockopt(pData->mSocketId, SOL_SOCKET, SO_REUSEPORT, &isReusePortEnabled, sizeof(isReusePortEnabled))) {
+            LOGE << "Failed to enable port reuse (errno == " << errno << ")";
+
+            close(pData->mSocketId);
+
+            return eUdpResult_Failed;
+        }
+    }
+
+    if (UdpRole::Server == role) {
+        int result = bind(pData->mSocketId, (const sockaddr*)address.nativeData(), address.nativeDataSize());
+        if (0 != result) {
+            LOGE << "Failed to bind address to a socket (errno == " << errno << ")";
+
+            close(pData->mSocketId);
+
+            return eUdpResult_Failed;
+        }
+    }
+
+    const int socketId = pData->mSocketId;
+
+    // the reactor thread registers the socket on its next step; a failed registration
+    // is reported to the user through `notifyInvalid`.
+    TRY_LOCKED(_usersTable) {
+        auto insres = _usersTable.emplace(pUser, pData.get());
+        if (!insres.second) {
+            LOGE << "Trying to attach already attached user";
+
+            close(socketId);
+
+            return eUdpResult_Already;
+        }
+
+        PublishUsers(pData.release(), true, false);
+    } UNLOCK;
+
+    if (pSocketId)
+        *pSocketId = socketId;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::detachSocket(IUdpUser* pUser) noexcept {
+
+    uint64_t nbVersions = 0;
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to detach not attached user";
+            return eUdpResult_Failed;
+        }
+
+        // the reactor thread closes the socket and frees the user data, once it doesn't use them
+        UserData* pData = foundIt->second;
+
+        _usersTable.erase(foundIt);
+
+        nbVersions = PublishUsers(pData, false, false);
+    } UNLOCK;
+
+    WaitForUsersApplied(nbVersions);
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::moveSocket(IUdpUser* pUser, UdpReactor& target) noexcept {
+
+    UserData* pData = nullptr;
+    uint64_t nbVersions = 0;
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to move not attached user";
+            return eUdpResult_Failed;
+        }
+
+        pData = foundIt->second;
+
+#if defined(__linux__)
+        // this thread still reaps the completions of the cancelled recv into the input queue,
+        // while the target thread recieves into it already
+        if (UdpEngineBackend::IoUring == _pNativeData->mBackend && UdpQueueConcurrency::Spsc == pData->mInputQueue->concurrency()) {
+            LOGE << "Socket with spsc input queue can't be moved off its io_uring thread";
+            return eUdpResult_NotImplemented;
+        }
+#endif
+
+        _usersTable.erase(foundIt);
+
+        nbVersions = PublishUsers(pData, false, true);
+    } UNLOCK;
+
+    // the socket isn't served by anybody for a moment, but it stays open, so the kernel
+    // keeps buffering dgrams for it; the target gets the readiness from its own backend.
+    WaitForUsersApplied(nbVersions);
+
+    TRY_LOCKED(target._usersTable) {
+        auto insres = target._usersTable.emplace(pUser, pData);
+        if (!insres.second) {
+            LOGE << "Trying to move user to the reactor, which already serves it";
+
+            close(pData->mSocketId);
+
+            delete pData;
+
+            return eUdpResult_Failed;
+        }
+
+        target.PublishUsers(pData, true, false);
+    } UNLOCK;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::setRecieveBatchSize(IUdpUser* pUser, size_t nbDgrams) noexcept {
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to configure not attached user";
+            return eUdpResult_Failed;
+        }
+
+        foundIt->second->mRecieveBatchSize = std::min<size_t>(std::max<size_t>(nbDgrams, 1), DGRAM_RECV_BATCH_MAX);
+    } UNLOCK;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::setSegmentationOffload(IUdpUser* pUser, bool isEnabled) noexcept {
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to configure not attached user";
+            return eUdpResult_Failed;
+        }
+
+        if (isEnabled) {
+#if defined(__linux__)
+            if (!IsSegmentationOffloadSupported(foundIt->second->mSocketId)) {
+                LOGW << "UDP GSO is not supported by the kernel";
+                return eUdpResult_Failed;
+            }
+#else
+            LOGW << "UDP GSO is not available on this platform";
+            return eUdpResult_Failed;
+#endif
+        }
+
+        foundIt->second->mIsGsoEnabled = isEnabled;
+    } UNLOCK;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::setLargeDgrams(IUdpUser* pUser, bool isEnabled) noexcept {
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to configure not attached user";
+            return eUdpResult_Failed;
+        }
+
+        foundIt->second->mIsLargeDgrams = isEnabled;
+    } UNLOCK;
+
+    return eUdpResult_Ok;
+}
+
+
+UdpResult UdpReactor::socketConfig(IUdpUser* pUser, UdpSocketConfig* pConfig) noexcept {
+
+    TRY_LOCKED(_usersTable) {
+        auto foundIt = _usersTable.find(pUser);
+        if (_usersTable.end() == foundIt) {
+            LOGE << "Trying to read config of not attached user";
+            return eUdpResult_Failed;
+        }
+
+        const UserData& udata = *foundIt->second;
+
+        UdpSocketConfig config;
+        config.mInputQueueSize = udata.mInputQueue->capacity();
+        config.mOutputQueueSize = udata.mOutputQueue->capacity();
+        config.mInputQueueConcurrency = udata.mInputQueue->concurrency();
+        config.mOutputQueueConcurrency = udata.mOutputQueue->concurrency();
+        config.mRecieveBatchSize = udata.mRecieveBatchSize;
+        config.mMaxDgramSize = udata.mIsLargeDgrams ? UdpSocketConfig::MaxDgramSize : DGRAM_MAXLINE;
+        config.mIsSegmentationOffload = udata.mIsGsoEnabled;
+        config.mIsRecieveOffload = udata.mIsGroEnabled;
+        config.mOverflowPolicy = udata.mOverflowPolicy;
+
+        if (udata.mpSpill) {
+            config.mSpillSize = udata.mpSpill->capacity();
+        }
+
+        socklen_t szOption = sizeof(int);
+        if (0 != getsockopt(udata.mSocketId, SOL_SOCKET, SO_RCVBUF, &config.mRecieveBufferSize, &szOption)) {
+            LOGE << "Failed to read SO_RCVBUF (errno == " << errno << ")";
+            return eUdpResult_Failed;
+        }
+
+        szOption = sizeof(int);
+        if (0 != getsockopt(udata.mSocketId, SOL_SOCKET, SO_SNDBUF, &config.mSendBufferSize, &szOption)) {
+            LOGE << "Failed to read SO_SNDBUF (errno == " << errno << ")";
+            return eUdpResult_Failed;
+        }
+
+#if defined(__linux__)
+        szOption = sizeof(int);
+        if (0 != getsockopt(udata.mSocketId, SOL_SOCKET, SO_BUSY_POLL, &config.mBusyPollUs, &szOption)) {
+            LOGE << "Failed to read SO_BUSY_POLL (errno == " << errno << ")";
+            return eUdpResult_Failed;
+        }
+#endif
+
+        *pConfig = config;
+    } UNLOCK;
+
+    return eUdpResult_Ok;
+}
+
+
+void UdpReactor::setDrainQuantum(size_t nbDgrams) noexcept {
+
+    _drainQuantum.store(std::max<size_t>(std::min<size_t>(nbDgrams, INT_MAX), 1), std::memory_order_relaxed);
+}
+
+
+UdpEngineBackend UdpReactor::backend() const noexcept {
+
+    return _pNativeData->mBackend;
+}
+
+
+UdpReactor::Stats UdpReactor::stats() noexcept {
+
+    Stats copy;
+
+    SyncWithReactorThread();
+
+    TRY_LOCKED(_publishedStats) {
+        copy = _publishedStats;
+    } UNLOCK;
+
+    return copy;
+}
+
+
+size_t UdpReactor::nbUsers() noexcept {
+
+    size_t nbUsers = 0;
+
+    TRY_LOCKED(_usersTable) {
+        nbUsers = _usersTable.size();
+    } UNLOCK;
+
+    return nbUsers;
+}
+
+
+UdpReactor::ThreadLoad UdpReactor::load() noexcept {
+
+    ThreadLoad load;
+    load.mNbSockets = nbUsers();
+
+    TRY_LOCKED(_publishedStats) {
+        load.mDgramsPerSecond = _recentRate;
+        load.mStats = _publishedStats;
+    } UNLOCK;
+
+    return load;
+}
+
+
+uint64_t UdpReactor::PublishUsers(UserData* pChanged, bool isAdded, bool isMoved) noexcept {
+
+    UsersSnapshot* pSnapshot = new UsersSnapshot;
+    pSnapshot->mUsers.reserve(_usersTable.size());
+    for (auto& p : _usersTable) {
+        pSnapshot->mUsers.push_back(p.second);
+    }
+
+    pSnapshot->mpChanged = pChanged;
+    pSnapshot->mIsAdded = isAdded;
+    pSnapshot->mIsMoved = isMoved;
+
+    // control threads are serialized by the lock, so nobody else publishes in between
+    pSnapshot->mpPrevious = _pPublishedUsers.load(std::memory_order_relaxed);
+
+    _pPublishedUsers.store(pSnapshot, std::memory_order_release);
+
+    _nbPublishedUsers += 1;
+
+    if (!_pThreader->isRunning()) {
+        WaitForUsersApplied(_nbPublishedUsers);
+    } else if (_nbPublishedUsers - _nbAppliedUsers.load(std::memory_order_acquire) > USERS_MAX_PENDING_VERSIONS) {
+        // every pending version holds a copy of the table - don't let a burst of attaches pile them up
+        WaitForUsersApplied(_nbPublishedUsers - USERS_MAX_PENDING_VERSIONS);
+    } else {
+        _pNativeData->mpWakeup->wake();
+    }
+
+    return _nbPublishedUsers;
+}
+
+
+void UdpReactor::ApplyUsersSnapshot() noexcept {
+
+    UsersSnapshot* pLatest = _pPublishedUsers.load(std::memory_order_acquire);
+    if (pLatest == _pUsers)
+        return;
+
+    // versions link to older ones, but changes have to be applied from the oldest
+    std::vector<UsersSnapshot*>& missed = _pNativeData->mMissedUsers;
+    for (UsersSnapshot* pSnapshot = pLatest; pSnapshot != _pUsers; pSnapshot = pSnapshot->mpPrevious) {
+        missed.push_back(pSnapshot);
+    }
+
+    uint64_t nbApplied = _nbAppliedUsers.load(std::memory_order_relaxed);
+
+    for (auto it = missed.rbegin(); it != missed.rend(); ++it) {
+        UserData* pData = (*it)->mpChanged;
+
+        if ((*it)->mIsAdded) {
+            pData->mIsRegistered = RegisterSocket(*pData);
+            if (!pData->mIsRegistered) {
+                pData->mpUser->notifyInvalid();
+            }
+        } else {
+            if (pData->mIsRegistered) {
+                UnregisterSocket(*pData, (*it)->mIsMoved);
+                pData->mIsRegistered = false;
+            }
+
+            if ((*it)->mIsMoved) {
+                pData->mIsReadable = false;
+                pData->mIsWriteBlocked = false;
+            } else {
+                close(pData->mSocketId);
+
+                delete pData;
+            }
+        }
+
+        nbApplied += 1;
+
+        if (*it != pLatest)
+            delete *it;
+    }
+
+    missed.clear();
+
+    // the reactor thread doesn't hold pointers into the previous version past this point
+    delete _pUsers;
+    _pUsers = pLatest;
+
+    _nbAppliedUsers.store(nbApplied, std::memory_order_release);
+}
+
+
+void UdpReactor::WaitForUsersApplied(uint64_t nbVersions) noexcept {
+
+    TRY_LOCKED(_running) {
+        if (_pThreader->isRunning()) {
+            _pNativeData->mpWakeup->wake();
+
+            while (_nbAppliedUsers.load(std::memory_order_acquire) < nbVersions && _pThreader->isRunning()) {
+                std::this_thread::yield();
+            }
+        }
+
+        // the thread is down and can't be started meanwhile, so the versions are applied here
+        if (_nbAppliedUsers.load(std::memory_order_acquire) < nbVersions) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            ApplyUsersSnapshot();
+        }
+    } UNLOCK;
+}
+
+
+void UdpReactor::SyncWithReactorThread() noexcept {
+
+    // the counter grows at the start of a step, which might have begun right before the call,
+    // so only the step after the next one follows a whole step made after the call
+    const uint64_t nbSteps = _nbSteps.load(std::memory_order_acquire);
+
+    for (uint64_t nbTarget = nbSteps + 1; nbTarget <= nbSteps + 2; ++nbTarget) {
+        _pNativeData->mpWakeup->wake();
+
+        while (_nbSteps.load(std::memory_order_acquire) < nbTarget) {
+            if (!_pThreader->isRunning())
+                return;
+
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+bool UdpReactor::SetUpIoUring() noexcept {
+
+#if defined(__linux__)
+    static const int sRequiredOps[] = { IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL, IORING_OP_POLL_ADD };
+
+    IoUring& ring = _pNativeData->mRing;
+
+    UdpResult res = ring.setUp(URING_QUEUE_SIZE, sRequiredOps, sizeof(sRequiredOps) / sizeof(sRequiredOps[0]));
+    if (eUdpResult_Ok != res)
+        return false;
+
+    res = ring.setUpBuffers(URING_BUFFERS_GROUP, URING_NB_BUFFERS, URING_BUFFER_SIZE);
+    if (eUdpResult_Ok != res) {
+        ring.tearDown();
+        return false;
+    }
+
+    // there is no feature flag for multishot recvmsg (linux 6.0+), so arm one on a dummy
+    // socket and cancel it: old kernels reject the unknown ioprio flag with EINVAL.
+    int probeSocketId = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (probeSocketId < 0) {
+        ring.tearDown();
+        return false;
+    }
+
+    NativeData::UringRecvOp probeOp;
+    probeOp.mpUser = nullptr;
+
+    io_uring_sqe* pSqe = ring.getSqe();
+    _pNativeData->prepareRecieve(pSqe, &probeOp, probeSocketId);
+
+    pSqe = ring.getSqe();
+    pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+    pSqe->addr = (uint64_t)&probeOp;
+    pSqe->user_data = 0;
+
+    bool isSupported = ring.submit(2) >= 0;
+
+    for (int nbSeen = 0; nbSeen < 2;) {
+        io_uring_cqe* pCqe = ring.peekCqe();
+        if (!pCqe) {
+            if (ring.submit(1) < 0)
+                break;
+            continue;
+        }
+
+        if ((uint64_t)&probeOp == pCqe->user_data && -EINVAL == pCqe->res) {
+            isSupported = false;
+        }
+
+        ring.seenCqe();
+        ++nbSeen;
+    }
+
+    close(probeSocketId);
+
+    if (!isSupported) {
+        ring.tearDown();
+        return false;
+    }
+
+    _pNativeData->mSendOps = std::make_unique<NativeData::UringSendOp[]>(URING_NB_SEND_OPS);
+    for (size_t i = 0; i < URING_NB_SEND_OPS; ++i) {
+        _pNativeData->mFreeSendOps.push_back(&_pNativeData->mSendOps[i]);
+    }
+
+    if (_pNativeData->mpWakeup->valid()) {
+        _pNativeData->prepareWakeupPoll(ring.getSqe());
+        ring.submit();
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool UdpReactor::RegisterSocket(UserData& udata) noexcept {
+
+    switch (_pNativeData->mBackend) {
+#if defined(__linux__)
+    case UdpEngineBackend::Epoll: {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = &udata; // user data is stable until the reactor thread frees it
+
+        if (0 != epoll_ctl(_pNativeData->mEpollId, EPOLL_CTL_ADD, udata.mSocketId, &ev)) {
+            LOGE << "Failed to add socket to epoll (errno == " << errno << ")";
+            return false;
+        }
+
+        break;
+    }
+    case UdpEngineBackend::IoUring: {
+        io_uring_sqe* pSqe = _pNativeData->getSqe();
+        if (!pSqe) {
+            LOGE << "Failed to get io_uring submission entry";
+            return false;
+        }
+
+        NativeData::UringRecvOp* pOp = new NativeData::UringRecvOp;
+        pOp->mpUser = &udata; // user data is stable until the reactor thread frees it
+
+        _pNativeData->prepareRecieve(pSqe, pOp, udata.mSocketId);
+        _pNativeData->mRecvOps[&udata] = pOp;
+
+        _pNativeData->mRing.submit();
+
+        break;
+    }
+#endif
+    default:
+        FD_SET(udata.mSocketId, &_pNativeData->mAllSockets);
+
+        if (udata.mSocketId + 1 > _pNativeData->mMaxSocketId)
+            _pNativeData->mMaxSocketId = udata.mSocketId + 1;
+
+        break;
+    }
+
+    // a queue notifies a single wakeup, so a merged output queue is served by one shard only
+    if (udata.mIsSending) {
+        udata.mOutputQueue->setWakeup(_pNativeData->mpWakeup);
+        _pNativeData->mOutputQueueUsers[udata.mOutputQueue.get()] = &udata;
+
+        // the user might have queued dgrams already - the next step checks and arms the queue
+        MarkPendingOutput(udata);
+    }
+
+    // a moved socket brings its spilled dgrams along
+    MarkPendingSpill(udata);
+
+    return true;
+}
+
+
+void UdpReactor::UnregisterSocket(UserData& udata, bool isMoving) noexcept {
+
+    if (udata.mHasPendingOutput) {
+        udata.mHasPendingOutput = false;
+        RemoveUnordered(_pNativeData->mPendingOutput, &udata);
+    }
+
+    if (udata.mHasPendingSpill) {
+        udata.mHasPendingSpill = false;
+        RemoveUnordered(_pNativeData->mPendingSpills, &udata);
+    }
+
+    if (udata.mIsSending) {
+        _pNativeData->mOutputQueueUsers.erase(udata.mOutputQueue.get());
+    }
+
+    switch (_pNativeData->mBackend) {
+#if defined(__linux__)
+    case UdpEngineBackend::Epoll:
+        epoll_ctl(_pNativeData->mEpollId, EPOLL_CTL_DEL, udata.mSocketId, nullptr);
+
+        if (udata.mIsReadable)
+            RemoveUnordered(_pNativeData->mReadyToRead, &udata);
+
+        break;
+    case UdpEngineBackend::IoUring: {
+        auto foundIt = _pNativeData->mRecvOps.find(&udata);
+        if (_pNativeData->mRecvOps.end() != foundIt) {
+            NativeData::UringRecvOp* pOp = foundIt->second;
+            pOp->mpUser = nullptr;
+            pOp->mIsCancelled = true;
+
+            if (isMoving) {
+                pOp->mpMovedUser = std::make_unique<UserData>();
+                pOp->mpMovedUser->mAddress = udata.mAddress;
+                pOp->mpMovedUser->mInputQueue = udata.mInputQueue;
+                pOp->mpMovedUser->mpPeers = udata.mpPeers;
+                pOp->mpMovedUser->mSocketId = -1;
+                pOp->mpMovedUser->mRole = udata.mRole;
+                pOp->mpMovedUser->mRecieveBatchSize = udata.mRecieveBatchSize.load();
+                pOp->mpMovedUser->mIsLargeDgrams = udata.mIsLargeDgrams.load();
+                pOp->mpMovedUser->mOverflowPolicy = udata.mOverflowPolicy; // the spill ring moves on with the user
+
+                pOp->mpUser = pOp->mpMovedUser.get();
+            }
+
+            _pNativeData->mRecvOps.erase(foundIt);
+            _pNativeData->mCancelledRecvOps.push_back(pOp);
+
+            io_uring_sqe* pSqe = _pNativeData->getSqe();
+            if (pSqe) {
+                pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+                pSqe->addr = (uint64_t)pOp;
+                pSqe->user_data = 0;
+            }
+        }
+
+        // in-flight sends still complete, but there is nobody to report to
+        for (size_t i = 0; i < URING_NB_SEND_OPS; ++i) {
+            if (&udata == _pNativeData->mSendOps[i].mpUser)
+                _pNativeData->mSendOps[i].mpUser = nullptr;
+        }
+
+        _pNativeData->mRing.submit();
+
+        break;
+    }
+#endif
+    default:
+        FD_CLR(udata.mSocketId, &_pNativeData->mAllSockets);
+        break;
+    }
+
+#if !defined(__linux__)
+    UNUSED(isMoving);
+#endif
+}
+
+
+void UdpReactor::FindAndFixBadSocketId() noexcept {
+
+    for (UserData* pData : _pUsers->mUsers) {
+        if (!pData->mIsRegistered)
+            continue;
+
+        fd_set toTry;
+        FD_ZERO(&toTry);
+        FD_SET(pData->mSocketId, &toTry);
+
+        timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+
+        int selectRes = select(pData->mSocketId + 1, &toTry, 0, 0, &tv);
+        if (selectRes < 0 && EBADF == errno) {
+            pData->mpUser->notifyInvalid();
+
+            // stays in the table until the user detaches, but isn't served anymore
+            UnregisterSocket(*pData);
+            pData->mIsRegistered = false;
+        }
+    }
+}
+
+
+void UdpReactor::InvalidateUsersWithLargeSocketId() noexcept {
+
+    for (UserData* pData : _pUsers->mUsers) {
+        if (pData->mIsRegistered && pData->mSocketId >= FD_SETSIZE) {
+            pData->mpUser->notifyInvalid();
+
+            UnregisterSocket(*pData);
+            pData->mIsRegistered = false;
+        }
+    }
+}
+
+
+/*static*/
+Threader::StepResult UdpReactor::DoEngineStep(void *pOpaqueSelf) {
+
+    UdpReactor* pSelf = (UdpReactor*)pOpaqueSelf;
+
+    if (pSelf->_isStopping.load(std::memory_order_acquire)) {
+        // the wakeup is consumed already - don't wait again, the thread is about to stop
+        std::this_thread::yield();
+        return Threader::StepResult::Continue;
+    }
+
+    // the only point, where the reactor thread switches to a newer users table version
+    pSelf->ApplyUsersSnapshot();
+
+    pSelf->_nbSteps.fetch_add(1, std::memory_order_acq_rel);
+
+    Threader::StepResult res;
+    switch (pSelf->_pNativeData->mBackend) {
+    case UdpEngineBackend::Epoll:
+        res = pSelf->DoEpollStep();
+        break;
+    case UdpEngineBackend::IoUring:
+        res = pSelf->DoIoUringStep();
+        break;
+    default:
+        res = pSelf->DoSelectStep();
+        break;
+    }
+
+    pSelf->PublishStats();
+    pSelf->ExpireIdlePeers();
+
+    return res;
+}
+
+
+void UdpReactor::PublishStats() noexcept {
+
+    std::chrono::steady_clock::time_point nowTp = std::chrono::steady_clock::now();
+
+    std::chrono::duration<float> elapsed = (nowTp - _rateWindowTp) * 1000.0f;
+
+    TRY_LOCKED(_publishedStats) {
+        _publishedStats = _stats;
+
+        if (elapsed.count() >= LOAD_RATE_WINDOW_MS) {
+            int nbDgrams = _stats.mNbSent + _stats.mNbRecieved;
+
+            _recentRate = (nbDgrams - _rateWindowNbDgrams) * 1000.0f / elapsed.count();
+
+            _rateWindowNbDgrams = nbDgrams;
+            _rateWindowTp = nowTp;
+        }
+    } UNLOCK;
+}
+
+
+void UdpReactor::ExpireIdlePeers() noexcept {
+
+    const UdpPeerTable::Clock::time_point now = UdpPeerTable::Clock::now();
+    if (now < _peersExpiryTp)
+        return;
+
+    _peersExpiryTp = now + std::chrono::milliseconds(PEERS_EXPIRY_PERIOD_MS);
+
+    // every shard of a sharded socket gets here with the same table - it keeps its own pace
+    for (UserData* pData : _pUsers->mUsers) {
+        if (pData->mpPeers) {
+            pData->mpPeers->expireIdlePeers(now);
+        }
+    }
+}
+
+
+Threader::StepResult UdpReactor::DoSelectStep() noexcept {
+
+    fd_set toRead, toWrite, withErrors;
+    FD_ZERO(&toWrite);
+    FD_ZERO(&withErrors);
+
+    FD_COPY(&_pNativeData->mAllSockets, &toRead);
+
+    int maxSocketId = _pNativeData->mMaxSocketId;
+
+    // the wakeup is polled along with the sockets: it ends the wait once there is output
+    const int wakeupId = _pNativeData->mpWakeup->waitId();
+    if (wakeupId >= 0) {
+        FD_SET(wakeupId, &toRead);
+        maxSocketId = std::max(maxSocketId, wakeupId + 1);
+    }
+
+    // udp sockets are almost always writable - ask only about the ones with something to send
+    for (UserData* pData : _pNativeData->mPendingOutput) {
+        FD_SET(pData->mSocketId, &toWrite);
+    }
+
+    FlushPendingSpills();
+
+    const int msTimeout = WaitTimeoutMs();
+
+    timeval tv;
+    tv.tv_sec = msTimeout / 1000;
+    tv.tv_usec = (msTimeout % 1000) * 1000;
+
+    int selectRes = select(maxSocketId, &toRead, &toWrite, &withErrors, &tv);
+    if (selectRes < 0 && (EAGAIN == errno || EINTR == errno)) {
+        // just continue and try on the next step
+        return Threader::StepResult::Continue;
+    } else if (selectRes < 0 && EBADF == errno) {
+        FindAndFixBadSocketId();
+        return Threader::StepResult::Continue;
+    } else if (selectRes < 0 && EINVAL == errno) {
+        if (_pNativeData->mMaxSocketId >= FD_SETSIZE) {
+            // too many descriptors! lets throw some away
+            InvalidateUsersWithLargeSocketId();
+            return Threader::StepResult::Continue;
+        }
+
+        // according to the man page, this is a case, when timeval is wrong.
+        // this is definitely a hardbreak...
+        HARDBREAK;
+        return Threader::StepResult::Continue;
+    } else if (0 == selectRes) {
+        // timeout case - try on the next step
+        return Threader::StepResult::Continue;
+    } else if (selectRes < 0) {
+        // welp, this is strange - let's break the fuck out of here
+        HARDBREAK;
+        return Threader::StepResult::Continue;
+    }
+
+    assert(selectRes > 0);
+
+    if (wakeupId >= 0 && FD_ISSET(wakeupId, &toRead) != 0) {
+        ProcessWakeup();
+    }
+
+    std::vector<UserData*>& pendingOutput = _pNativeData->mPendingOutput;
+    for (size_t i = 0; i < pendingOutput.size();) {
+        UserData& udata = *pendingOutput[i];
+        if (FD_ISSET(udata.mSocketId, &toWrite) != 0) {
+            DrainSocket(udata, true);
+
+            if (!ArmOutputWakeup(udata)) {
+                RemovePendingOutput(i);
+                continue;
+            }
+        }
+
+        ++i;
+    }
+
+    for (UserData* pData : _pUsers->mUsers) {
+        if (pData->mIsRegistered && FD_ISSET(pData->mSocketId, &toRead) != 0) {
+            DrainSocket(*pData, false);
+        }
+    }
+
+    return Threader::StepResult::Continue;
+}
+
+
+Threader::StepResult UdpReactor::DoEpollStep() noexcept {
+
+#if defined(__linux__)
+    std::vector<UserData*>& readyToRead   = _pNativeData->mReadyToRead;
+    std::vector<UserData*>& pendingOutput = _pNativeData->mPendingOutput;
+
+    // don't block while some sockets still have unprocessed readiness or unblocked output
+    bool isIdle = readyToRead.empty();
+    for (size_t i = 0; isIdle && i < pendingOutput.size(); ++i) {
+        isIdle = pendingOutput[i]->mIsWriteBlocked;
+    }
+
+    FlushPendingSpills();
+
+    int msTimeout = isIdle ? WaitTimeoutMs() : 0;
+
+    int nbEvents = epoll_wait(_pNativeData->mEpollId, _pNativeData->mEvents, EPOLL_MAX_EVENTS, msTimeout);
+    if (nbEvents < 0) {
+        if (EINTR == errno)
+            return Threader::StepResult::Continue;
+
+        LOGE << "epoll_wait failed (errno == " << errno << ")";
+        HARDBREAK;
+
+        return Threader::StepResult::Continue;
+    }
+
+    bool isWoken = false;
+
+    for (int i = 0; i < nbEvents; ++i) {
+        UserData* pData = (UserData*)_pNativeData->mEvents[i].data.ptr;
+        uint32_t events = _pNativeData->mEvents[i].events;
+
+        if (!pData) {
+            isWoken = true;
+            continue;
+        }
+
+        if ((events & (EPOLLIN | EPOLLERR)) && !pData->mIsReadable) {
+            pData->mIsReadable = true;
+            readyToRead.push_back(pData);
+        }
+
+        if ((events & EPOLLOUT) && pData->mIsWriteBlocked) {
+            pData->mIsWriteBlocked = false;
+            _pNativeData->updateEpollEvents(*pData);
+        }
+    }
+
+    if (isWoken) {
+        ProcessWakeup();
+    }
+
+    for (size_t i = 0; i < pendingOutput.size();) {
+        UserData& udata = *pendingOutput[i];
+        if (udata.mIsWriteBlocked) {
+            ++i;
+        } else if (eUdpResult_Again == DrainSocket(udata, true)) {
+            udata.mIsWriteBlocked = true;
+            _pNativeData->updateEpollEvents(udata);
+            ++i;
+        } else if (!ArmOutputWakeup(udata)) {
+            RemovePendingOutput(i);
+        } else {
+            ++i;
+        }
+    }
+
+    for (size_t i = 0; i < readyToRead.size();) {
+        // a socket, which spent its quantum, stays ready and gets served on the next step
+        if (eUdpResult_Again == DrainSocket(*readyToRead[i], false)) {
+            readyToRead[i]->mIsReadable = false;
+            readyToRead[i] = readyToRead.back();
+            readyToRead.pop_back();
+        } else {
+            ++i;
+        }
+    }
+#else
+    HARDBREAK;
+#endif
+
+    return Threader::StepResult::Continue;
+}
+
+
+Threader::StepResult UdpReactor::DoIoUringStep() noexcept {
+
+#if defined(__linux__)
+    ReapIoUringCompletions();
+
+    // completions are reaped before the wait, so the wakeup is consumed by this very step
+    const bool isWoken = _pNativeData->mIsWoken;
+    if (isWoken) {
+        _pNativeData->mIsWoken = false;
+        ProcessWakeup();
+    }
+
+    std::vector<UserData*>& pendingOutput = _pNativeData->mPendingOutput;
+    std::vector<NativeData::UringSendOp*>& freeOps = _pNativeData->mFreeSendOps;
+
+    size_t nbQueuedSends = 0;
+    for (size_t i = 0; i < pendingOutput.size() && !freeOps.empty();) {
+        UserData& udata = *pendingOutput[i];
+
+        size_t nbQueued = 0;
+        DrainSocket(udata, true, &nbQueued);
+
+        nbQueuedSends += nbQueued;
+
+        if (!ArmOutputWakeup(udata)) {
+            RemovePendingOutput(i);
+        } else {
+            ++i;
+        }
+    }
+
+    FlushPendingSpills();
+
+    // wait for completions (recieves, sends or the wakeup poll), unless more sends can be queued;
+    // a woken step doesn't wait either - whoever woke the thread (e.g. SyncWithReactorThread)
+    // expects the next step to start promptly
+    bool isIdle = !isWoken && (pendingOutput.empty() || freeOps.empty());
+
+    // one syscall submits all the sends of the step and re-armed recieves
+    int res = _pNativeData->mRing.submit(isIdle ? 1 : 0, WaitTimeoutMs());
+    if (res < 0 && -EBUSY != res && -EAGAIN != res && -ETIME != res && -EINTR != res) {
+        LOGE << "io_uring submit failed (errno == " << -res << ")";
+        HARDBREAK;
+    } else if (res >= 0 && nbQueuedSends > 0) {
+        _stats.mNbSendCalls += 1;
+    }
+#else
+    HARDBREAK;
+#endif
+
+    return Threader::StepResult::Continue;
+}
+
+
+void UdpReactor::ReapIoUringCompletions() noexcept {
+
+#if defined(__linux__)
+    IoUring& ring = _pNativeData->mRing;
+
+    ring.flushOverflow();
+
+    bool hasRecycledBuffers = false;
+
+    // the recieve buffer is recycled right away, so the dgram is copied out of it here
+    auto reapDgram = [this](UserData& udata, const void* pName, size_t szName, const uint8_t* pData, size_t szData) {
+        UdpDgram dgram = UdpDgram::Allocate(UdpAddress(), szData);
+        if (!dgram.valid()) {
+            LOGW << "Failed to allocate recieved dgram - dropped";
+            _stats.mNbInputDropped += 1;
+            return;
+        }
+
+        memcpy(dgram.data(), pData, szData);
+
+        size_t peerIndex = _pNativeData->mRecieveBatch.mPeers.add(udata.mpPeers.get(), pName, szName, 1, szData);
+        _pNativeData->mReapedDgrams.push_back(NativeData::ReapedDgram{&udata, peerIndex, std::move(dgram)});
+    };
+
+    io_uring_cqe* pCqe;
+    while ((pCqe = ring.peekCqe()) != nullptr) {
+        uint64_t userData = pCqe->user_data;
+        int res = pCqe->res;
+        unsigned flags = pCqe->flags;
+
+        ring.seenCqe();
+
+        if (0 == userData) // cancellation results
+            continue;
+
+        if (URING_WAKEUP_DATA == userData) {
+            _pNativeData->mIsWoken = true;
+
+            // the poll is oneshot; it is submitted again after the wakeup is reset by the step
+            io_uring_sqe* pSqe = _pNativeData->getSqe();
+            if (pSqe) {
+                _pNativeData->prepareWakeupPoll(pSqe);
+            } else {
+                LOGE << "Failed to re-arm io_uring wakeup poll";
+            }
+
+            continue;
+        }
+
+        if (userData & URING_SEND_OP_TAG) {
+            NativeData::UringSendOp* pOp = (NativeData::UringSendOp*)(userData & ~(uint64_t)URING_SEND_OP_TAG);
+
+            if (res < 0) {
+                if (pOp->mpUser && (-EAGAIN == res || -EWOULDBLOCK == res)) {
+                    // put back in the order of submission, once every completion is reaped
+                    _pNativeData->mAgainSendOps.push_back(pOp);
+                    continue;
+                }
+
+                // the error sticks to the dgram or its peer (see SendUdpUserDgrams) - dropped
+                if (pOp->mpUser) {
+                    LOGW << "failed to send data (errno == " << -res << ") - the dgram is dropped";
+                    _stats.mNbSendFails += 1;
+                }
+            } else {
+                _stats.mNbSent += 1;
+            }
+
+            pOp->mpUser = nullptr;
+            pOp->mDgram = UdpDgram();
+
+            _pNativeData->mFreeSendOps.push_back(pOp);
+
+            continue;
+        }
+
+        NativeData::UringRecvOp* pOp = (NativeData::UringRecvOp*)userData;
+
+        if (flags & IORING_CQE_F_BUFFER) {
+            uint16_t bufferId = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+            if (res >= 0 && pOp->mpUser) {
+                uint8_t* pBuffer = ring.buffer(bufferId);
+
+                // buffer layout: recvmsg_out header | source address | control | payload
+                io_uring_recvmsg_out* pOut = (io_uring_recvmsg_out*)pBuffer;
+                uint8_t* pName = pBuffer + sizeof(io_uring_recvmsg_out);
+                uint8_t* pPayload = pName + pOp->mHeader.msg_namelen + pOp->mHeader.msg_controllen;
+
+                size_t szName = std::min<size_t>(pOut->namelen, pOp->mHeader.msg_namelen);
+                size_t szPayload = std::min<size_t>(pOut->payloadlen, (size_t)res - (size_t)(pPayload - pBuffer));
+
+                if (pOut->flags & MSG_TRUNC) {
+                    DropTruncatedDgram(*pOp->mpUser, &_stats);
+                } else {
+                    reapDgram(*pOp->mpUser, pName, szName, pPayload, szPayload);
+                }
+
+                // the multishot op can't recieve large dgrams - cancel it to be armed again
+                if (pOp->mpUser->mIsLargeDgrams && !pOp->mIsCancelled && !pOp->mIsSwitching) {
+                    io_uring_sqe* pSqe = _pNativeData->getSqe();
+                    if (pSqe) {
+                        pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+                        pSqe->addr = (uint64_t)pOp;
+                        pSqe->user_data = 0;
+
+                        pOp->mIsSwitching = true;
+                    }
+                }
+            }
+
+            ring.recycleBuffer(bufferId);
+            hasRecycledBuffers = true;
+        } else if (res > 0 && pOp->mpUser && pOp->mpStorage) {
+            if (pOp->mHeader.msg_flags & MSG_TRUNC) {
+                DropTruncatedDgram(*pOp->mpUser, &_stats);
+            } else {
+                reapDgram(*pOp->mpUser, &pOp->mAddress, pOp->mHeader.msg_namelen, pOp->mpStorage, (size_t)res);
+            }
+        }
+
+        if (res < 0 && pOp->mpUser && -ENOBUFS != res && -ECANCELED != res) {
+            LOGW << "failed to recieve data!";
+            _stats.mNbRecievesFails += 1;
+        }
+
+        if (!(flags & IORING_CQE_F_MORE)) {
+            if (!pOp->mIsCancelled) {
+                // multishot was terminated (e.g. the buffers ring ran dry) - re-arm it
+                io_uring_sqe* pSqe = _pNativeData->getSqe();
+                if (pSqe) {
+                    _pNativeData->prepareRecieve(pSqe, pOp, pOp->mpUser->mSocketId);
+                } else {
+                    LOGE << "Failed to re-arm io_uring recieve";
+                }
+            } else {
+                // a moved user, which the reaped dgrams may refer to, goes away with the op
+                EnqueueReapedDgrams();
+
+                RemoveUnordered(_pNativeData->mCancelledRecvOps, pOp);
+                delete pOp;
+            }
+        }
+    }
+
+    if (hasRecycledBuffers)
+        ring.commitBuffers();
+
+    EnqueueReapedDgrams();
+
+    // the latest submitted goes to the front first, so every socket keeps its order
+    std::vector<NativeData::UringSendOp*>& againOps = _pNativeData->mAgainSendOps;
+    std::sort(againOps.begin(), againOps.end(), [](const NativeData::UringSendOp* pA, const NativeData::UringSendOp* pB) {
+        return pA->mSequence > pB->mSequence;
+    });
+
+    for (NativeData::UringSendOp* pOp : againOps) {
+        pOp->mpUser->mLeftovers.push_front(std::move(pOp->mDgram));
+
+        MarkPendingOutput(*pOp->mpUser);
+
+        pOp->mpUser = nullptr;
+
+        _pNativeData->mFreeSendOps.push_back(pOp);
+    }
+
+    againOps.clear();
+#endif
+}
+
+
+void UdpReactor::EnqueueReapedDgrams() noexcept {
+
+#if defined(__linux__)
+    std::vector<NativeData::ReapedDgram>& reaped = _pNativeData->mReapedDgrams;
+    if (reaped.empty())
+        return;
+
+    PeerCache& peers = _pNativeData->mRecieveBatch.mPeers;
+    peers.intern(UdpPeerTable::Clock::now());
+
+    for (NativeData::ReapedDgram& dgram : reaped) {
+        const PeerCache::Entry& peer = peers[dgram.mPeerIndex];
+        dgram.mDgram.setSource(peer.mSource, peer.mId);
+
+        EnqueueDgram(*dgram.mpUser, std::move(dgram.mDgram), &_stats);
+        MarkPendingSpill(*dgram.mpUser);
+    }
+
+    reaped.clear();
+    peers.clear();
+#endif
+}
+
+
+size_t UdpReactor::QueueIoUringSends(UserData& udata, size_t nbMaxSends) noexcept {
+
+#if defined(__linux__)
+    std::vector<NativeData::UringSendOp*>& freeOps = _pNativeData->mFreeSendOps;
+
+    size_t nbQueued = 0;
+
+    while (nbQueued < nbMaxSends && !freeOps.empty()) {
+        UdpDgram dgram;
+        if (udata.mLeftovers.size() > 0) {
+            dgram = std::move(udata.mLeftovers.front());
+            udata.mLeftovers.pop_front();
+        } else if (!udata.mOutputQueue->dequeue(dgram)) {
+            break;
+        }
+
+        if (!dgram.valid() || !ResolvePeer(udata, dgram, &_stats))
+            continue;
+
+        io_uring_sqe* pSqe = _pNativeData->getSqe();
+        if (!pSqe) {
+            udata.mLeftovers.push_front(std::move(dgram));
+            break;
+        }
+
+        NativeData::UringSendOp* pOp = freeOps.back();
+        freeOps.pop_back();
+
+        pOp->mpUser = &udata;
+        pOp->mSequence = _pNativeData->mNbSubmittedSends++;
+        pOp->mAddress = (UdpRole::Client == udata.mRole) ? udata.mAddress : dgram.source();
+        pOp->mDgram = std::move(dgram);
+
+        memset(&pOp->mHeader, 0, sizeof(msghdr));
+        pOp->mHeader.msg_name = pOp->mAddress.nativeData();
+        pOp->mHeader.msg_namelen = pOp->mAddress.nativeDataSize();
+        pOp->mHeader.msg_iov = pOp->mIovs;
+        pOp->mHeader.msg_iovlen = GatherSegments(pOp->mDgram, pOp->mIovs);
+
+        pSqe->opcode = IORING_OP_SENDMSG;
+        pSqe->fd = udata.mSocketId;
+        pSqe->addr = (uint64_t)&pOp->mHeader;
+        pSqe->len = 1;
+        pSqe->user_data = (uint64_t)pOp | URING_SEND_OP_TAG;
+
+        ++nbQueued;
+    }
+
+    return nbQueued;
+#else
+    UNUSED(udata);
+    UNUSED(nbMaxSends);
+
+    return 0;
+#endif
+}
+
+
+void UdpReactor::ProcessWakeup() noexcept {
+
+    _pNativeData->mpWakeup->reset();
+
+    std::vector<const void*>& notifiers = _pNativeData->mNotifiers;
+    _pNativeData->mpWakeup->collect(notifiers);
+
+    // output queues, which got dgrams after being armed; a queue of a moved or detached
+    // user isn't found, its new reactor checks the queue anyway
+    for (const void* pNotifier : notifiers) {
+        auto foundIt = _pNativeData->mOutputQueueUsers.find(pNotifier);
+        if (_pNativeData->mOutputQueueUsers.end() != foundIt) {
+            MarkPendingOutput(*foundIt->second);
+        }
+    }
+
+    notifiers.clear();
+}
+
+
+void UdpReactor::MarkPendingOutput(UserData& udata) noexcept {
+
+    if (udata.mHasPendingOutput)
+        return;
+
+    udata.mHasPendingOutput = true;
+    _pNativeData->mPendingOutput.push_back(&udata);
+}
+
+
+void UdpReactor::RemovePendingOutput(size_t index) noexcept {
+
+    std::vector<UserData*>& pendingOutput = _pNativeData->mPendingOutput;
+
+    pendingOutput[index]->mHasPendingOutput = false;
+    pendingOutput[index] = pendingOutput.back();
+    pendingOutput.pop_back();
+}
+
+
+void UdpReactor::MarkPendingSpill(UserData& udata) noexcept {
+
+    if (udata.mHasPendingSpill || !udata.mpSpill || udata.mpSpill->empty())
+        return;
+
+    udata.mHasPendingSpill = true;
+    _pNativeData->mPendingSpills.push_back(&udata);
+}
+
+
+void UdpReactor::FlushPendingSpills() noexcept {
+
+    std::vector<UserData*>& pendingSpills = _pNativeData->mPendingSpills;
+
+    for (size_t i = 0; i < pendingSpills.size();) {
+        if (FlushSpill(*pendingSpills[i])) {
+            pendingSpills[i]->mHasPendingSpill = false;
+            pendingSpills[i] = pendingSpills.back();
+            pendingSpills.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+
+int UdpReactor::WaitTimeoutMs() const noexcept {
+
+    // consumers don't notify the engine, when they free the input queue - poll it instead
+    return _pNativeData->mPendingSpills.empty() ? ENGINE_WAIT_TIMEOUT_MS : SPILL_RETRY_TIMEOUT_MS;
+}
+
+
+/*static*/
+bool UdpReactor::ArmOutputWakeup(UserData& udata) noexcept {
+
+    if (udata.mLeftovers.size() > 0)
+        return true;
+
+    udata.mOutputQueue->armWakeup();
+
+    // a dgram could have been enqueued right before arming - it wouldn't notify anybody
+    UdpDgram dgram;
+    if (!udata.mOutputQueue->dequeue(dgram))
+        return false;
+
+    udata.mOutputQueue->disarmWakeup();
+    udata.mLeftovers.push_back(std::move(dgram));
+
+    return true;
+}
+
+
+UdpResult UdpReactor::DrainSocket(UserData& udata, bool isSending, size_t* pNbMoved) noexcept {
+
+    // every socket gets the same quantum per step; each call is capped by what is left of it,
+    // so nothing is overspent and carried over to the next step
+    const size_t quantum = _drainQuantum.load(std::memory_order_relaxed);
+
+    UdpResult res = eUdpResult_Ok;
+    size_t nbMoved = 0;
+
+    while (nbMoved < quantum) {
+        size_t nbDone = 0;
+        if (!isSending) {
+            res = RecieveUdpUserDgrams(udata, _pNativeData->mRecieveBatch, quantum - nbMoved, &nbDone, &_stats);
+        } else if (UdpEngineBackend::IoUring == _pNativeData->mBackend) {
+            nbDone = QueueIoUringSends(udata, quantum - nbMoved);
+        } else {
+            res = SendUdpUserDgrams(udata, _pNativeData->mSendBatch, quantum - nbMoved, &nbDone, &_stats);
+        }
+
+        nbMoved += nbDone;
+
+        if (eUdpResult_Ok != res || 0 == nbDone)
+            break;
+    }
+
+    if (nbMoved >= quantum) {
+        _stats.mNbSpentQuantums += 1;
+    }
+
+    if (!isSending) {
+        MarkPendingSpill(udata);
+    }
+
+    if (nbMoved > 0) {
+        _stats.mNbDrains += 1;
+        _stats.mMaxDrainedDgrams = std::max(_stats.mMaxDrainedDgrams, (int)nbMoved);
+    }
+
+    if (pNbMoved)
+        *pNbMoved = nbMoved;
+
+    return res;
+}
+
+
+/*static*/
+UdpResult UdpReactor::SendUdpUserDgrams( UserData& udata, SendBatch& batch, size_t nbMaxDgrams
+                                       , size_t* pNbSent, Stats* pStats )
+{
+    *pNbSent = 0;
+
+    nbMaxDgrams = std::min<size_t>(nbMaxDgrams, DGRAM_SEND_BATCH_MAX);
+
+    // leftovers go first - they were dequeued earlier than anything in the queue
+    size_t nbTaken = 0;
+    while (nbTaken < nbMaxDgrams && udata.mLeftovers.size() > 0) {
+        batch.mDgrams[nbTaken++] = std::move(udata.mLeftovers.front());
+        udata.mLeftovers.pop_front();
+    }
+
+    // the rest of the batch is claimed from the queue at once
+    nbTaken += udata.mOutputQueue->dequeueBulk(batch.mDgrams + nbTaken, nbMaxDgrams - nbTaken);
+
+    size_t nbToSend = 0;
+    for (size_t i = 0; i < nbTaken; ++i) {
+        UdpDgram& dgram = batch.mDgrams[i];
+        if (!dgram.valid() || !ResolvePeer(udata, dgram, pStats))
+            continue;
+
+        if (i != nbToSend) {
+            batch.mDgrams[nbToSend] = std::move(dgram);
+        }
+
+        ++nbToSend;
+    }
+
+    if (0 == nbToSend)
+        return eUdpResult_Ok;
+
+    auto destination = [&udata](const UdpDgram& dgram) -> const UdpAddress& {
+        return (UdpRole::Client == udata.mRole) ? udata.mAddress : dgram.source();
+    };
+
+    int nbSent;
+    int nbCalls;
+
+    bool isGsoRejected = false;
+
+#if defined(__linux__)
+    size_t nbHeaders = 0;
+    size_t nbIovs = 0;
+    for (size_t i = 0; i < nbToSend; ++nbHeaders) {
+        const UdpAddress& address = destination(batch.mDgrams[i]);
+        const size_t szSegment = batch.mDgrams[i].totalSize();
+
+        // coalesce a run of same-size dgrams to the same peer into one UDP GSO send
+        size_t nbSegments = 1;
+        if (udata.mIsGsoEnabled) {
+            while ( i + nbSegments < nbToSend
+                 && nbSegments < GSO_MAX_SEGMENTS
+                 && (nbSegments + 1) * szSegment <= GSO_MAX_SIZE
+                 && batch.mDgrams[i + nbSegments].totalSize() == szSegment
+                 && destination(batch.mDgrams[i + nbSegments]) == address )
+            {
+                ++nbSegments;
+            }
+        }
+
+        // segments of multi-segment dgrams are gathered one after another; GSO splits the whole
+        // run by the dgram size regardless of how it's scattered over iovecs
+        msghdr& header = batch.mHeaders[nbHeaders].msg_hdr;
+        memset(&header, 0, sizeof(msghdr));
+        header.msg_name = (void*)address.nativeData();
+        header.msg_namelen = address.nativeDataSize();
+        header.msg_iov = &batch.mIovs[nbIovs];
+
+        for (size_t j = i; j < i + nbSegments; ++j) {
+            nbIovs += GatherSegments(batch.mDgrams[j], &batch.mIovs[nbIovs]);
+        }
+
+        header.msg_iovlen = (size_t)(&batch.mIovs[nbIovs] - header.msg_iov);
+
+        if (nbSegments > 1) {
+            header.msg_control = batch.mControls[nbHeaders];
+            header.msg_controllen = sizeof(batch.mControls[nbHeaders]);
+
+            cmsghdr* pCmsg = CMSG_FIRSTHDR(&header);
+            pCmsg->cmsg_level = SOL_UDP;
+            pCmsg->cmsg_type = UDP_SEGMENT;
+            pCmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+            uint16_t szGsoSegment = (uint16_t)szSegment;
+            memcpy(CMSG_DATA(pCmsg), &szGsoSegment, sizeof(uint16_t));
+        }
+
+        batch.mNbSegments[nbHeaders] = nbSegments;
+
+        i += nbSegments;
+    }
+
+    int nbSentHeaders = sendmmsg(udata.mSocketId, batch.mHeaders, (unsigned)nbHeaders, 0);
+    nbCalls = 1;
+
+    if (nbSentHeaders < 0) {
+        nbSent = -1;
+
+        // EIO: the device can't checksum segments; EINVAL: the kernel doesn't know UDP_SEGMENT
+        // or the segment doesn't fit the mtu - either way, resend the batch dgram by dgram
+        if (batch.mNbSegments[0] > 1 && (EIO == errno || EINVAL == errno)) {
+            LOGW << "UDP GSO was rejected (errno == " << errno << ") - disabled for the socket";
+            udata.mIsGsoEnabled = false;
+            isGsoRejected = true;
+        }
+    } else {
+        nbSent = 0;
+        for (int i = 0; i < nbSentHeaders; ++i) {
+            nbSent += (int)batch.mNbSegments[i];
+
+            if (batch.mNbSegments[i] > 1 && pStats) {
+                pStats->mNbSegmentedDgrams += (int)batch.mNbSegments[i];
+            }
+        }
+    }
+#else
+    // no sendmmsg here: send one by one until the socket pushes back
+    for (nbSent = 0; (size_t)nbSent < nbToSend; ++nbSent) {
+        const UdpDgram& dgram = batch.mDgrams[nbSent];
+        const UdpAddress& address = destination(dgram);
+
+        iovec iovs[UdpDgram::MaxSegments];
+
+        msghdr header;
+        memset(&header, 0, sizeof(msghdr));
+        header.msg_name = (void*)address.nativeData();
+        header.msg_namelen = address.nativeDataSize();
+        header.msg_iov = iovs;
+        header.msg_iovlen = GatherSegments(dgram, iovs);
+
+        if (sendmsg(udata.mSocketId, &header, 0) < 0) {
+            if (0 == nbSent)
+                nbSent = -1;
+            break;
+        }
+    }
+
+    nbCalls = nbSent;
+#endif
+
+    int sendErrno = errno;
+
+    if (nbSent > 0 && pStats) {
+        pStats->mNbSent += nbSent;
+        pStats->mNbSendCalls += nbCalls;
+    }
+
+    size_t nbDone = nbSent > 0 ? (size_t)nbSent : 0;
+
+    *pNbSent = nbDone;
+
+    // other errors stick to the dgram (e.g. EMSGSIZE) or to its peer (e.g. ENETUNREACH), so
+    // a retry would hold the rest of the output back forever - the failing dgram is dropped
+    const bool isFailed = nbSent < 0 && !isGsoRejected && EAGAIN != sendErrno && EWOULDBLOCK != sendErrno;
+    const size_t nbFinished = isFailed ? 1 : nbDone;
+
+    // the unsent remainder goes back in front of the leftovers, keeping its order
+    for (size_t i = nbToSend; i > nbFinished; --i) {
+        udata.mLeftovers.push_front(std::move(batch.mDgrams[i - 1]));
+    }
+
+    for (size_t i = 0; i < nbFinished; ++i) {
+        batch.mDgrams[i] = UdpDgram();
+    }
+
+    if (isGsoRejected)
+        return eUdpResult_Ok;
+
+    if (nbSent < 0) {
+        if (!isFailed)
+            return eUdpResult_Again;
+
+        LOGW << "failed to send data (errno == " << sendErrno << ") - the dgram is dropped";
+        if (pStats) {
+            pStats->mNbSendFails += 1;
+        }
+
+        return eUdpResult_Failed;
+    }
+
+    // a partial batch usually means the socket buffer is full, but it also hides the
+    // error of the first unsent dgram - the next call reports either EAGAIN or the error
+    return eUdpResult_Ok;
+}
+
+
+/*static*/
+UdpResult UdpReactor::RecieveUdpUserDgrams( UserData& udata, RecieveBatch& batch, size_t nbMaxDgrams
+                                          , size_t* pNbRecieved, Stats* pStats )
+{
+    *pNbRecieved = 0;
+
+#if defined(__linux__)
+    const bool isGroEnabled = udata.mIsGroEnabled;
+    const bool hasStorages = isGroEnabled || udata.mIsLargeDgrams;
+
+    // a coalesced buffer carries several dgrams, but the count is known only after recieving
+    size_t nbToRecieve = std::min<size_t>(nbMaxDgrams, udata.mRecieveBatchSize);
+
+    for (size_t i = 0; i < nbToRecieve; ++i) {
+        msghdr& header = batch.mHeaders[i].msg_hdr;
+        header.msg_name = &batch.mAddresses[i];
+        header.msg_namelen = sizeof(sockaddr_in);
+
+        if (!batch.preparePayload(i)) {
+            // recieve into the buffers we've got; the rest stays in the socket
+            nbToRecieve = i;
+            break;
+        }
+
+        if (hasStorages) {
+            if (!batch.prepareStorage(i)) {
+                nbToRecieve = i;
+                break;
+            }
+
+            batch.mStorageIovs[i][0] = batch.mIovs[i];
+            batch.mStorageIovs[i][1].iov_base = batch.mStorages[i] + DGRAM_MAXLINE;
+            batch.mStorageIovs[i][1].iov_len = STORAGE_SIZE - DGRAM_MAXLINE;
+
+            header.msg_iov = batch.mStorageIovs[i];
+            header.msg_iovlen = 2;
+            header.msg_control = batch.mGroControls[i];
+            header.msg_controllen = sizeof(batch.mGroControls[i]);
+        } else {
+            header.msg_iov = &batch.mIovs[i];
+            header.msg_iovlen = 1;
+            header.msg_control = nullptr;
+            header.msg_controllen = 0;
+        }
+    }
+
+    if (0 == nbToRecieve) {
+        LOGW << "Failed to allocate recieve buffers";
+        if (pStats) {
+            pStats->mNbRecievesFails += 1;
+        }
+
+        return eUdpResult_Failed;
+    }
+
+    int nbRecieved = recvmmsg(udata.mSocketId, batch.mHeaders, (unsigned)nbToRecieve, 0, nullptr);
+
+    if (nbRecieved < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+        return eUdpResult_Again;
+    }
+
+    if (nbRecieved <= 0) {
+        LOGW << "failed to recieve data!";
+        if (pStats) {
+            pStats->mNbRecievesFails += 1;
+        }
+
+        return eUdpResult_Failed;
+    }
+
+    if (pStats) {
+        pStats->mNbRecieveCalls += 1;
+    }
+
+    // the peers go first, so each of them is interned once with all its dgrams of the batch
+    PeerCache& peers = batch.mPeers;
+    for (int i = 0; i < nbRecieved; ++i) {
+        const msghdr& header = batch.mHeaders[i].msg_hdr;
+        if (header.msg_flags & MSG_TRUNC)
+            continue;
+
+        const size_t szData = batch.mHeaders[i].msg_len;
+        const size_t szSegment = hasStorages ? GroSegmentSize(header, szData) : szData;
+        const size_t nbDgrams = (szSegment > 0 && szSegment < szData) ? (szData + szSegment - 1) / szSegment : 1;
+
+        batch.mPeerIndices[i] = peers.add(udata.mpPeers.get(), &batch.mAddresses[i], header.msg_namelen, nbDgrams, szData);
+    }
+
+    peers.intern(UdpPeerTable::Clock::now());
+
+    for (int i = 0; i < nbRecieved; ++i) {
+        if (batch.mHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            DropTruncatedDgram(udata, pStats);
+            continue;
+        }
+
+        const PeerCache::Entry& peer = peers[batch.mPeerIndices[i]];
+        if (hasStorages) {
+            EnqueueCoalescedDgrams(udata, batch, (size_t)i, peer.mSource, peer.mId, pStats);
+        } else {
+            EnqueueRecievedPayload(udata, peer.mSource, peer.mId, batch.mPayloads[i], batch.mHeaders[i].msg_len, pStats);
+        }
+    }
+
+    peers.clear();
+
+    // a coalesced buffer is copied once and split without copies, so it costs a single dgram
+    *pNbRecieved = (size_t)nbRecieved;
+
+    // a short batch means the socket was drained - save the edge-triggered
+    // backends a syscall, which would return EAGAIN anyway
+    return (size_t)nbRecieved < nbToRecieve ? eUdpResult_Again : eUdpResult_Ok;
+#else
+    const size_t nbToRecieve = std::min<size_t>(nbMaxDgrams, udata.mRecieveBatchSize);
+
+    // no recvmmsg here: at least drain up to a batch per call
+    for (size_t i = 0; i < nbToRecieve; ++i) {
+        const bool hasStorage = udata.mIsLargeDgrams;
+
+        if (!batch.preparePayload(0) || (hasStorage && !batch.prepareStorage(0))) {
+            LOGW << "Failed to allocate recieve buffers";
+            if (pStats) {
+                pStats->mNbRecievesFails += 1;
+            }
+
+            return eUdpResult_Failed;
+        }
+
+        // large dgrams spill past the payload buffer into the storage
+        iovec iovs[2];
+        iovs[0].iov_base = batch.mPayloads[0];
+        iovs[0].iov_len = DGRAM_MAXLINE;
+        iovs[1].iov_base = hasStorage ? batch.mStorages[0] + DGRAM_MAXLINE : nullptr;
+        iovs[1].iov_len = STORAGE_SIZE - DGRAM_MAXLINE;
+
+        msghdr header;
+        memset(&header, 0, sizeof(msghdr));
+        header.msg_name = &batch.mAddresses[0];
+        header.msg_namelen = sizeof(sockaddr_in);
+        header.msg_iov = iovs;
+        header.msg_iovlen = hasStorage ? 2 : 1;
+
+        int nbReadBytes = (int)recvmsg(udata.mSocketId, &header, 0);
+
+        if (nbReadBytes < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+            return eUdpResult_Again;
+        }
+
+        if (nbReadBytes <= 0) {
+            LOGW << "failed to recieve data!";
+            if (pStats) {
+                pStats->mNbRecievesFails += 1;
+            }
+
+            return eUdpResult_Failed;
+        }
+
+        if (pStats) {
+            pStats->mNbRecieveCalls += 1;
+        }
+
+        if (header.msg_flags & MSG_TRUNC) {
+            DropTruncatedDgram(udata, pStats);
+        } else {
+            // one dgram per syscall here - the batch of peers is a single one
+            PeerCache& peers = batch.mPeers;
+            peers.add(udata.mpPeers.get(), &batch.mAddresses[0], header.msg_namelen, 1, nbReadBytes);
+            peers.intern(UdpPeerTable::Clock::now());
+
+            if ((size_t)nbReadBytes > DGRAM_MAXLINE) {
+                memcpy(batch.mStorages[0], batch.mPayloads[0], DGRAM_MAXLINE);
+                EnqueueRecievedDgram(udata, peers[0].mSource, peers[0].mId, batch.mStorages[0], nbReadBytes, pStats);
+            } else {
+                EnqueueRecievedPayload(udata, peers[0].mSource, peers[0].mId, batch.mPayloads[0], nbReadBytes, pStats);
+            }
+
+            peers.clear();
+        }
+
+        *pNbRecieved += 1;
+    }
+
+    return eUdpResult_Ok;
+#endif
+}
+
+
+/*static*/
+void UdpReactor::DropTruncatedDgram(UserData& udata, Stats* pStats) {
+
+    if (!udata.mIsLargeDgrams.exchange(true)) {
+        LOGW << "Dgram larger than " << DGRAM_MAXLINE << " bytes was truncated - dropped; the socket recieves large dgrams since now";
+    }
+
+    if (pStats) {
+        pStats->mNbTruncatedDgrams += 1;
+    }
+}
+
+
+/*static*/
+void UdpReactor::EnqueueRecievedDgram( UserData& udata, const UdpAddress& source, UdpPeerId peer
+                                    , const uint8_t* pData, size_t szData, Stats* pStats )
+{
+    UdpDgram dgram = UdpDgram::Allocate(source, szData);
+    if (!dgram.valid()) {
+        LOGW << "Failed to allocate recieved dgram - dropped";
+        if (pStats) {
+            pStats->mNbInputDropped += 1;
+        }
+
+        return;
+    }
+
+    memcpy(dgram.data(), pData, szData);
+
+    dgram.setPeer(peer);
+
+    EnqueueDgram(udata, std::move(dgram), pStats);
+}
+
+
+/*static*/
+void UdpReactor::EnqueueRecievedPayload( UserData& udata, const UdpAddress& source, UdpPeerId peer
+                                      , uint8_t*& pPayload, size_t szData, Stats* pStats )
+{
+    if (szData <= DGRAM_TRIM_SIZE) {
+        // the buffer stays in the batch for the next recieve
+        EnqueueRecievedDgram(udata, source, peer, pPayload, szData, pStats);
+        return;
+    }
+
+    UdpDgram dgram = UdpDgram::Adopt(source, pPayload, szData);
+    pPayload = nullptr;
+
+    dgram.setPeer(peer);
+
+    EnqueueDgram(udata, std::move(dgram), pStats);
+}
+
+
+/*static*/
+void UdpReactor::EnqueueCoalescedDgrams( UserData& udata, RecieveBatch& batch, size_t index
+                                       , const UdpAddress& source, UdpPeerId peer, Stats* pStats )
+{
+
+#if defined(__linux__)
+    uint8_t* pData = batch.mStorages[index];
+    size_t szData = batch.mHeaders[index].msg_len;
+
+    size_t szSegment = GroSegmentSize(batch.mHeaders[index].msg_hdr, szData);
+
+    if (szSegment >= szData && szData <= DGRAM_MAXLINE) {
+        // nothing was coalesced and the dgram fits the payload buffer - the storage stays in the batch
+        // (this is the path of almost any dgram of a socket with large dgrams)
+        EnqueueRecievedPayload(udata, source, peer, batch.mPayloads[index], szData, pStats);
+        return;
+    }
+
+    // the head of the data is in the payload buffer, which is kept for the next recieve
+    memcpy(pData, batch.mPayloads[index], std::min<size_t>(szData, DGRAM_MAXLINE));
+
+    if (szSegment >= szData) {
+        // a single big dgram - don't pin the whole storage with it
+        EnqueueRecievedDgram(udata, source, peer, pData, szData, pStats);
+        return;
+    }
+
+    // the storage is handed over to the segments - the next recieve allocates a new one;
+    // all of them come from the same peer, which is interned along with the batch already
+    UdpDgram coalesced = UdpDgram::Adopt(source, pData, szData);
+    coalesced.setPeer(peer);
+
+    batch.mStorages[index] = nullptr;
+
+    for (size_t offset = 0; offset < szData; offset += szSegment) {
+        if (pStats) {
+            pStats->mNbCoalescedDgrams += 1;
+        }
+
+        EnqueueDgram(udata, coalesced.slice(offset, szSegment), pStats);
+    }
+#else
+    UNUSED(udata);
+    UNUSED(batch);
+    UNUSED(index);
+    UNUSED(source);
+    UNUSED(peer);
+    UNUSED(pStats);
+#endif
+}
+
+
+/*static*/
+bool UdpReactor::ResolvePeer(UserData& udata, UdpDgram& dgram, Stats* pStats) {
+
+    // clients send to their address anyway; a dgram with the address doesn't need the peer table
+    if (UdpRole::Client == udata.mRole || 0 == dgram.peer() || dgram.source().valid())
+        return true;
+
+    UdpAddress address;
+    if (udata.mpPeers && udata.mpPeers->resolve(dgram.peer(), &address)) {
+        dgram.setSource(address, dgram.peer());
+        return true;
+    }
+
+    LOGW << "Dgram is addressed to an unknown peer " << dgram.peer() << " - dropped";
+    if (pStats) {
+        pStats->mNbUnresolvedDgrams += 1;
+    }
+
+    dgram = UdpDgram();
+
+    return false;
+}
+
+
+/*static*/
+void UdpReactor::EnqueueDgram(UserData& udata, UdpDgram&& dgram, Stats* pStats) {
+
+    if (pStats) {
+        pStats->mNbRecieved += 1;
+    }
+
+    // spilled dgrams go first - nothing overtakes them
+    const bool hasSpilled = udata.mpSpill && !FlushSpill(udata);
+
+    // a failed enqueue leaves the dgram intact
+    if (hasSpilled || !udata.mInputQueue->enqueue(std::move(dgram))) {
+        OverflowInputQueue(udata, std::move(dgram), pStats);
+    }
+}
+
+
+/*static*/
+void UdpReactor::OverflowInputQueue(UserData& udata, UdpDgram&& dgram, Stats* pStats) {
+
+    if (!udata.mHasOverflowed) {
+        udata.mHasOverflowed = true;
+        LOGW << "Input queue of socket " << udata.mSocketId << " overflowed - see the overflow counters of the stats";
+    }
+
+    Stats ignored;
+    Stats& stats = pStats ? *pStats : ignored;
+
+    switch (udata.mOverflowPolicy) {
+    case UdpOverflowPolicy::DropOldest:
+        for (int i = 0; i < OVERFLOW_MAX_EVICTIONS; ++i) {
+            UdpDgram oldest;
+            if (udata.mInputQueue->dequeue(oldest)) {
+                stats.mNbDroppedOldest += 1;
+                stats.mNbInputDropped += 1;
+            }
+
+            if (udata.mInputQueue->enqueue(std::move(dgram)))
+                return;
+        }
+
+        break;
+    case UdpOverflowPolicy::Spill:
+        // a user moved away from the thread takes the spill ring along - its last dgrams are dropped
+        if (!udata.mpSpill)
+            break;
+
+        if (udata.mpSpill->push(std::move(dgram))) {
+            stats.mNbSpilled += 1;
+        } else {
+            stats.mNbSpillDropped += 1;
+            stats.mNbInputDropped += 1;
+        }
+
+        return;
+    default:
+        break;
+    }
+
+    stats.mNbDroppedNewest += 1;
+    stats.mNbInputDropped += 1;
+}
+
+
+/*static*/
+bool UdpReactor::FlushSpill(UserData& udata) noexcept {
+
+    SpillRing& spill = *udata.mpSpill;
+
+    while (!spill.empty()) {
+        if (!udata.mInputQueue->enqueue(std::move(spill.front())))
+            return false;
+
+        spill.pop();
+    }
+
+    return true;
+}
+
+
+UdpReactor::SpillRing::SpillRing(size_t capacity) noexcept
+    : mDgrams(std::make_unique<UdpDgram[]>(ToPowerOf2(capacity)))
+    , mMask(ToPowerOf2(capacity) - 1)
+{
+}
+
+
+bool UdpReactor::SpillRing::push(UdpDgram&& dgram) noexcept {
+
+    if (mCount > mMask)
+        return false;
+
+    mDgrams[(mHead + mCount) & mMask] = std::move(dgram);
+    mCount += 1;
+
+    return true;
+}
+
+
+void UdpReactor::SpillRing::pop() noexcept {
+
+    mDgrams[mHead] = UdpDgram();
+    mHead = (mHead + 1) & mMask;
+    mCount -= 1;
+}
@@ -0,0 +1,282 @@
+#ifndef UDP_SOCKETS_UDPREACTOR_HPP_
+#define UDP_SOCKETS_UDPREACTOR_HPP_
+
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "commons/macros.h"
+#include "commons/types.h"
+
+#include "commons/threader.hpp"
+
+#include "sockets/udpaddress.hpp"
+#include "sockets/udpdgram.hpp"
+#include "sockets/udpengine.hpp"
+#include "sockets/udppeers.hpp"
+
+
+namespace udp { ;
+namespace sockets { ;
+namespace priv { ;
+
+
+//! One engine thread with its own readiness backend and its own subset of the attached sockets;
+//! the UdpEngine spreads sockets (and shards of sockets) over its reactors.
+class UdpReactor final {
+    NOCOPY(UdpReactor)
+    NOMOVE(UdpReactor)
+public:
+
+    using Stats = UdpEngine::Stats;
+    using ThreadLoad = UdpEngine::ThreadLoad;
+
+    explicit UdpReactor(UdpEngineBackend backend) noexcept;
+   ~UdpReactor() noexcept;
+
+    UdpResult startUp () noexcept;
+    UdpResult tearDown() noexcept;
+
+    bool isRunning() const noexcept;
+
+    //! creates a socket for the user and starts serving it; with `isReusePort` several
+    //! reactors can bind sockets to the same address (SO_REUSEPORT). Shards of a socket
+    //! share the peer table; a socket without `isSending` only recieves - its output queue
+    //! is served by another reactor.
+    UdpResult attachSocket( IUdpUser* pUser, UdpRole role, const UdpAddress& address, bool isReusePort
+                          , const UdpSocketConfig& config
+                          , UdpDgramQueue::SPtr pInputQueue, UdpDgramQueue::SPtr pOutputQueue, bool isSending
+                          , UdpPeerTable::SPtr pPeers, int* pSocketId ) noexcept;
+
+    //! closes the socket of the user; doesn't notify the user. Waits for the running reactor
+    //! thread to apply the change, so the socket is closed on return.
+    UdpResult detachSocket(IUdpUser* pUser) noexcept;
+
+    //! hands the open socket of the user with its queues and leftovers over to `target`. Returns
+    //! eUdpResult_NotImplemented, if the backend can't hand the socket over - it stays served by
+    //! this reactor then; the socket is closed on other failures.
+    UdpResult moveSocket(IUdpUser* pUser, UdpReactor& target) noexcept;
+
+    UdpResult setRecieveBatchSize(IUdpUser* pUser, size_t nbDgrams) noexcept;
+    UdpResult setSegmentationOffload(IUdpUser* pUser, bool isEnabled) noexcept;
+    UdpResult setLargeDgrams(IUdpUser* pUser, bool isEnabled) noexcept;
+
+    UdpResult socketConfig(IUdpUser* pUser, UdpSocketConfig* pConfig) noexcept;
+
+    void setDrainQuantum(size_t nbDgrams) noexcept;
+
+    UdpEngineBackend backend() const noexcept;
+
+    //! waits for the running reactor thread to finish its current step, so the stats are exact.
+    Stats stats() noexcept;
+
+    size_t nbUsers() noexcept;
+
+    //! stats in the load are the ones published by the last finished step.
+    ThreadLoad load() noexcept;
+
+private:
+
+    void FindAndFixBadSocketId() noexcept;
+    void InvalidateUsersWithLargeSocketId() noexcept;
+
+    //! fifo of recieved dgrams, which didn't fit the input queue (UdpOverflowPolicy::Spill);
+    //! touched by the reactor thread only.
+    struct SpillRing {
+        explicit SpillRing(size_t capacity) noexcept;
+
+        bool push(UdpDgram&& dgram) noexcept;
+        void pop () noexcept;
+
+        UdpDgram& front() noexcept { return mDgrams[mHead]; }
+
+        bool   empty   () const noexcept { return 0 == mCount; }
+        size_t capacity() const noexcept { return mMask + 1; }
+
+        std::unique_ptr<UdpDgram[]> mDgrams;
+        size_t mMask;
+        size_t mHead{0};
+        size_t mCount{0};
+    };
+
+    struct UserData {
+        IUdpUser* mpUser{nullptr};
+
+        UdpAddress mAddress;
+
+        UdpDgramQueue::SPtr mInputQueue;
+        UdpDgramQueue::SPtr mOutputQueue;
+        bool                mIsSending{true}; ///< false for shards, which leave the merged output queue to the first one
+
+        UdpPeerTable::SPtr mpPeers; ///< source addresses of recieved dgrams
+
+        int mSocketId;
+
+        UdpRole mRole;
+
+        std::list<UdpDgram> mLeftovers;
+
+        UdpOverflowPolicy          mOverflowPolicy{UdpOverflowPolicy::DropNewest};
+        std::unique_ptr<SpillRing> mpSpill; ///< Spill only
+
+        std::atomic<size_t> mRecieveBatchSize{0}; ///< configured by control threads
+        std::atomic<bool>   mIsGsoEnabled{false};
+        std::atomic<bool>   mIsLargeDgrams{false}; ///< set by control threads or on the first truncated dgram
+
+        bool mIsGroEnabled{false};
+
+        bool mIsRegistered{false};   ///< reactor thread only: the socket is served by the backend
+
+        bool mIsReadable{false};     ///< edge-triggered backends only: set until recv reports EAGAIN
+        bool mIsWriteBlocked{false}; ///< epoll only: send reported EAGAIN, EPOLLOUT is awaited
+        bool mHasPendingOutput{false}; ///< has leftovers or the output queue isn't armed
+        bool mHasPendingSpill{false};  ///< reactor thread only: the spill ring waits for room in the input queue
+        bool mHasOverflowed{false};    ///< the input queue overflowed at least once (it's logged once)
+    };
+
+    //! immutable version of the users table. Control threads publish a new version per change;
+    //! the reactor thread picks up the latest one at the start of a step without locking, applies
+    //! changes of the versions it missed to the backend and frees them, since it is the only reader.
+    struct UsersSnapshot {
+        std::vector<UserData*> mUsers;
+
+        UserData* mpChanged{nullptr}; ///< the user added or removed by this version
+        bool      mIsAdded{false};
+        bool      mIsMoved{false};    ///< the removed user is handed over, its socket stays open
+
+        UsersSnapshot* mpPrevious{nullptr}; ///< valid until the reactor thread picks this version up
+    };
+
+    struct NativeData;
+    struct PeerCache;
+    struct RecieveBatch;
+    struct SendBatch;
+
+    //! must be called with the users table lock taken; returns the number of published versions.
+    uint64_t PublishUsers(UserData* pChanged, bool isAdded, bool isMoved) noexcept;
+
+    //! called by the reactor thread (or by a control thread, while the reactor isn't running).
+    void ApplyUsersSnapshot() noexcept;
+
+    //! returns once the first `nbVersions` users versions are applied - by the running reactor
+    //! thread, or by the calling one, if the reactor isn't running.
+    void WaitForUsersApplied(uint64_t nbVersions) noexcept;
+
+    //! returns once the running reactor thread has made a whole step after the call.
+    void SyncWithReactorThread() noexcept;
+
+    bool RegisterSocket  (UserData& udata) noexcept;
+    void UnregisterSocket(UserData& udata, bool isMoving = false) noexcept;
+
+    void PublishStats() noexcept;
+
+    void ProcessWakeup() noexcept;
+
+    void MarkPendingOutput(UserData& udata) noexcept;
+    void RemovePendingOutput(size_t index) noexcept;
+
+    static bool ArmOutputWakeup(UserData& udata) noexcept;
+
+    //! remembers the user, if its spill ring has dgrams; the steps wait for the input queue to
+    //! get room then.
+    void MarkPendingSpill(UserData& udata) noexcept;
+
+    //! moves spilled dgrams of every pending user to the input queues, as far as they fit.
+    void FlushPendingSpills() noexcept;
+
+    //! how long a step may wait for readiness.
+    int WaitTimeoutMs() const noexcept;
+
+    //! moves dgrams of the user in one direction until the socket or the queue runs dry, or the
+    //! drain quantum is spent; returns eUdpResult_Again if the socket reported EAGAIN.
+    UdpResult DrainSocket(UserData& udata, bool isSending, size_t* pNbMoved = nullptr) noexcept;
+
+    static Threader::StepResult DoEngineStep(void* pOpaqueSelf);
+
+    Threader::StepResult DoSelectStep () noexcept;
+    Threader::StepResult DoEpollStep  () noexcept;
+    Threader::StepResult DoIoUringStep() noexcept;
+
+    bool SetUpIoUring() noexcept;
+    void ReapIoUringCompletions() noexcept;
+    size_t QueueIoUringSends(UserData& udata, size_t nbMaxSends) noexcept;
+
+    static UdpResult SendUdpUserDgrams   ( UserData& udata, SendBatch& batch, size_t nbMaxDgrams
+                                         , size_t* pNbSent, Stats* pStats );
+    static UdpResult RecieveUdpUserDgrams( UserData& udata, RecieveBatch& batch, size_t nbMaxDgrams
+                                         , size_t* pNbRecieved, Stats* pStats );
+
+    //! counts the dgram, which didn't fit the recieve buffer, and makes the socket recieve large dgrams.
+    static void DropTruncatedDgram(UserData& udata, Stats* pStats);
+
+    static void EnqueueRecievedDgram( UserData& udata, const UdpAddress& source, UdpPeerId peer
+                                    , const uint8_t* pData, size_t szData, Stats* pStats );
+
+    //! hands the recieve buffer over to the dgram (`pPayload` is reset then), unless the dgram
+    //! is small enough to be copied out.
+    static void EnqueueRecievedPayload( UserData& udata, const UdpAddress& source, UdpPeerId peer
+                                      , uint8_t*& pPayload, size_t szData, Stats* pStats );
+
+    static void EnqueueCoalescedDgrams( UserData& udata, RecieveBatch& batch, size_t index
+                                      , const UdpAddress& source, UdpPeerId peer, Stats* pStats );
+
+    //! interns the peers of the dgrams copied out of the completions and enqueues the dgrams.
+    void EnqueueReapedDgrams() noexcept;
+
+    //! lets the peer tables of the users sweep idle peers out - off the recieve path.
+    void ExpireIdlePeers() noexcept;
+
+    //! gives a dgram addressed by a peer id only the address of the peer; returns false (and
+    //! drops the dgram) if the peer is unknown or expired.
+    static bool ResolvePeer(UserData& udata, UdpDgram& dgram, Stats* pStats);
+
+    static void EnqueueDgram(UserData& udata, UdpDgram&& dgram, Stats* pStats);
+
+    //! applies the overflow policy of the user to the dgram, which didn't fit the input queue.
+    static void OverflowInputQueue(UserData& udata, UdpDgram&& dgram, Stats* pStats);
+
+    //! returns true if the spill ring is empty afterwards.
+    static bool FlushSpill(UserData& udata) noexcept;
+
+    std::mutex                               _usersTableM; ///< serializes control threads only
+    std::unordered_map<IUdpUser*, UserData*> _usersTable;
+
+    std::atomic<UsersSnapshot*> _pPublishedUsers;
+    uint64_t                    _nbPublishedUsers{0}; ///< guarded by the users table lock
+    std::atomic<uint64_t>       _nbAppliedUsers{0};
+
+    UsersSnapshot* _pUsers; ///< reactor thread only: the version served by the backend
+
+    NativeData* _pNativeData;
+
+    std::mutex     _runningM; ///< serializes starts and stops with applies on control threads
+    Threader::UPtr _pThreader;
+
+    std::atomic<uint64_t> _nbSteps{0};
+
+    std::atomic<size_t> _drainQuantum{UdpEngine::DefaultDrainQuantum};
+    std::atomic<bool>     _isStopping{false}; ///< the reactor thread doesn't wait while set
+
+    Stats _stats; ///< reactor thread only
+
+    std::chrono::steady_clock::time_point _rateWindowTp;
+    std::chrono::steady_clock::time_point _peersExpiryTp; ///< reactor thread only
+    int _rateWindowNbDgrams{0};
+
+    std::mutex _publishedStatsM;
+    Stats      _publishedStats;
+    float      _recentRate{0.0f};
+};
+
+
+} // namespace priv
+} // namespace sockets
+} // namespace udp
+
+
+#endif//UDP_SOCKETS_UDPREACTOR_HPP_
@@ -0,0 +1,97 @@
+#include "sockets/udpwakeup.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#   include <sys/eventfd.h>
+#endif
+
+#include "commons/logger.hpp"
+
+
+using namespace udp;
+using namespace sockets::priv;
+
+
+UdpWakeup::UdpWakeup() noexcept {
+
+#if defined(__linux__)
+    _waitId = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _wakeId = _waitId;
+#else
+    int pipeIds[2];
+    if (0 == pipe(pipeIds)) {
+        for (int id : pipeIds) {
+            int flags = fcntl(id, F_GETFL, 0);
+            fcntl(id, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        _waitId = pipeIds[0];
+        _wakeId = pipeIds[1];
+    }
+#endif
+
+    if (_waitId < 0) {
+        LOGE << "Failed to create wakeup descriptor (errno == " << errno << ")";
+    }
+}
+
+
+UdpWakeup::~UdpWakeup() noexcept {
+
+    if (_waitId >= 0)
+        close(_waitId);
+
+    if (_wakeId >= 0 && _wakeId != _waitId)
+        close(_wakeId);
+}
+
+
+void UdpWakeup::wake() noexcept {
+
+    if (_isSignaled.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    uint64_t value = 1;
+    ssize_t res = write(_wakeId, &value, sizeof(value));
+    UNUSED(res); // a full counter or pipe means the thread is going to wake up anyway
+}
+
+
+void UdpWakeup::notify(const void* pNotifier) noexcept {
+
+    TRY_LOCKED(_notifiers) {
+        _notifiers.push_back(pNotifier);
+    } UNLOCK;
+
+    wake();
+}
+
+
+void UdpWakeup::reset() noexcept {
+
+    // clear the flag first: a wake after this point writes again and isn't lost
+    _isSignaled.store(false, std::memory_order_seq_cst);
+
+    uint64_t values[8];
+    while (read(_waitId, values, sizeof(values)) > 0) {
+#if defined(__linux__)
+        break; // eventfd is drained by a single read
+#endif
+    }
+}
+
+
+void UdpWakeup::collect(std::vector<const void*>& notifiers) noexcept {
+
+    TRY_LOCKED(_notifiers) {
+        if (notifiers.empty()) {
+            notifiers.swap(_notifiers);
+        } else {
+            notifiers.insert(notifiers.end(), _notifiers.begin(), _notifiers.end());
+            _notifiers.clear();
+        }
+    } UNLOCK;
+}
@@ -0,0 +1,64 @@
+#ifndef UDP_SOCKETS_UDPWAKEUP_HPP_
+#define UDP_SOCKETS_UDPWAKEUP_HPP_
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "commons/macros.h"
+#include "commons/types.h"
+
+
+namespace udp { ;
+namespace sockets { ;
+namespace priv { ;
+
+
+//! wakes an engine thread up from waiting for socket events: an eventfd on linux, a pipe
+//! elsewhere. `waitId` is polled for readability together with the sockets.
+class UdpWakeup final {
+    NOCOPY(UdpWakeup)
+    NOMOVE(UdpWakeup)
+public:
+
+    using SPtr = std::shared_ptr<UdpWakeup>;
+
+    UdpWakeup() noexcept;
+   ~UdpWakeup() noexcept;
+
+    bool valid() const noexcept { return _waitId >= 0; }
+
+    int waitId() const noexcept { return _waitId; }
+
+    //! wakes the waiting thread up; wakeups are coalesced until the next `reset`.
+    void wake() noexcept;
+
+    //! remembers who woke the thread up (e.g. an output queue, which got a dgram) and wakes it.
+    void notify(const void* pNotifier) noexcept;
+
+    //! called by the woken thread before it processes anything, so no wakeup is lost.
+    void reset() noexcept;
+
+    //! moves notifiers collected since the last call to `notifiers`.
+    void collect(std::vector<const void*>& notifiers) noexcept;
+
+private:
+
+    int _waitId{-1};
+    int _wakeId{-1};
+
+    std::atomic<bool> _isSignaled{false};
+
+    std::mutex               _notifiersM;
+    std::vector<const void*> _notifiers;
+};
+
+
+} // namespace priv
+} // namespace sockets
+} // namespace udp
+
+
+#endif//UDP_SOCKETS_UDPWAKEUP_HPP_